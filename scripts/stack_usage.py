@@ -0,0 +1,276 @@
+"""
+Stack Usage Report
+
+Worst-case stack depth of each call path in the firmware, from the per
+function frame sizes that -fstack-usage writes next to every object file
+(.su) and the call graph read from the disassembly of the linked ELF.
+
+Runs after the build as a PlatformIO extra script (see platformio.ini), or
+on its own:
+
+  python3 scripts/stack_usage.py --elf firmware.elf --su-dir <build dir>
+      [--objdump avr-objdump] [--call-cost 3] [--report stack-usage.txt]
+      [--indirect caller=callee,callee ...]
+
+Frame sizes are matched to symbols by qualified name; overloads and
+template instances of a name all get the largest of their frames. Calls
+through pointers are only followed where they are listed with --indirect
+(INDIRECT_CALLS for the firmware: the scheduler tasks and the modem
+callbacks). Other functions nobody calls directly are reported as roots of
+their own. Calls that close a cycle are cut and listed, so a recursion
+counts once. An interrupt can land on top of the deepest path.
+"""
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+# Call and tail-jump mnemonics of AVR and x86 (the host simulator build)
+CALLS = re.compile(r"\s(call|rcall|jmp|rjmp|callq|jmpq)\s.*<([^>+]+)>\s*$")
+INDIRECT = re.compile(r"\s(icall|eicall|ijmp|eijmp)\b|\s(call|callq|jmp|jmpq)\s+\*")
+FUNCTION = re.compile(r"^[0-9a-f]+ <(.+)>:$")
+
+# Calls the firmware makes through function pointers. runTask() may be
+# inlined into runDueTasks(), so both get the tasks. A task waiting in
+# schedulerDelay() has the background tasks run on top of it. The modem
+# token handlers, SMS callback and command result callback are called from
+# the tokenizer, which may be inlined up to Poll().
+BACKGROUND_TASKS = ["inputTask", "soundTask"]
+TASKS = BACKGROUND_TASKS + ["gsmTask", "notificationTask", "outboxTask",
+                            "inboxTask", "slaveSyncTask", "profilerTask"]
+MODEM_HANDLERS = ["SerialGSM::on" + name for name in
+                  ["OK", "Error", "EquipmentError", "SMS", "StoredSMS", "ReadSMS",
+                   "Storage", "Ring", "CallEnded", "CallState", "Registration",
+                   "ModemStarted", "CallReady", "NoSIM", "PowerDown"]]
+MODEM_CALLBACKS = MODEM_HANDLERS + ["onReceiveSMS", "onCommandResult", "onInboxResult"]
+INDIRECT_CALLS = {
+    "runTask": TASKS,
+    "runDueTasks": TASKS,
+    "schedulerDelay": BACKGROUND_TASKS,
+    "schedulerYield": BACKGROUND_TASKS,
+    "SerialGSM::endLine": MODEM_HANDLERS,
+    "SerialGSM::finish": ["onCommandResult", "onInboxResult"],
+    "SerialGSM::Feed": MODEM_CALLBACKS,
+    "SerialGSM::Poll": MODEM_CALLBACKS,
+}
+
+
+def base_name(signature):
+    """Qualified name of a function without return type, parameters or
+    template arguments: 'void LogRecord::add(const char*)' -> 'LogRecord::add'"""
+    signature = re.sub(r"\s*\[with .*\]$", "", signature.strip())
+    depth = 0
+    for i, c in enumerate(signature):
+        if c == "<":
+            depth += 1
+        elif c == ">":
+            depth -= 1
+        elif c == "(" and depth == 0 and i > 0:
+            signature = signature[:i]
+            break
+    name = re.sub(r"<[^<>]*>", "", signature)
+    while "<" in name:
+        name = re.sub(r"<[^<>]*>", "", name)
+    return name.split()[-1].lstrip("*&") if name.split() else name
+
+
+def read_frames(su_dir):
+    """Largest frame per function name, and whether any was dynamic"""
+    frames = {}
+    for root, _, files in os.walk(su_dir):
+        for file in files:
+            if not file.endswith(".su"):
+                continue
+            with open(os.path.join(root, file)) as su:
+                for line in su:
+                    parts = line.rstrip("\n").split("\t")
+                    if len(parts) < 3:
+                        continue
+                    location, size, kind = parts[0], int(parts[1]), parts[2]
+                    fields = location.split(":", 3)
+                    name = base_name(fields[3] if len(fields) == 4 else location)
+                    dynamic = "dynamic" in kind
+                    old = frames.get(name, (0, False))
+                    frames[name] = (max(old[0], size), old[1] or dynamic)
+    return frames
+
+
+def read_calls(objdump, elf):
+    """Direct callees and indirect call sites of every function symbol"""
+    listing = subprocess.run([objdump, "-d", "-C", elf], check=True,
+                             stdout=subprocess.PIPE, universal_newlines=True).stdout
+    calls = {}
+    indirect = set()
+    current = None
+    for line in listing.splitlines():
+        match = FUNCTION.match(line)
+        if match:
+            current = base_name(match.group(1))
+            calls.setdefault(current, set())
+            continue
+        if current is None:
+            continue
+        match = CALLS.search(line)
+        if match:
+            target = base_name(match.group(2).split("@")[0])
+            if target != current:
+                calls[current].add(target)
+        elif INDIRECT.search(line):
+            indirect.add(current)
+    return calls, indirect
+
+
+def cut_cycles(calls, order):
+    """Remove the calls that close a cycle, visiting from the given functions
+    first. The graph left is acyclic.
+
+    Returns the calls removed, as (caller, callee)"""
+    state = {}   # 1 while on the DFS stack, 2 once done
+    cut = []
+    for start in order:
+        if start in state:
+            continue
+        state[start] = 1
+        stack = [(start, iter(sorted(calls.get(start, ()))))]
+        while stack:
+            name, callees = stack[-1]
+            callee = next(callees, None)
+            if callee is None:
+                state[name] = 2
+                stack.pop()
+            elif state.get(callee) == 1:
+                cut.append((name, callee))
+            elif callee not in state:
+                state[callee] = 1
+                stack.append((callee, iter(sorted(calls.get(callee, ())))))
+    for caller, callee in cut:
+        calls[caller].discard(callee)
+    return cut
+
+
+class Analysis:
+    def __init__(self, frames, calls, call_cost):
+        self.frames = frames
+        self.calls = calls
+        self.call_cost = call_cost
+        self.memo = {}
+        self.unknown = set()
+
+    def depth(self, name):
+        """Worst-case bytes used from the entry of name, and the deepest path.
+        The call graph must be acyclic."""
+        if name in self.memo:
+            return self.memo[name]
+        if name not in self.frames:
+            self.unknown.add(name)
+        own = self.frames.get(name, (0, False))[0]
+        best, best_path = 0, []
+        for callee in sorted(self.calls.get(name, ())):
+            bytes_below, callee_path = self.depth(callee)
+            bytes_below += self.call_cost
+            if bytes_below > best:
+                best, best_path = bytes_below, callee_path
+        self.memo[name] = (own + best, [name] + best_path)
+        return self.memo[name]
+
+
+def report(frames, calls, indirect, call_cost):
+    sys.setrecursionlimit(max(sys.getrecursionlimit(), 10000))
+    cut = cut_cycles(calls, [name for name in ("main", "setup", "loop") if name in calls] + sorted(calls))
+    analysis = Analysis(frames, calls, call_cost)
+    called = set()
+    for callees in calls.values():
+        called |= callees
+    # Functions of the firmware (with a frame) that nothing calls directly
+    roots = sorted(name for name in calls if name not in called and name in frames)
+    for name in ("main", "setup", "loop"):
+        if name in calls and name not in roots:
+            roots.insert(0, name)
+    interrupts = [name for name in roots if name.startswith("__vector_")]
+
+    lines = ["Worst-case stack depth per root (bytes, %d per call for the return address)" % call_cost]
+    results = sorted(((analysis.depth(root), root) for root in roots), key=lambda r: -r[0][0])
+    for (bytes_used, path), root in results:
+        lines.append("  %6d  %s" % (bytes_used, root))
+        lines.append("          " + " > ".join(path[1:]) if len(path) > 1 else "          (leaf)")
+
+    worst_interrupt = max((analysis.depth(name)[0] for name in interrupts), default=0)
+    worst_main = analysis.depth("main")[0] if "main" in calls else 0
+    lines.append("")
+    lines.append("main() + deepest interrupt: %d bytes" % (worst_main + worst_interrupt + call_cost))
+
+    dynamic = sorted(name for name, (_, is_dynamic) in frames.items() if is_dynamic)
+    if dynamic:
+        lines.append("Dynamic frames (alloca, VLAs), not bounded: " + ", ".join(dynamic))
+    if cut:
+        lines.append("Calls closing a cycle, not followed: " +
+                     ", ".join("%s > %s" % edge for edge in sorted(cut)))
+    if indirect:
+        lines.append("Indirect calls not followed in: " + ", ".join(sorted(indirect)))
+    if analysis.unknown:
+        lines.append("No frame size (library or assembly), counted as 0: " + ", ".join(sorted(analysis.unknown)))
+
+    lines.append("")
+    lines.append("Largest frames")
+    for name, (size, _) in sorted(frames.items(), key=lambda f: -f[1][0])[:15]:
+        lines.append("  %6d  %s" % (size, name))
+    return "\n".join(lines) + "\n"
+
+
+def add_indirect(calls, indirect, indirect_calls):
+    """Add the calls made through pointers, for the callers that were linked"""
+    for caller, callees in indirect_calls.items():
+        if caller in calls:
+            calls[caller] |= set(callee for callee in callees if callee in calls)
+            indirect.discard(caller)
+
+
+def run(elf, su_dir, objdump, call_cost, indirect_calls, report_path=None):
+    frames = read_frames(su_dir)
+    calls, indirect = read_calls(objdump, elf)
+    add_indirect(calls, indirect, indirect_calls)
+    text = report(frames, calls, indirect, call_cost)
+    sys.stdout.write(text)
+    if report_path:
+        with open(report_path, "w") as out:
+            out.write(text)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--elf", required=True)
+    parser.add_argument("--su-dir", required=True)
+    parser.add_argument("--objdump", default="avr-objdump")
+    parser.add_argument("--call-cost", type=int, default=3,
+                        help="Bytes pushed by a call (3 on the ATmega2560)")
+    parser.add_argument("--report")
+    parser.add_argument("--indirect", action="append", default=[],
+                        help="caller=callee,callee: calls made through pointers, "
+                             "in addition to the firmware's")
+    args = parser.parse_args()
+
+    indirect_calls = dict(INDIRECT_CALLS)
+    for entry in args.indirect:
+        caller, callees = entry.split("=", 1)
+        indirect_calls[caller] = indirect_calls.get(caller, []) + callees.split(",")
+    run(args.elf, args.su_dir, args.objdump, args.call_cost, indirect_calls, args.report)
+
+
+try:
+    # PlatformIO extra script: report once the firmware is linked
+    Import("env")  # noqa: F821
+except NameError:
+    env = None
+
+if env is None:
+    if __name__ == "__main__":
+        main()
+else:
+    def after_link(source, target, env):
+        build_dir = env.subst("$BUILD_DIR")
+        objdump = env.subst("$CC").replace("gcc", "objdump")
+        run(str(target[0]), build_dir, objdump, 3, INDIRECT_CALLS,
+            os.path.join(build_dir, "stack-usage.txt"))
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", after_link)  # noqa: F821
@@ -0,0 +1,345 @@
+/*
+  Arduino (host stand-in)
+
+  Virtual clock, pin state and Serial port for the simulator.
+*/
+#include <Arduino.h>
+#include "Sim.h"
+
+// Begin Registers
+volatile uint8_t simPortInput[SIM_NUM_PORTS];
+volatile uint8_t TIMSK0 = 0;
+volatile uint8_t OCR0B = 0;
+volatile uint8_t simPortOutput[SIM_NUM_PORTS];
+volatile uint8_t TCCR2A = 0;
+volatile uint8_t TCCR2B = 0;
+volatile uint8_t TCNT2 = 0;
+volatile uint8_t OCR2A = 0;
+volatile uint8_t TIMSK2 = 0;
+
+// Defined by the firmware when it samples inputs from Timer0
+extern "C" void TIMER0_COMPB_vect(void) __attribute__((weak));
+// Defined by the firmware when it plays sounds from Timer2
+extern "C" void TIMER2_COMPA_vect(void) __attribute__((weak));
+
+// Arduino Mega 2560 pin to port mapping
+#define P(port, bit) ((port) << 3 | (bit))
+static const uint8_t pinToPortBit[] = {
+  P(PE,0), P(PE,1), P(PE,4), P(PE,5), P(PG,5), P(PE,3), P(PH,3), P(PH,4),   //  0 -  7
+  P(PH,5), P(PH,6), P(PB,4), P(PB,5), P(PB,6), P(PB,7), P(PJ,1), P(PJ,0),   //  8 - 15
+  P(PH,1), P(PH,0), P(PD,3), P(PD,2), P(PD,1), P(PD,0), P(PA,0), P(PA,1),   // 16 - 23
+  P(PA,2), P(PA,3), P(PA,4), P(PA,5), P(PA,6), P(PA,7), P(PC,7), P(PC,6),   // 24 - 31
+  P(PC,5), P(PC,4), P(PC,3), P(PC,2), P(PC,1), P(PC,0), P(PD,7), P(PG,2),   // 32 - 39
+  P(PG,1), P(PG,0), P(PL,7), P(PL,6), P(PL,5), P(PL,4), P(PL,3), P(PL,2),   // 40 - 47
+  P(PL,1), P(PL,0), P(PB,3), P(PB,2), P(PB,1), P(PB,0), P(PF,0), P(PF,1),   // 48 - 55
+  P(PF,2), P(PF,3), P(PF,4), P(PF,5), P(PF,6), P(PF,7), P(PK,0), P(PK,1),   // 56 - 63
+  P(PK,2), P(PK,3), P(PK,4), P(PK,5), P(PK,6), P(PK,7)                      // 64 - 69
+};
+#undef P
+
+static void initPins(void);
+
+uint8_t digitalPinToPort(uint8_t pin){
+  initPins();
+  return pin < SIM_NUM_PINS ? pinToPortBit[pin] >> 3 : NOT_A_PORT;
+}
+
+uint8_t digitalPinToBitMask(uint8_t pin){
+  return pin < SIM_NUM_PINS ? 1 << (pinToPortBit[pin] & 7) : 0;
+}
+// End Registers
+
+
+// Begin Clock
+#define TIMER0_PERIOD_MICROS 1024
+
+static uint64_t nowMicros = 0;
+static uint64_t nextTimer0 = TIMER0_PERIOD_MICROS;
+
+// Timer2 is kept in CPU cycles (1/16 us), its compare period rarely being whole us
+#define CYCLES_PER_MICRO (F_CPU / 1000000UL)
+static const uint16_t timer2Prescale[] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+static bool timer2Running = false;
+static uint64_t nextTimer2Cycles = 0;
+static SimTimerStats timer2Stats;
+
+static uint64_t timer2PeriodCycles(){
+  return (uint64_t)timer2Prescale[TCCR2B & 7] * (OCR2A + 1);
+}
+
+const SimTimerStats *simGetTimer2Stats(){
+  return &timer2Stats;
+}
+
+uint64_t simNowMicros(){
+  return nowMicros;
+}
+
+/**
+* Move the virtual clock forward, applying any scenario events that fall
+* inside the interval at their exact timestamp, and running the timers,
+* the modem and its USART as their time comes.
+*/
+void simAdvanceMicros(uint64_t us){
+  uint64_t target = nowMicros + us;
+
+  while(true){
+    simApplyDueEvents();
+    simModemRun();
+    simUsartRun();
+    uint64_t next = simNextEventMicros();
+    if(nextTimer0 < next) next = nextTimer0;
+    uint64_t nextDevice = simUsartNextMicros();
+    if(nextDevice < next) next = nextDevice;
+    nextDevice = simModemNextMicros();
+    if(nextDevice < next) next = nextDevice;
+
+    // Timer2 starts counting when the firmware enables it
+    bool timer2Enabled = TIMER2_COMPA_vect && (TIMSK2 & _BV(OCIE2A)) && (TCCR2B & 7);
+    if(timer2Enabled && !timer2Running) nextTimer2Cycles = nowMicros * CYCLES_PER_MICRO + timer2PeriodCycles();
+    timer2Running = timer2Enabled;
+    uint64_t nextTimer2 = (nextTimer2Cycles + CYCLES_PER_MICRO - 1) / CYCLES_PER_MICRO;
+    if(timer2Running && nextTimer2 < next) next = nextTimer2;
+
+    if(next > target) break;
+    nowMicros = next;
+
+    if(nowMicros == nextTimer0){
+      nextTimer0 += TIMER0_PERIOD_MICROS;
+      if(TIMER0_COMPB_vect && (TIMSK0 & _BV(OCIE0B))) TIMER0_COMPB_vect();
+    }
+    if(timer2Running && nowMicros == nextTimer2){
+      uint64_t period = timer2PeriodCycles();
+      uint8_t outputs[SIM_NUM_PORTS];
+      memcpy(outputs, (const void *)simPortOutput, sizeof(outputs));
+      TIMER2_COMPA_vect();
+      timer2Stats.interrupts++;
+      // An interrupt that toggled a pin ended a half period of tone
+      if(memcmp(outputs, (const void *)simPortOutput, sizeof(outputs)) != 0){
+        timer2Stats.toggles++;
+        timer2Stats.toggleCycles += period;
+      }
+      nextTimer2Cycles += timer2PeriodCycles();
+    }
+  }
+  nowMicros = target;
+  simApplyDueEvents();
+  simModemRun();
+  simUsartRun();
+  simCheckWatchdog();
+}
+
+unsigned long millis(){
+  return (unsigned long)(nowMicros / 1000);
+}
+
+unsigned long micros(){
+  return (unsigned long)nowMicros;
+}
+
+void delay(unsigned long ms){
+  simAdvanceMicros((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us){
+  simAdvanceMicros(us);
+}
+// End Clock
+
+
+// Begin Pins
+// Unconnected inputs read HIGH, as they would with the pull-up enabled
+uint8_t simPinLevel[SIM_NUM_PINS];
+static bool pinsInitialized = false;
+
+static void initPins(){
+  if(pinsInitialized) return;
+  memset(simPinLevel, HIGH, sizeof(simPinLevel));
+  for(uint8_t port = 0; port < SIM_NUM_PORTS; port++) simPortInput[port] = 0xFF;
+  pinsInitialized = true;
+}
+
+void simSetPin(uint8_t pin, uint8_t level){
+  initPins();
+  if(pin >= SIM_NUM_PINS) return;
+
+  simPinLevel[pin] = level ? HIGH : LOW;
+  if(level) simPortInput[digitalPinToPort(pin)] |= digitalPinToBitMask(pin);
+  else simPortInput[digitalPinToPort(pin)] &= ~digitalPinToBitMask(pin);
+}
+
+void pinMode(uint8_t pin, uint8_t mode){
+  (void)pin;
+  (void)mode;
+  initPins();
+}
+
+int digitalRead(uint8_t pin){
+  initPins();
+  return pin < SIM_NUM_PINS ? simPinLevel[pin] : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val){
+  // Outputs (speaker, reset line) are not observed by the input model
+  (void)pin;
+  (void)val;
+}
+// End Pins
+
+
+size_t strlcpy(char *dst, const char *src, size_t size){
+  size_t len = strlen(src);
+  if(size > 0){
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+
+// From avr-libc
+char *utoa(unsigned int value, char *text, int radix){
+  char digits[sizeof(unsigned int) * 8 + 1];
+  byte length = 0;
+  do{
+    unsigned int digit = value % radix;
+    digits[length++] = digit < 10 ? '0' + digit : 'a' + digit - 10;
+    value /= radix;
+  } while(value != 0);
+
+  for(byte i = 0; i < length; i++) text[i] = digits[length - 1 - i];
+  text[length] = '\0';
+  return text;
+}
+
+
+// Begin Print
+size_t Print::write(const char *str){
+  return str ? write((const uint8_t *)str, strlen(str)) : 0;
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size){
+  size_t n = 0;
+  while(size--) n += write(*buffer++);
+  return n;
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base){
+  char buf[8 * sizeof(long) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if(base < 2) base = 10;
+  do{
+    char c = n % base;
+    n /= base;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  }while(n);
+  return write(str);
+}
+
+size_t Print::print(const __FlashStringHelper *s){ return write(reinterpret_cast<const char *>(s)); }
+size_t Print::print(const char s[]){ return write(s); }
+size_t Print::print(char c){ return write((uint8_t)c); }
+size_t Print::print(unsigned char b, int base){ return printNumber(b, base); }
+size_t Print::print(unsigned int n, int base){ return printNumber(n, base); }
+size_t Print::print(unsigned long n, int base){ return printNumber(n, base); }
+size_t Print::print(int n, int base){ return print((long)n, base); }
+
+size_t Print::print(long n, int base){
+  if(base == 10 && n < 0){
+    return write('-') + printNumber(-(unsigned long)n, 10);
+  }
+  return printNumber((unsigned long)n, base);
+}
+
+size_t Print::print(double n, int digits){
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return write(buf);
+}
+
+size_t Print::println(void){ return write("\r\n"); }
+size_t Print::println(const __FlashStringHelper *s){ return print(s) + println(); }
+size_t Print::println(const char s[]){ return print(s) + println(); }
+size_t Print::println(char c){ return print(c) + println(); }
+size_t Print::println(unsigned char b, int base){ return print(b, base) + println(); }
+size_t Print::println(int n, int base){ return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base){ return print(n, base) + println(); }
+size_t Print::println(long n, int base){ return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base){ return print(n, base) + println(); }
+size_t Print::println(double n, int digits){ return print(n, digits) + println(); }
+// End Print
+
+
+// Begin Serial
+#define SERIAL_TX_BUFFER_SIZE 64
+
+HardwareSerial Serial;
+void (*simSerialTap)(uint8_t) = NULL;
+unsigned long simSerialBaud = 9600;
+
+// Time at which the last queued byte has left the UART
+static uint64_t txIdleAt = 0;
+
+// Bytes waiting in the TX buffer
+static uint64_t txQueued(){
+  uint64_t byteMicros = 10000000ULL / simSerialBaud;
+  uint64_t now = simNowMicros();
+  if(txIdleAt < now) txIdleAt = now;
+  return (txIdleAt - now + byteMicros - 1) / byteMicros;
+}
+
+void HardwareSerial::begin(unsigned long baud){
+  simSerialBaud = baud;
+}
+
+size_t HardwareSerial::write(uint8_t c){
+  // 10 bits per byte (start, 8 data, stop)
+  uint64_t byteMicros = 10000000ULL / simSerialBaud;
+  uint64_t queued = txQueued();
+
+  // Block until the interrupt driven TX buffer has room for another byte
+  if(queued >= SERIAL_TX_BUFFER_SIZE){
+    simAdvanceMicros((queued - SERIAL_TX_BUFFER_SIZE + 1) * byteMicros);
+  }
+  txIdleAt += byteMicros;
+
+  if(simSerialTap) simSerialTap(c);
+  return 1;
+}
+
+// As on the AVR core, one slot of the ring buffer is always left empty
+int HardwareSerial::availableForWrite(){
+  uint64_t queued = txQueued();
+  return queued >= SERIAL_TX_BUFFER_SIZE - 1 ? 0 : SERIAL_TX_BUFFER_SIZE - 1 - queued;
+}
+
+// RX buffer, filled by the scenario
+#define SERIAL_RX_BUFFER_SIZE 64
+static uint8_t rxBuffer[SERIAL_RX_BUFFER_SIZE];
+static unsigned int rxHead = 0, rxTail = 0;
+
+void simSerialReceive(const char *text){
+  for(; *text; text++){
+    unsigned int next = (rxHead + 1) % SERIAL_RX_BUFFER_SIZE;
+    if(next == rxTail) return;   // Overrun, as on the AVR
+    rxBuffer[rxHead] = *text;
+    rxHead = next;
+  }
+}
+
+int HardwareSerial::available(){
+  return (rxHead + SERIAL_RX_BUFFER_SIZE - rxTail) % SERIAL_RX_BUFFER_SIZE;
+}
+
+int HardwareSerial::read(){
+  if(rxHead == rxTail) return -1;
+  uint8_t c = rxBuffer[rxTail];
+  rxTail = (rxTail + 1) % SERIAL_RX_BUFFER_SIZE;
+  return c;
+}
+
+int HardwareSerial::peek(){
+  return rxHead == rxTail ? -1 : rxBuffer[rxTail];
+}
+// End Serial
@@ -0,0 +1,217 @@
+/*
+  Arduino (host stand-in)
+
+  Minimal subset of the Arduino core used by the MegaMaster sources, so they
+  can be compiled and run on a Linux host by the [env:native] build.
+  Time is virtual: millis()/micros() read the simulator clock and delay()
+  advances it, so no real time is spent waiting.
+*/
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// Flash memory is ordinary memory on the host
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte_near(addr)  (*(const uint8_t *)(addr))
+#define pgm_read_word_near(addr)  (*(const uint16_t *)(addr))
+#define pgm_read_dword_near(addr) (*(const uint32_t *)(addr))
+#define pgm_read_byte(addr)  pgm_read_byte_near(addr)
+#define pgm_read_word(addr)  pgm_read_word_near(addr)
+#define pgm_read_dword(addr) pgm_read_dword_near(addr)
+#define pgm_read_ptr(addr) (*(const void * const *)(addr))
+#define strncat_P strncat
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define memcpy_P memcpy
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strstr_P strstr
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+#define cli()
+#define sei()
+#define _BV(bit) (1 << (bit))
+
+// Begin Registers
+// Only the registers used by the master are modelled. Port input registers
+// follow the pin levels set by the scenario.
+#define NOT_A_PORT 0
+#define PA 1
+#define PB 2
+#define PC 3
+#define PD 4
+#define PE 5
+#define PF 6
+#define PG 7
+#define PH 8
+#define PJ 10
+#define PK 11
+#define PL 12
+#define SIM_NUM_PORTS 13
+
+extern volatile uint8_t simPortInput[SIM_NUM_PORTS];
+#define PINA simPortInput[PA]
+#define PINB simPortInput[PB]
+#define PINC simPortInput[PC]
+#define PIND simPortInput[PD]
+#define PINF simPortInput[PF]
+#define PINK simPortInput[PK]
+#define PINL simPortInput[PL]
+
+uint8_t digitalPinToPort(uint8_t pin);
+uint8_t digitalPinToBitMask(uint8_t pin);
+#define portInputRegister(port) (&simPortInput[port])
+
+// Port output registers only record what the firmware writes
+extern volatile uint8_t simPortOutput[SIM_NUM_PORTS];
+#define portOutputRegister(port) (&simPortOutput[port])
+
+// Timer0 compare B: called once per Timer0 overflow period (1.024 ms) when
+// OCIE0B is set in TIMSK0
+extern volatile uint8_t TIMSK0;
+extern volatile uint8_t OCR0B;
+#define OCIE0B 2
+
+// Timer2 in CTC mode: TIMER2_COMPA_vect is called every (OCR2A + 1) timer
+// clocks while OCIE2A is set in TIMSK2 and a clock is selected in TCCR2B
+#define F_CPU 16000000UL
+extern volatile uint8_t TCCR2A;
+extern volatile uint8_t TCCR2B;
+extern volatile uint8_t TCNT2;
+extern volatile uint8_t OCR2A;
+extern volatile uint8_t TIMSK2;
+#define WGM21 1
+#define OCIE2A 1
+
+// USART1, the modem's port (see sim/Usart.cpp). Reading UDR1 takes the
+// received byte and writing it transmits, as on the AVR. Bits have the
+// USART0 names, as in the Arduino core.
+class SimDataRegister
+{
+  public:
+    operator uint8_t();
+    SimDataRegister &operator=(uint8_t c);
+};
+// Only U2X is writable in UCSR1A, the flags are set by the USART
+class SimStatusRegister
+{
+  public:
+    operator uint8_t();
+    SimStatusRegister &operator=(uint8_t value);
+};
+extern SimDataRegister UDR1;
+extern SimStatusRegister UCSR1A;
+extern volatile uint8_t UCSR1B;
+extern volatile uint8_t UCSR1C;
+extern volatile uint16_t UBRR1;
+#define RXC0 7
+#define TXC0 6
+#define UDRE0 5
+#define FE0 4
+#define DOR0 3
+#define U2X0 1
+#define RXCIE0 7
+#define UDRIE0 5
+#define RXEN0 4
+#define TXEN0 3
+#define UCSZ01 2
+#define UCSZ00 1
+
+#define ISR(vector) extern "C" void vector(void); void vector(void)
+// End Registers
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t val);
+
+size_t strlcpy(char *dst, const char *src, size_t size);
+char *utoa(unsigned int value, char *text, int radix);
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t) = 0;
+    size_t write(const char *str);
+    virtual size_t write(const uint8_t *buffer, size_t size);
+
+    size_t print(const __FlashStringHelper *);
+    size_t print(const char[]);
+    size_t print(char);
+    size_t print(unsigned char, int = DEC);
+    size_t print(int, int = DEC);
+    size_t print(unsigned int, int = DEC);
+    size_t print(long, int = DEC);
+    size_t print(unsigned long, int = DEC);
+    size_t print(double, int = 2);
+
+    size_t println(const __FlashStringHelper *);
+    size_t println(const char[]);
+    size_t println(char);
+    size_t println(unsigned char, int = DEC);
+    size_t println(int, int = DEC);
+    size_t println(unsigned int, int = DEC);
+    size_t println(long, int = DEC);
+    size_t println(unsigned long, int = DEC);
+    size_t println(double, int = 2);
+    size_t println(void);
+
+  private:
+    size_t printNumber(unsigned long, uint8_t);
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() {}
+};
+
+// Serial port 0, modelled at its configured baud rate with the 64 byte TX
+// buffer of the AVR core: print() only blocks once that buffer is full.
+class HardwareSerial : public Stream
+{
+  public:
+    void begin(unsigned long baud);
+    virtual size_t write(uint8_t);
+    virtual int available();
+    virtual int read();
+    virtual int peek();
+    int availableForWrite();
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,1521 @@
+/*
+  Benchmarks
+
+  Host micro-benchmarks of firmware building blocks, run with
+  alarm-sim --bench <name>. Times are host nanoseconds and are only
+  meaningful relative to each other.
+*/
+#include <Arduino.h>
+#include <chrono>
+#include <math.h>
+#include "Sim.h"
+#include "MegaMaster.h"
+#include "Debouncer.h"
+#include "CRC32.h"
+#include "ContactParser.h"
+#include "ContactRecord.h"
+#include "SlaveCommunicationsFunctions.h"
+#include "Outbox.h"
+#include "Inbox.h"
+#include "MessageTemplates.h"
+#include "Log.h"
+#include "Sounds.h"
+#include "Pitches.h"
+#include "SerialGSM.h"
+#include "ModemUart.h"
+#include <string>
+#include <vector>
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double nanosSince(BenchClock::time_point start, unsigned long iterations){
+  return std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / iterations;
+}
+
+// Small deterministic generator so runs are comparable
+static uint32_t benchRandom(){
+  static uint32_t state = 2463534242UL;
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+// Begin Debounce
+#define DEBOUNCE_POLLS 200000UL
+
+// The per-input checkInputs() loop this tree used before the bit-sliced debouncer
+struct LegacyDebouncer
+{
+  byte count;
+  byte pins[64];
+  byte previousState[64], currentState[64];
+  byte pressed[64], justPressed[64], justReleased[64];
+
+  void check(){
+    for (byte index = 0; index < count; index++) {
+      justPressed[index] = 0;
+      justReleased[index] = 0;
+      currentState[index] = digitalRead(pins[index]);
+      if (currentState[index] == previousState[index]) {
+        if ((pressed[index] == LOW) && (currentState[index] == LOW)) justPressed[index] = 1;
+        else if ((pressed[index] == HIGH) && (currentState[index] == HIGH)) justReleased[index] = 1;
+        pressed[index] = !currentState[index];
+      }
+      previousState[index] = currentState[index];
+    }
+  }
+};
+
+// Ports of the 64 lanes used for the benchmark, 8 pins each
+static const uint8_t benchPorts[] = { PA, PC, PL, PB, PF, PK, PD, PG };
+
+static uint64_t readBenchPorts(byte ports){
+  uint64_t levels = 0;
+  for(byte i = 0; i < ports; i++){
+    levels |= (uint64_t)simPortInput[benchPorts[i]] << (8 * i);
+  }
+  return levels;
+}
+
+template <typename Mask>
+static double benchSliced(byte inputs, const byte *pins){
+  Debouncer<Mask> debouncer;
+  byte ports = (inputs + 7) / 8;
+  Mask lanes = inputs >= 8 * sizeof(Mask) ? (Mask)~(Mask)0 : (Mask)(((Mask)1 << inputs) - 1);
+  unsigned long now = 0;
+  volatile Mask sink = 0;
+
+  debouncer.begin((Mask)readBenchPorts(ports) | (Mask)~lanes, now, DEBOUNCE);
+
+  BenchClock::time_point start = BenchClock::now();
+  for(unsigned long poll = 0; poll < DEBOUNCE_POLLS; poll++){
+    if((benchRandom() & 15) == 0) simSetPin(pins[benchRandom() % inputs], benchRandom() & 1);
+
+    now += DEBOUNCE;
+    Mask levels = (Mask)readBenchPorts(ports) | (Mask)~lanes;
+    if(levels != debouncer.raw) debouncer.edge(now, levels);
+    debouncer.advance(now);
+
+    sink = sink | debouncer.justPressed | debouncer.justReleased;
+    debouncer.justPressed = 0;
+    debouncer.justReleased = 0;
+  }
+  return nanosSince(start, DEBOUNCE_POLLS);
+}
+
+static double benchLegacy(byte inputs, const byte *pins){
+  LegacyDebouncer legacy;
+  memset(&legacy, 0, sizeof(legacy));
+  legacy.count = inputs;
+  memcpy(legacy.pins, pins, inputs);
+
+  BenchClock::time_point start = BenchClock::now();
+  for(unsigned long poll = 0; poll < DEBOUNCE_POLLS; poll++){
+    if((benchRandom() & 15) == 0) simSetPin(pins[benchRandom() % inputs], benchRandom() & 1);
+    legacy.check();
+  }
+  return nanosSince(start, DEBOUNCE_POLLS);
+}
+
+/**
+* Check that windows stay on the grid of begin() after an idle stretch:
+* a press 110 ms in, with 50 ms windows, is reported at 200 ms
+*/
+static bool checkDebounceGrid(){
+  Debouncer<uint8_t> debouncer;
+  debouncer.begin(0xFF, 0, 50);
+  debouncer.advance(60);
+  debouncer.edge(110, 0xFE);
+  bool ok = debouncer.advance(199) == 0 && debouncer.advance(200) == 0x01;
+  printf("  windows after an idle stretch: %s\n", ok ? "on the grid" : "FAILED");
+  return ok;
+}
+
+static bool benchDebounce(){
+  // Pins in lane order: port A, C, L, B, F, K, D, G. Port bits without a
+  // header pin on the Mega use pin 0.
+  static const byte lanePins[64] = {
+    22, 23, 24, 25, 26, 27, 28, 29,  37, 36, 35, 34, 33, 32, 31, 30,
+    49, 48, 47, 46, 45, 44, 43, 42,  53, 52, 51, 50, 10, 11, 12, 13,
+    54, 55, 56, 57, 58, 59, 60, 61,  62, 63, 64, 65, 66, 67, 68, 69,
+    21, 20, 19, 18,  0,  0,  0, 38,  41, 40, 39,  0,  0,  4,  0,  0
+  };
+  static const byte sizes[] = { 3, 16, 64 };
+
+  printf("Debouncer, ns per poll (%lu polls)\n", DEBOUNCE_POLLS);
+  printf("  inputs   checkInputs() loop   bit-sliced\n");
+  for(byte i = 0; i < sizeof(sizes); i++){
+    byte inputs = sizes[i];
+    double legacy = benchLegacy(inputs, lanePins);
+    double sliced = inputs <= 8 ? benchSliced<uint8_t>(inputs, lanePins)
+                  : inputs <= 16 ? benchSliced<uint16_t>(inputs, lanePins)
+                  : benchSliced<uint64_t>(inputs, lanePins);
+    printf("  %6u   %18.1f   %10.1f\n", inputs, legacy, sliced);
+  }
+  return checkDebounceGrid();
+}
+// End Debounce
+
+// Begin CRC
+#define CRC_BENCH_BYTES 768      // A full contacts file
+#define CRC_BENCH_ROUNDS 20000UL
+
+static uint32_t crcNibble(const uint8_t *data, unsigned int length){
+  uint32_t crc = 0xFFFFFFFF;
+  for(unsigned int i = 0; i < length; i++) crc = crc_update(crc, data[i]);
+  return ~crc;
+}
+
+// One byte per call only takes the byte-wise table path, as on the AVR
+static uint32_t crcByteTable(const uint8_t *data, unsigned int length){
+  uint32_t crc = 0xFFFFFFFF;
+  for(unsigned int i = 0; i < length; i++) crc = crc_update_block(crc, data + i, 1);
+  return ~crc;
+}
+
+static uint32_t crcBlock(const uint8_t *data, unsigned int length){
+  return ~crc_update_block(0xFFFFFFFF, data, length);
+}
+
+/**
+* Check that every variant gives the same result as the nibble table,
+* for random lengths, alignments and split points
+*/
+static bool checkCrc(){
+  static uint8_t buffer[1024];
+  const uint8_t check[] = "123456789";
+
+  if(crcBlock(check, 9) != 0xCBF43926 || crcNibble(check, 9) != 0xCBF43926){
+    printf("  check value 123456789: FAILED\n");
+    return false;
+  }
+
+  for(int run = 0; run < 10000; run++){
+    unsigned int offset = benchRandom() % 8;
+    unsigned int length = benchRandom() % (sizeof(buffer) - 8);
+    unsigned int split = length > 0 ? benchRandom() % length : 0;
+    for(unsigned int i = 0; i < length; i++) buffer[offset + i] = benchRandom();
+
+    const uint8_t *data = buffer + offset;
+    uint32_t expected = crcNibble(data, length);
+    uint32_t halves = ~crc_update_block(crc_update_block(0xFFFFFFFF, data, split), data + split, length - split);
+
+    if(crcByteTable(data, length) != expected || crcBlock(data, length) != expected || halves != expected){
+      printf("  run %d (offset %u, length %u, split %u): FAILED\n", run, offset, length, split);
+      return false;
+    }
+  }
+  printf("  10000 random buffers: bit-exact with crc_update()\n");
+  return true;
+}
+
+static void benchCrcVariant(const char *name, uint32_t (*variant)(const uint8_t *, unsigned int), const uint8_t *data){
+  volatile uint32_t sink = 0;
+#ifdef __x86_64__
+  uint64_t cycles = __rdtsc();
+#endif
+  BenchClock::time_point start = BenchClock::now();
+  for(unsigned long round = 0; round < CRC_BENCH_ROUNDS; round++){
+    sink = sink ^ variant(data, CRC_BENCH_BYTES);
+  }
+  double nanos = nanosSince(start, CRC_BENCH_ROUNDS * CRC_BENCH_BYTES);
+#ifdef __x86_64__
+  double perByte = (double)(__rdtsc() - cycles) / (CRC_BENCH_ROUNDS * CRC_BENCH_BYTES);
+  printf("  %-30s %8.2f ns/byte %8.2f TSC cycles/byte\n", name, nanos, perByte);
+#else
+  printf("  %-30s %8.2f ns/byte\n", name, nanos);
+#endif
+}
+
+static bool benchCrc(){
+  static uint8_t data[CRC_BENCH_BYTES];
+  for(unsigned int i = 0; i < sizeof(data); i++) data[i] = benchRandom();
+
+  printf("CRC32 self-check\n");
+  if(!checkCrc()) return false;
+
+  printf("CRC32 over %u bytes, host\n", CRC_BENCH_BYTES);
+  benchCrcVariant("crc_update() nibble table", crcNibble, data);
+  benchCrcVariant("byte table, one byte per call", crcByteTable, data);
+  benchCrcVariant("crc_update_block() slicing-4", crcBlock, data);
+  return true;
+}
+// End CRC
+
+// Begin Contact Parser
+#define PARSER_FUZZ_RUNS 200000UL
+#define PARSER_BENCH_ROUNDS 20000UL
+
+// A contact between guard bytes, to catch writes outside its fields
+struct GuardedContact
+{
+  uint8_t before[16];
+  ContactText contact;
+  uint8_t after[16];
+};
+
+static GuardedContact parsed[CONTACTS_MAX_NUMBER];
+
+static void randomField(std::string *out, const char *alphabet, unsigned int maxLength){
+  unsigned int length = 1 + benchRandom() % maxLength;
+  unsigned int size = strlen(alphabet);
+  for(unsigned int i = 0; i < length; i++) *out += alphabet[benchRandom() % size];
+}
+
+/**
+* A valid contacts file of count random contacts
+*/
+static std::string randomContactsFile(byte count){
+  static const char *text = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 .-_@";
+  std::string file;
+  for(byte i = 0; i < count; i++){
+    randomField(&file, "0123456789", 3);
+    file += ',';
+    randomField(&file, text, sizeof(ContactText().name) - 1);
+    file += ',';
+    randomField(&file, text, sizeof(ContactText().email) - 1);
+    file += ',';
+    randomField(&file, "0123456789", sizeof(ContactText().phone) - 1);
+    file += '\n';
+  }
+  return file;
+}
+
+static void corruptContactsFile(std::string *file){
+  byte mutations = 1 + benchRandom() % 4;
+  for(byte i = 0; i < mutations && !file->empty(); i++){
+    size_t at = benchRandom() % file->size();
+    switch(benchRandom() % 6){
+      case 0: (*file)[at] ^= 1 << (benchRandom() % 8); break;
+      case 1: file->erase(at, 1); break;
+      case 2: file->insert(at, 1, (char)benchRandom()); break;
+      case 3: file->insert(at, 1, ",\n\r"[benchRandom() % 3]); break;
+      case 4: file->resize(at); break;
+      case 5: file->insert(at, std::string(1 + benchRandom() % 80, (char)('a' + benchRandom() % 26))); break;
+    }
+  }
+}
+
+static bool fieldValid(const char *field, size_t size, bool digits){
+  size_t length = strnlen(field, size);
+  if(length == 0 || length == size) return false;
+  for(size_t i = 0; i < length; i++){
+    if((uint8_t)field[i] < ' ' || field[i] == ',') return false;
+    if(digits && (field[i] < '0' || field[i] > '9')) return false;
+  }
+  return true;
+}
+
+/**
+* Stream a file through the parser into the guarded contacts
+*
+* Returns:
+*   -false if an invariant was broken
+*/
+static bool parseContactsFile(const std::string &file, byte *accepted, byte *rejected){
+  ContactParser parser;
+  byte count = 0;
+  *accepted = 0;
+  *rejected = 0;
+
+  memset(parsed, 0xA5, sizeof(parsed));
+  parser.begin(&parsed[0].contact);
+
+  for(size_t i = 0; i <= file.size() && count < CONTACTS_MAX_NUMBER; i++){
+    byte result = i < file.size() ? parser.feed(file[i]) : parser.finish();
+    if(result == CONTACT_PARSE_ERROR) (*rejected)++;
+    if(result != CONTACT_PARSE_DONE) continue;
+
+    ContactText *contact = &parsed[count].contact;
+    if(!fieldValid(contact->groups, sizeof(contact->groups), true)
+       || !fieldValid(contact->name, sizeof(contact->name), false)
+       || !fieldValid(contact->email, sizeof(contact->email), false)
+       || !fieldValid(contact->phone, sizeof(contact->phone), true)){
+      printf("  invalid contact accepted\n");
+      return false;
+    }
+    count++;
+    if(count < CONTACTS_MAX_NUMBER) parser.begin(&parsed[count].contact);
+  }
+
+  for(byte i = 0; i < CONTACTS_MAX_NUMBER; i++){
+    for(byte j = 0; j < sizeof(parsed[i].before); j++){
+      if(parsed[i].before[j] != 0xA5 || parsed[i].after[j] != 0xA5){
+        printf("  write outside contact %u\n", i);
+        return false;
+      }
+    }
+  }
+  *accepted = count;
+  return true;
+}
+
+/**
+* Valid files must parse back to the same contacts and line hashes
+*/
+static bool checkParserRoundTrip(const std::string &file, byte count){
+  byte accepted, rejected;
+  if(!parseContactsFile(file, &accepted, &rejected)) return false;
+  if(accepted != count || rejected != 0){
+    printf("  valid file: %u of %u contacts accepted\n", accepted, count);
+    return false;
+  }
+
+  size_t start = 0;
+  for(byte i = 0; i < count; i++){
+    size_t end = file.find('\n', start) + 1;
+    std::string line = file.substr(start, end - start);
+    ContactText *contact = &parsed[i].contact;
+    std::string expected = std::string(contact->groups) + "," + contact->name + ","
+                         + contact->email + "," + contact->phone + "\n";
+    uint32_t hash = ~crc_update_block(0xFFFFFFFF, (const uint8_t *)line.data(), line.size());
+    if(line != expected || contact->hash != hash){
+      printf("  valid line %u parsed differently: %s", i, line.c_str());
+      return false;
+    }
+    start = end;
+  }
+  return true;
+}
+
+// The strtok/strncpy line parser this tree used before the streaming parser,
+// with the line hash it computed. It crashes on a missing field, so it is only benchmarked.
+static void legacyParseLine(char *lineBuffer, ContactText *contact){
+  char *temp = strtok(lineBuffer, ",");
+  strncpy(contact->groups, temp, sizeof(contact->groups) - 1);
+  contact->groups[sizeof(contact->groups) - 1] = '\0';
+  temp = strtok(NULL, ",");
+  strncpy(contact->name, temp, sizeof(contact->name) - 1);
+  contact->name[sizeof(contact->name) - 1] = '\0';
+  temp = strtok(NULL, ",");
+  strncpy(contact->email, temp, sizeof(contact->email) - 1);
+  contact->email[sizeof(contact->email) - 1] = '\0';
+  temp = strtok(NULL, "\n");
+  strncpy(contact->phone, temp, sizeof(contact->phone) - 1);
+  contact->phone[sizeof(contact->phone) - 1] = '\0';
+}
+
+static void legacyParseFile(const std::string &file, ContactText *contacts){
+  char lineBuffer[65];
+  byte lIndex = 0;
+  byte count = 0;
+  for(size_t i = 0; i < file.size(); i++){
+    char c = file[i];
+    lineBuffer[lIndex++] = c;
+    if(c == '\n' || lIndex >= 64){
+      contacts[count].hash = ~crc_update_block(0xFFFFFFFF, (const uint8_t *)lineBuffer, lIndex);
+      lineBuffer[lIndex] = '\0';
+      legacyParseLine(lineBuffer, &contacts[count++]);
+      lIndex = 0;
+    }
+  }
+}
+
+static void streamParseFile(const std::string &file, ContactText *contacts){
+  ContactParser parser;
+  byte count = 0;
+  parser.begin(&contacts[0]);
+  for(size_t i = 0; i < file.size(); i++){
+    if(parser.feed(file[i]) == CONTACT_PARSE_DONE && ++count < CONTACTS_MAX_NUMBER){
+      parser.begin(&contacts[count]);
+    }
+  }
+}
+
+static bool benchParser(){
+  unsigned long valid = 0, corrupted = 0, accepted = 0, rejected = 0;
+
+  printf("Contact parser fuzzing (%lu files)\n", PARSER_FUZZ_RUNS);
+  for(unsigned long run = 0; run < PARSER_FUZZ_RUNS; run++){
+    byte count = benchRandom() % (CONTACTS_MAX_NUMBER + 1);
+    std::string file = randomContactsFile(count);
+    byte fileAccepted, fileRejected;
+
+    switch(run % 3){
+      case 0:
+        if(!checkParserRoundTrip(file, count)) return false;
+        valid++;
+        break;
+      case 1:
+        corruptContactsFile(&file);
+        if(!parseContactsFile(file, &fileAccepted, &fileRejected)) return false;
+        corrupted++;
+        accepted += fileAccepted;
+        rejected += fileRejected;
+        break;
+      case 2:{
+        // Pure noise, biased towards the separators
+        std::string noise;
+        unsigned int length = benchRandom() % 1024;
+        for(unsigned int i = 0; i < length; i++){
+          noise += (benchRandom() & 3) ? (char)benchRandom() : ",\n1"[benchRandom() % 3];
+        }
+        if(!parseContactsFile(noise, &fileAccepted, &fileRejected)) return false;
+        corrupted++;
+        accepted += fileAccepted;
+        rejected += fileRejected;
+        break;
+      }
+    }
+  }
+  printf("  %lu valid files parsed exactly\n", valid);
+  printf("  %lu corrupted files: %lu lines accepted, %lu rejected, no invariant broken\n",
+         corrupted, accepted, rejected);
+
+  std::string file = randomContactsFile(CONTACTS_MAX_NUMBER);
+  static ContactText contacts[CONTACTS_MAX_NUMBER];
+  printf("Contact parser, ns per byte (%u byte file)\n", (unsigned int)file.size());
+
+  BenchClock::time_point start = BenchClock::now();
+  for(unsigned long round = 0; round < PARSER_BENCH_ROUNDS; round++) legacyParseFile(file, contacts);
+  printf("  strtok/strncpy line parser   %6.2f\n", nanosSince(start, PARSER_BENCH_ROUNDS * file.size()));
+
+  start = BenchClock::now();
+  for(unsigned long round = 0; round < PARSER_BENCH_ROUNDS; round++) streamParseFile(file, contacts);
+  printf("  streaming parser (with hash) %6.2f\n", nanosSince(start, PARSER_BENCH_ROUNDS * file.size()));
+  return true;
+}
+// End Contact Parser
+
+// Begin Phone Lookup
+#define LOOKUP_QUERIES 200000UL
+
+// isInContactList() before the phone index: a substring match over every contact
+static int legacyFindPhone(const std::vector<std::string> &phones, const char *number){
+  for(size_t j = 0; j < phones.size(); j++){
+    if(strstr(number, phones[j].c_str())) return j;
+  }
+  return -1;
+}
+
+/**
+* Match senders against count contacts with the old linear scan and the
+* phone index, checking that the index finds exactly the right contact
+*
+* Returns:
+*   -false if a lookup gave the wrong contact
+*/
+static bool benchLookupSize(unsigned int count){
+  std::vector<std::string> phones(count);
+  std::vector<Contact> packed(count);
+  std::vector<Contact *> table(count);
+  std::vector<unsigned int> index(count);
+  char number[24];
+
+  // Distinct numbers, every third one stored without the country code
+  for(unsigned int i = 0; i < count; i++){
+    snprintf(number, sizeof(number), "%s416%07u", i % 3 == 0 ? "" : "1", (i * 19997 + benchRandom() % 19997) % 10000000);
+    phones[i] = number;
+    if(!contactPhoneKey(number, &packed[i])) return false;
+    table[i] = &packed[i];
+    index[i] = i;
+  }
+  contactIndexSort(table.data(), index.data(), count);
+
+  // Senders: hits in international format, numbers of another area and
+  // numbers that contain a contact's number but are longer
+  std::vector<std::string> senders(LOOKUP_QUERIES);
+  std::vector<int> expected(LOOKUP_QUERIES);
+  unsigned long looseMatches = 0;
+  for(unsigned long q = 0; q < LOOKUP_QUERIES; q++){
+    unsigned int i = benchRandom() % count;
+    const std::string &national = phones[i].size() == PHONE_NATIONAL_DIGITS ? phones[i] : phones[i].substr(1);
+    switch(q % 4){
+      case 0:
+      case 1: senders[q] = "+1" + national; expected[q] = i; break;
+      case 2: snprintf(number, sizeof(number), "+1999%07u", benchRandom() % 10000000); senders[q] = number; expected[q] = -1; break;
+      case 3: senders[q] = "+1" + national + "7"; expected[q] = -1; break;
+    }
+  }
+
+  for(unsigned long q = 0; q < LOOKUP_QUERIES; q++){
+    Contact key;
+    int found = contactPhoneKey(senders[q].c_str(), &key)
+                ? contactIndexSearch(table.data(), index.data(), count, &key) : -1;
+    if(found != expected[q]){
+      printf("  %s matched contact %d instead of %d\n", senders[q].c_str(), found, expected[q]);
+      return false;
+    }
+    if(legacyFindPhone(phones, senders[q].c_str()) != expected[q]) looseMatches++;
+  }
+
+  volatile int sink = 0;
+  BenchClock::time_point start = BenchClock::now();
+  for(unsigned long q = 0; q < LOOKUP_QUERIES; q++) sink += legacyFindPhone(phones, senders[q].c_str());
+  double linear = nanosSince(start, LOOKUP_QUERIES);
+
+  start = BenchClock::now();
+  for(unsigned long q = 0; q < LOOKUP_QUERIES; q++){
+    Contact key;
+    contactPhoneKey(senders[q].c_str(), &key);
+    sink += contactIndexSearch(table.data(), index.data(), count, &key);
+  }
+  double indexed = nanosSince(start, LOOKUP_QUERIES);
+
+  printf("  %4u contacts   %8.1f   %8.1f   %lu wrong matches by the substring scan\n",
+         count, linear, indexed, looseMatches);
+  return true;
+}
+
+static bool benchLookup(){
+  static const unsigned int sizes[] = { CONTACTS_MAX_NUMBER, 100, 500 };
+  printf("Sender lookup, ns per SMS (%lu senders)\n", LOOKUP_QUERIES);
+  printf("                 substring    index\n");
+  for(byte i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+    if(!benchLookupSize(sizes[i])) return false;
+  }
+  return true;
+}
+// End Phone Lookup
+
+// Begin Contact Sync
+#define SYNC_RECORDS 5
+
+/**
+* Check that the contacts array holds the valid lines of the file, in order
+* lines: The file, NULL for a line not in it
+*/
+static bool contactsMatchFile(const char *const *lines){
+  ContactParser check;
+  ContactText text;
+  byte entry = 0;
+  for(byte i = 0; i < SYNC_RECORDS && lines[i] != NULL; i++){
+    check.begin(&text);
+    byte result = CONTACT_PARSE_MORE;
+    for(const char *c = lines[i]; *c; c++) result = check.feed(*c);
+    result = check.feed('\n');
+    if(result != CONTACT_PARSE_DONE) continue;
+    if(entry >= numContacts || contacts[entry]->hash != text.hash) return false;
+    entry++;
+  }
+  return entry == numContacts;
+}
+
+/**
+* Edit a contacts file with malformed lines one record at a time and check
+* that each sync fetches only the records that changed or moved
+*
+* Returns:
+*   -false if a sync fetched more than that, or fell back to a full transfer
+*/
+static bool benchContactSync(){
+  static Contact records[CONTACTS_MAX_NUMBER];
+  for(byte i = 0; i < CONTACTS_MAX_NUMBER; i++) contacts[i] = &records[i];
+  // Loads end with a melody
+  soundBegin();
+
+  const char *lines[SYNC_RECORDS] = {
+    "1,Mayan,mayan@example.com,16479806182",
+    "1,Aaron,aaron@example.com",   // No phone
+    "2,Lab,lab@example.com,14165550102",
+    "12,Priya,priya@example.com,4165550103",
+    NULL,
+  };
+  std::string file;
+  for(byte i = 0; i < SYNC_RECORDS && lines[i] != NULL; i++) file.append(lines[i]).append("\n");
+  simSlaveSetContacts(file.c_str());
+  numContacts = 0;
+  loadAndValidateContacts();
+  bool ok = numContacts == 3 && contactsMatchFile(lines);
+  printf("  full load, 1 of 4 lines malformed: %s\n", ok ? "as expected" : "FAILED");
+
+  // Every name at the longest the parser accepts
+  std::string full;
+  char line[CONTACT_LINE_MAX];
+  for(byte i = 0; i < CONTACTS_MAX_NUMBER; i++){
+    snprintf(line, sizeof(line), "1,Contact%c,c@example.com,41655501%02u\n", 'A' + i, i);
+    full.append(line);
+  }
+  simSlaveSetContacts(full.c_str());
+  numContacts = 0;
+  loadAndValidateContacts();
+  bool names = numContacts == CONTACTS_MAX_NUMBER;
+  for(byte i = 0; i < numContacts && names; i++){
+    snprintf(line, sizeof(line), "Contact%c", 'A' + i);
+    names = strcmp(contactName(i), line) == 0;
+  }
+  printf("  full load, %u names of %u characters: %s\n", CONTACTS_MAX_NUMBER, CONTACT_NAME_SIZE - 1,
+         names ? "all kept" : "FAILED");
+  ok = ok && names;
+
+  // Back to the file with the malformed line, loaded in full
+  simSlaveSetContacts(file.c_str());
+  numContacts = 0;
+  loadAndValidateContacts();
+  ok = ok && contactsMatchFile(lines);
+
+  static const struct { byte record; const char *line; byte fetched; const char *what; } edits[] = {
+    { 3, "12,Priya,priya@example.com,4165550103,30",  2, "edit after a malformed line (read once)" },
+    { 3, "12,Priya,priya@example.com,4165550103,45",  1, "edit after a malformed line" },
+    { 1, "1,Aaron,aaron@example.com,14165550101",     3, "malformed line fixed, 2 records moved" },
+    { 2, "2,Lab,lab@example.com",                     2, "line made malformed, 1 record moved" },
+    { 4, "3,Zoe,zoe@example.com,4165550104",          1, "line added" },
+  };
+  for(byte i = 0; i < sizeof(edits) / sizeof(edits[0]); i++){
+    lines[edits[i].record] = edits[i].line;
+    simSlaveSetContact(edits[i].record, edits[i].line);
+    loadAndValidateContacts();
+    bool synced = contactsRecordsFetched == edits[i].fetched && contactsMatchFile(lines);
+    printf("  %-42s %u records fetched: %s\n", edits[i].what, contactsRecordsFetched,
+           synced ? "as expected" : "FAILED");
+    ok = ok && synced;
+  }
+  return ok;
+}
+// End Contact Sync
+
+// Begin Message Templates
+#define TEMPLATE_RENDERS 200000UL
+
+// The strncat renderer this tree used before the flash templates
+static void legacyAppendInputNames(char *message, byte msgSize, byte inputSet){
+  boolean first = true;
+  for(byte i = 0; i < NUMINPUTS; i++){
+    if(!(inputSet & (1 << i))) continue;
+    if(!first) strncat(message, ", ", msgSize - strlen(message) - 1);
+    strncat_P(message, inputConfig[i].name, msgSize - strlen(message) - 1);
+    first = false;
+  }
+}
+
+static void legacyRenderMessage(byte templateId, const byte *args, char *message, byte msgSize){
+  message[0] = '\0';
+
+  switch(templateId){
+    case MSG_ALARM_ENTERED:
+    case MSG_ALARM_STILL:
+      strncat(message, "The ", msgSize - strlen(message) - 1);
+      strncat_P(message, inputConfig[args[0]].name, msgSize - strlen(message) - 1);
+      if(templateId == MSG_ALARM_ENTERED){
+        strncat(message, " is in an alarm state.", msgSize - strlen(message) - 1);
+      }
+      else{
+        strncat(message, " is still in an alarm state.", msgSize - strlen(message) - 1);
+      }
+      if(INPUT_REQUIRES_RESPONSE(args[0])){
+        // Ask the recipient to reply with BIRLOFF
+        strncat(message, " Please reply with 'BIRLOFF' if you are responding.", msgSize - strlen(message) - 1);
+      }
+      break;
+
+    case MSG_ALARM_CLEARED:
+      strncat(message, "The ", msgSize - strlen(message) - 1);
+      strncat_P(message, inputConfig[args[0]].name, msgSize - strlen(message) - 1);
+      strncat(message, " alarm has been cleared. The messages will now cease.", msgSize - strlen(message) - 1);
+      break;
+
+    case MSG_ALARM_RESPONSE:
+      strncat(message, contactName(args[1]), msgSize - strlen(message) - 1);
+      strncat(message, " is responding to the ", msgSize - strlen(message) - 1);
+      strncat_P(message, inputConfig[args[0]].name, msgSize - strlen(message) - 1);
+      strncat(message, " alarm.", msgSize - strlen(message) - 1);
+      break;
+
+    case MSG_NOT_ADDRESSED_1:
+    case MSG_NOT_ADDRESSED_2:
+      strncat(message, contactName(args[1]), msgSize - strlen(message) - 1);
+      strncat(message, " has not addressed the ", msgSize - strlen(message) - 1);
+      strncat_P(message, inputConfig[args[0]].name, msgSize - strlen(message) - 1);
+      if(templateId == MSG_NOT_ADDRESSED_1){
+        strncat(message, " alarm from 2 hours ago. The alarm has been reset, so please standby.", msgSize - strlen(message) - 1);
+      }
+      else{
+        strncat(message, " alarm from 2 hours ago. The alarm has been reset.", msgSize - strlen(message) - 1);
+      }
+      break;
+
+    case MSG_ALARM_DISABLED:
+      strncat(message, "Alarm has been disabled.", msgSize - strlen(message) - 1);
+      break;
+
+    case MSG_ALARM_ENABLED:
+      strncat(message, "Alarm has been automatically enabled.", msgSize - strlen(message) - 1);
+      break;
+
+    case MSG_I2C_FAILED:
+      strncat(message, "Master -> Slave I2C has failed. Reply with 'IKNOW' to stop these updates. Status: ", msgSize - strlen(message) - 1);
+      if(strlen(message) < (size_t)(msgSize - 1)){
+        byte length = strlen(message);
+        message[length] = args[0] + 48; //Convert decimal code to ASCII equivalent
+        message[length + 1] = '\0';
+      }
+      break;
+
+    case MSG_I2C_RESTORED:
+      strncat(message, "Master -> Slave I2C has sucessfully restarted.", msgSize - strlen(message) - 1);
+      break;
+
+    case MSG_ALARM_DIGEST:
+      if(args[0]){
+        legacyAppendInputNames(message, msgSize, args[0]);
+        strncat(message, " in alarm.", msgSize - strlen(message) - 1);
+      }
+      if(args[1]){
+        if(args[0]) strncat(message, " ", msgSize - strlen(message) - 1);
+        legacyAppendInputNames(message, msgSize, args[1]);
+        strncat(message, " cleared.", msgSize - strlen(message) - 1);
+      }
+      for(byte i = 0; i < NUMINPUTS; i++){
+        if((args[0] & (1 << i)) && INPUT_REQUIRES_RESPONSE(i)){
+          // Ask the recipient to reply with BIRLOFF
+          strncat(message, " Please reply with 'BIRLOFF' if you are responding.", msgSize - strlen(message) - 1);
+          break;
+        }
+      }
+      break;
+
+    case MSG_I2C_RESPONSE:
+      strncat(message, contactName(args[0]), msgSize - strlen(message) - 1);
+      strncat(message, " is responding to the I2C error", msgSize - strlen(message) - 1);
+      break;
+  }
+}
+
+static void templateArgs(byte templateId, byte *args){
+  switch(templateId){
+    case MSG_ALARM_DIGEST:
+      args[0] = benchRandom() & ((1 << NUMINPUTS) - 1);
+      args[1] = benchRandom() & ((1 << NUMINPUTS) - 1) & ~args[0];
+      break;
+    case MSG_I2C_FAILED:
+      args[0] = benchRandom() % 10;
+      args[1] = 0;
+      break;
+    default:
+      args[0] = benchRandom() % NUMINPUTS;
+      args[1] = benchRandom() % 4;
+      break;
+  }
+  if(templateId == MSG_I2C_RESPONSE) args[0] = benchRandom() % 4;
+}
+
+/**
+* Render every template with random arguments and buffer sizes, and check
+* the text against the strncat renderer
+*
+* Returns:
+*   -false if a text differs
+*/
+static bool benchTemplates(){
+  static Contact records[CONTACTS_MAX_NUMBER];
+  static const char *names[] = { "Mayan", "Aaron", "Lab", "Priya" };
+  for(byte i = 0; i < CONTACTS_MAX_NUMBER; i++) contacts[i] = &records[i];
+  contactRecordsBegin();
+  for(byte i = 0; i < 4; i++){
+    ContactText text;
+    strcpy(text.groups, "1");
+    strcpy(text.name, names[i]);
+    strcpy(text.email, "x@example.com");
+    strcpy(text.phone, "14165550100");
+    text.hash = 0;
+    contactStore(i, &text);
+  }
+
+  const byte msgSize = 140;
+  char expected[msgSize], rendered[msgSize];
+  byte args[2];
+  unsigned long checked = 0;
+
+  for(unsigned long run = 0; run < TEMPLATE_RENDERS; run++){
+    byte templateId = MSG_ALARM_ENTERED + run % MSG_ALARM_DIGEST;
+    // The disabled message now says for how long
+    if(templateId == MSG_ALARM_DISABLED) continue;
+    templateArgs(templateId, args);
+    byte size = run % 8 == 0 ? 1 + benchRandom() % msgSize : msgSize;
+
+    legacyRenderMessage(templateId, args, expected, size);
+    renderMessage(templateId, args, rendered, size);
+    if(strcmp(expected, rendered) != 0){
+      printf("  template %u, buffer %u:\n    %s\n    %s\n", templateId, size, expected, rendered);
+      return false;
+    }
+    checked++;
+  }
+  printf("Message templates: %lu renders identical to the strncat renderer\n", checked);
+
+  printf("Message rendering, ns per message\n");
+  BenchClock::time_point start = BenchClock::now();
+  for(unsigned long run = 0; run < TEMPLATE_RENDERS; run++){
+    byte templateId = MSG_ALARM_ENTERED + run % MSG_ALARM_DIGEST;
+    templateArgs(templateId, args);
+    legacyRenderMessage(templateId, args, expected, msgSize);
+  }
+  printf("  strncat chains     %8.1f\n", nanosSince(start, TEMPLATE_RENDERS));
+
+  start = BenchClock::now();
+  for(unsigned long run = 0; run < TEMPLATE_RENDERS; run++){
+    byte templateId = MSG_ALARM_ENTERED + run % MSG_ALARM_DIGEST;
+    templateArgs(templateId, args);
+    renderMessage(templateId, args, rendered, msgSize);
+  }
+  printf("  flash templates    %8.1f\n", nanosSince(start, TEMPLATE_RENDERS));
+  return true;
+}
+// End Message Templates
+
+// Begin Log
+static std::vector<std::string> decodedLines;
+
+static void decodeTap(uint8_t c){
+  char line[512];
+  if(simLogDecodeByte(c, line, sizeof(line))) decodedLines.push_back(line);
+}
+
+struct LogCase
+{
+  void (*log)(void);
+  const char *text;
+};
+
+static const char longSMS[] = "Reply with BIRLOFF if you are responding to the Shandon TP alarm, or with IKNOW to stop the I2C updates";
+
+static const LogCase logCases[] = {
+  { []{ LOG(LOG_BOOT, NUMINPUTS); }, "[I] Alarm Initialized with 3 inputs" },
+  { []{ LOG(LOG_GSM_ERROR, -3); }, "[E] Error has occured! Restarting. Code: -3" },
+  { []{ LOG(LOG_GSM_ERROR, (int32_t)0x80000000UL); }, "[E] Error has occured! Restarting. Code: -2147483648" },
+  { []{ LOG(LOG_CONTACTS_BYTES, 4294967295UL); }, "[I] Total bytes transferred: 4294967295" },
+  { []{ LOG(LOG_INPUT_PRESSED, 0, 127UL); }, "[I] Input 0 just pressed at 127" },
+  { []{ LOG(LOG_INPUT_RELEASED, 2, 7200128UL); }, "[I] Input 2 just released at 7200128" },
+  { []{ LOG(LOG_POOLS, 192, 84, 120); }, "[I] Static pools: 192 bytes of contacts, 84 bytes of contact names, 120 bytes of inputs" },
+  { []{ LOG(LOG_SMS_RECEIVED, "+14165550101", "BIRLOFF"); }, "[I] Incoming SMS from +14165550101: BIRLOFF" },
+  // The text is cut to the room left in the record
+  { []{ LOG(LOG_SMS_RECEIVED, "+14165550101", longSMS); }, "[I] Incoming SMS from +14165550101: Reply with BIRLOFF if you are r" },
+  { []{ LOG(LOG_CALLING, 1, ""); }, "[I] Calling contact 1: " },
+  { []{ LOG(LOG_SEND_RETRY, 2); }, "[W] Attempt 2: Message failed to send. Retrying later." },
+  { []{ LOG(LOG_INPUT_NOT_ADDRESSED, -1, 1); }, "[I] Although contact -1 had taken responsibility for attending to the alarm, input 1 is still active 2 hours later. Group 1 will be called again until another person takes responsibility to address the alarm." },
+};
+#define LOG_CASES (sizeof(logCases) / sizeof(logCases[0]))
+
+/**
+* Send a burst of messages as text and as log records, and compare the time
+* Serial kept the processor blocked at 9600 baud
+*/
+static void benchLogBurst(){
+  unsigned long textBytes = 0;
+  uint64_t start = simNowMicros();
+  for(byte i = 0; i < LOG_CASES; i++){
+    // The text as Serial.println() sent it, without the level
+    textBytes += Serial.println(logCases[i].text + 4);
+  }
+  uint64_t textBlocked = simNowMicros() - start;
+  simAdvanceMicros(2000000);
+
+  LogStats before = *logGetStats();
+  start = simNowMicros();
+  for(byte i = 0; i < LOG_CASES; i++) logCases[i].log();
+  uint64_t logBlocked = simNowMicros() - start;
+  const LogStats *after = logGetStats();
+  simAdvanceMicros(2000000);
+
+  printf("Burst of %u messages at %lu baud\n", (unsigned)LOG_CASES, simSerialBaud);
+  printf("  Serial.println     %5lu bytes, blocked %6.1f ms\n", textBytes, textBlocked / 1e3);
+  printf("  log records        %5lu bytes, blocked %6.1f ms, %lu sent, %u dropped\n",
+         after->bytes - before.bytes, logBlocked / 1e3,
+         after->records - before.records, after->dropped - before.dropped);
+}
+
+/**
+* Decode each message sent on its own and check the text, then time a burst
+*
+* Returns:
+*   -false if a decoded text differs
+*/
+static bool benchLog(){
+  simSerialTap = decodeTap;
+  for(byte i = 0; i < LOG_CASES; i++){
+    decodedLines.clear();
+    logCases[i].log();
+    simAdvanceMicros(1000000);
+    if(decodedLines.size() != 1 || decodedLines[0] != logCases[i].text){
+      printf("  case %u:\n    %s\n    %s\n", i, logCases[i].text, decodedLines.empty() ? "(nothing)" : decodedLines[0].c_str());
+      return false;
+    }
+  }
+  printf("Log records: %u messages decoded back to their text\n", (unsigned)LOG_CASES);
+  simSerialTap = NULL;
+
+  benchLogBurst();
+
+  // What was dropped is reported ahead of the next record
+  simSerialTap = decodeTap;
+  decodedLines.clear();
+  LOG(LOG_BOOT, NUMINPUTS);
+  simAdvanceMicros(1000000);
+  simSerialTap = NULL;
+  if(decodedLines.empty() || decodedLines[0].find("log records dropped") == std::string::npos){
+    printf("  dropped records were not reported\n");
+    return false;
+  }
+  printf("  then: %s\n", decodedLines[0].c_str());
+  return true;
+}
+// End Log
+
+// Begin Sound
+/**
+* Play one note and measure its pitch from the speaker toggles
+*
+* Returns:
+*   -false if it is off by more than 1%, blocked, or not the expected length
+*/
+static bool benchSoundNote(uint16_t frequency){
+  const MelodyNote melody[] = { {frequency, 500}, {0, 0} };
+  SimTimerStats before = *simGetTimer2Stats();
+  uint64_t start = simNowMicros();
+  soundPlay(melody, SOUND_PRIORITY_STATUS);
+  uint64_t blocked = simNowMicros() - start;
+  while(soundBusy()) simAdvanceMicros(100);
+  uint64_t played = simNowMicros() - start;
+
+  const SimTimerStats *after = simGetTimer2Stats();
+  double halfPeriod = (double)(after->toggleCycles - before.toggleCycles) / (after->toggles - before.toggles);
+  double measured = F_CPU / halfPeriod / 2;
+  double error = (measured - frequency) / frequency * 100;
+  // The pitch error, the last half period cut and the interrupt ending the note
+  uint64_t slack = 5000 + 1000000 / frequency;
+  printf("  %5u Hz: %8.1f Hz (%+.2f%%), played %5.1f ms, blocked %llu us\n",
+         frequency, measured, error, played / 1e3, (unsigned long long)blocked);
+  return fabs(error) < 1 && blocked == 0 && played + slack >= 500000 && played <= 500000 + slack;
+}
+
+/**
+* Check the pitch of the notes over the speaker's range and that a higher
+* priority melody preempts a lower one
+*
+* Returns:
+*   -false if a check fails
+*/
+static bool benchSound(){
+  static const uint16_t notes[] = { NOTE_B0, NOTE_C4, NOTE_A5, NOTE_C6, NOTE_B7, NOTE_DS8 };
+  soundBegin();
+  printf("Timer2 sound sequencer\n");
+  for(byte i = 0; i < sizeof(notes) / sizeof(notes[0]); i++){
+    if(!benchSoundNote(notes[i])) return false;
+  }
+
+  // The alarm cuts the 1 s status beep short; a status beep during it is dropped
+  uint64_t start = simNowMicros();
+  playLongBeepSound();
+  simAdvanceMicros(100000);
+  playAlarmSound();
+  playShortBeepSound();
+  while(soundBusy()) simAdvanceMicros(100);
+  uint64_t preempted = simNowMicros() - start;
+
+  // A second alarm plays after the first
+  start = simNowMicros();
+  playAlarmSound();
+  playAlarmSound();
+  while(soundBusy()) simAdvanceMicros(100);
+  uint64_t queued = simNowMicros() - start;
+
+  printf("  Alarm over long beep: silent after %.1f ms; two alarms: %.1f ms\n", preempted / 1e3, queued / 1e3);
+  return preempted < 420000 && queued >= 600000 && queued < 620000;
+}
+// End Sound
+
+// Begin Modem UART
+static SerialGSM *uartModem;
+static char uartSender[GSM_PHONE_SIZE];
+static char uartMessage[GSM_SMS_SIZE];
+static unsigned int uartMessages = 0;
+
+static double frameMicros(){
+  return 10.0 * 8 * (UBRR1 + 1) / (F_CPU / 1e6);
+}
+
+static int uartCallback(){
+  strlcpy(uartSender, uartModem->Sender(), sizeof(uartSender));
+  strlcpy(uartMessage, uartModem->Message(), sizeof(uartMessage));
+  uartMessages++;
+  return 0;
+}
+
+/**
+* Send a +CMT with a 160 character text and leave it in the RX ring for
+* holdMs after its last byte before the driver reads it
+*
+* Returns:
+*   -false if a byte was lost or the text came out different
+*/
+static bool benchUartMessage(SerialGSM *modem, unsigned long holdMs){
+  char text[161];
+  for(byte i = 0; i < 160; i++) text[i] = 'A' + (i * 7 + holdMs) % 26;
+  text[160] = '\0';
+
+  ModemUartStats before;
+  modemSerial.getStats(&before);
+  static const char header[] = "\r\n+CMT: \"+14165550101\",\"\",\"14/07/15,12:00:00+00\"\r\n";
+  simUsart1Send(header);
+  simUsart1Send(text);
+  simUsart1Send("\r\n");
+  // Until the last byte is in, then the hold
+  size_t length = strlen(header) + strlen(text) + 2;
+  simAdvanceMicros((uint64_t)(length * frameMicros()) + 1 + holdMs * 1000ULL);
+  unsigned int messages = uartMessages;
+  modem->Poll();
+
+  ModemUartStats after;
+  modemSerial.getStats(&after);
+  unsigned long bytes = after.rxBytes - before.rxBytes;
+  unsigned int lost = after.rxOverruns - before.rxOverruns;
+  bool intact = uartMessages == messages + 1 && strcmp(uartMessage, text) == 0
+                && strcmp(uartSender, "+14165550101") == 0;
+  printf("  read %4lu ms after: %3lu bytes, ring peak %3u, %3u lost, text %s\n",
+         holdMs, bytes, after.rxHighWater, lost, intact ? "intact" : "damaged");
+  return lost == 0 && intact;
+}
+
+/**
+* Check that a full +CMT fits in the modem RX ring however late the loop
+* reads it, and how fast back to back messages fill the ring at MODEM_BAUD
+*
+* Returns:
+*   -false if a byte was lost
+*/
+static bool benchUart(){
+  static SerialGSM modem(modemSerial);
+  uartModem = &modem;
+  modemSerial.begin(MODEM_BAUD);
+  modem.registerSMSCallback(uartCallback);
+
+  printf("Modem UART at %lu baud (%.1f us per byte), %u byte RX ring\n",
+         (unsigned long)MODEM_BAUD, frameMicros(), MODEM_RX_BUFFER_SIZE);
+  static const unsigned long holds[] = { 0, 25, 100, 1000 };
+  for(byte i = 0; i < sizeof(holds) / sizeof(holds[0]); i++){
+    if(!benchUartMessage(&modem, holds[i])) return false;
+  }
+  printf("  A second message right behind the first overflows the ring after %.1f ms unread\n",
+         (MODEM_RX_BUFFER_SIZE - 1) * frameMicros() / 1e3);
+  return true;
+}
+// End Modem UART
+
+// Begin AT Engine
+// Port for an engine fed straight from a transcript: keeps what it writes
+class TranscriptPort : public Stream
+{
+  public:
+    std::string sent;
+    virtual size_t write(uint8_t c) { sent += (char)c; return 1; }
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+    using Print::write;
+};
+
+struct AtTranscript
+{
+  const char *name;
+  byte command;            // GSM_CMD_ started before the modem output, or GSM_CMD_NONE
+  const char *modem;       // What the modem sent
+  byte result;             // GSM_RESULT_ the command should get
+  int status;              // GetGSMStatus() afterwards
+  unsigned int messages;   // SMS passed to the callback
+  const char *message;     // Text of the last one
+  int errorCode;
+  byte call;               // GetCallState() afterwards
+};
+
+#define BENCH_PHONE "+14165550101"
+#define BENCH_SMS_TEXT "Alarm on input 2"
+#define READY "\r\nCall Ready\r\n"
+#define CMT "\r\n+CMT: \"" BENCH_PHONE "\",\"\",\"14/07/15,12:00:00+00\"\r\n"
+#define CMGR(status) "\r\n+CMGR: \"" status "\",\"" BENCH_PHONE "\",\"\",\"14/07/15,12:00:00+00\"\r\n"
+#define CLCC(stat) "\r\n+CLCC: 1,0," #stat ",0,0,\"" BENCH_PHONE "\",145\r\n"
+#define TEXT_200 "0123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789" \
+                 "0123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789"
+
+// Modem output recorded from the SIM900 model in Modem.cpp, and the
+// responses and reports of the SIM900 AT command manual it does not send
+static const AtTranscript transcripts[] = {
+  { "power up",         GSM_CMD_NONE, "\r\nRDY\r\n\r\n+CFUN: 1\r\n\r\n+CPIN: READY\r\n\r\nCall Ready\r\n",
+    GSM_RESULT_PENDING, GSM_STATUS_READY, 0, "", 0, GSM_CALL_IDLE },
+  { "echoed AT",        GSM_CMD_AT, "AT\r\r\nOK\r\n", GSM_RESULT_OK, GSM_STATUS_BOOTING, 0, "", 0, GSM_CALL_IDLE },
+  { "registered",       GSM_CMD_REGISTRATION, "\r\n+CREG: 1,1\r\n\r\nOK\r\n", GSM_RESULT_OK, GSM_STATUS_READY, 0, "", 0, GSM_CALL_IDLE },
+  { "roaming report",   GSM_CMD_NONE, "\r\n+CREG: 5\r\n", GSM_RESULT_PENDING, GSM_STATUS_READY, 0, "", 0, GSM_CALL_IDLE },
+  { "searching",        GSM_CMD_REGISTRATION, "\r\n+CREG: 1,2\r\n\r\nOK\r\n", GSM_RESULT_OK, GSM_STATUS_BOOTING, 0, "", 0, GSM_CALL_IDLE },
+  { "SMS sent",         GSM_CMD_SEND_SMS, READY "\r\n> \r\n+CMGS: 12\r\n\r\nOK\r\n", GSM_RESULT_OK, GSM_STATUS_READY, 0, "", 0, GSM_CALL_IDLE },
+  { "SMS echoed",       GSM_CMD_SEND_SMS, READY "AT+CMGS=\"" BENCH_PHONE "\"\r\r\n> " BENCH_SMS_TEXT "\x1A\r\n+CMGS: 13\r\n\r\nOK\r\n",
+    GSM_RESULT_OK, GSM_STATUS_READY, 0, "", 0, GSM_CALL_IDLE },
+  { "SMS refused",      GSM_CMD_SEND_SMS, "\r\n+CMS ERROR: 500\r\n", GSM_RESULT_ERROR, GSM_STATUS_BOOTING, 0, "", 0, GSM_CALL_IDLE },
+  { "SMS not sent",     GSM_CMD_SEND_SMS, "\r\n> \r\n+CMS ERROR: 38\r\n", GSM_RESULT_ERROR, GSM_STATUS_BOOTING, 0, "", 0, GSM_CALL_IDLE },
+  { "SMS received",     GSM_CMD_NONE, READY CMT "BIRLOFF\r\n", GSM_RESULT_PENDING, GSM_STATUS_READY, 1, "BIRLOFF", 0, GSM_CALL_IDLE },
+  { "SMS saying OK",    GSM_CMD_DELETE_READ_SMS, CMT "OK\r\n\r\nOK\r\n", GSM_RESULT_OK, GSM_STATUS_BOOTING, 1, "OK", 0, GSM_CALL_IDLE },
+  { "long SMS",         GSM_CMD_NONE, CMT TEXT_200 "\r\n", GSM_RESULT_PENDING, GSM_STATUS_BOOTING, 1, NULL, 0, GSM_CALL_IDLE },
+  { "stored SMS",       GSM_CMD_NONE, READY "\r\n+CMTI: \"SM\",3\r\n", GSM_RESULT_PENDING, GSM_STATUS_READY, 0, "", 0, GSM_CALL_IDLE },
+  { "SMS read",         GSM_CMD_READ_SMS, READY CMGR("REC UNREAD") "BIRLOFF\r\n\r\nOK\r\n", GSM_RESULT_OK, GSM_STATUS_READY, 1,
+    "BIRLOFF", 0, GSM_CALL_IDLE },
+  { "read SMS saying OK", GSM_CMD_READ_SMS, CMGR("REC UNREAD") "OK\r\n\r\nOK\r\n", GSM_RESULT_OK, GSM_STATUS_BOOTING, 1, "OK", 0,
+    GSM_CALL_IDLE },
+  { "SMS read before",  GSM_CMD_READ_SMS, READY CMGR("REC READ") "BIRLOFF\r\n\r\nOK\r\n", GSM_RESULT_OK, GSM_STATUS_READY, 0, "",
+    0, GSM_CALL_IDLE },
+  { "empty index",      GSM_CMD_READ_SMS, READY "\r\n+CMS ERROR: 321\r\n", GSM_RESULT_ERROR, GSM_STATUS_READY, 0, "", 0, GSM_CALL_IDLE },
+  { "storage",          GSM_CMD_STORAGE, "\r\n+CPMS: \"SM\",0,30,\"SM\",0,30,\"SM\",0,30\r\n\r\nOK\r\n", GSM_RESULT_OK,
+    GSM_STATUS_BOOTING, 0, "", 0, GSM_CALL_IDLE },
+  { "call ended",       GSM_CMD_DIAL, READY "\r\nOK\r\n\r\nNO CARRIER\r\n", GSM_RESULT_OK, GSM_STATUS_CALL_ENDED, 0, "", 0, GSM_CALL_ENDED },
+  { "call in progress", GSM_CMD_DIAL, READY "\r\nOK\r\n\r\nRING\r\n", GSM_RESULT_OK, GSM_STATUS_IN_CALL, 0, "", 0, GSM_CALL_DIALING },
+  { "line busy",        GSM_CMD_DIAL, READY "\r\nBUSY\r\n", GSM_RESULT_ERROR, GSM_STATUS_READY, 0, "", 0, GSM_CALL_IDLE },
+  { "no answer",        GSM_CMD_DIAL, READY "\r\nNO ANSWER\r\n", GSM_RESULT_ERROR, GSM_STATUS_READY, 0, "", 0, GSM_CALL_IDLE },
+  { "hung up",          GSM_CMD_HANGUP, READY "\r\nNO CARRIER\r\n\r\nOK\r\n", GSM_RESULT_OK, GSM_STATUS_READY, 0, "", 0, GSM_CALL_IDLE },
+  { "far end ringing",  GSM_CMD_DIAL, READY "\r\nOK\r\n" CLCC(2) CLCC(3), GSM_RESULT_OK, GSM_STATUS_IN_CALL, 0, "", 0, GSM_CALL_ALERTING },
+  { "call answered",    GSM_CMD_DIAL, READY "\r\nOK\r\n" CLCC(2) CLCC(3) CLCC(0), GSM_RESULT_OK, GSM_STATUS_IN_CALL, 0, "", 0,
+    GSM_CALL_ACTIVE },
+  { "call rejected",    GSM_CMD_DIAL, READY "\r\nOK\r\n" CLCC(2) CLCC(3) CLCC(6) "\r\nNO CARRIER\r\n", GSM_RESULT_OK,
+    GSM_STATUS_CALL_ENDED, 0, "", 0, GSM_CALL_ENDED },
+  { "busy reported",    GSM_CMD_DIAL, READY "\r\nOK\r\n" CLCC(2) CLCC(6) "\r\nBUSY\r\n", GSM_RESULT_OK,
+    GSM_STATUS_CALL_ENDED, 0, "", 0, GSM_CALL_ENDED },
+  { "busy before OK",   GSM_CMD_DIAL, READY CLCC(6) "\r\nBUSY\r\n", GSM_RESULT_ERROR, GSM_STATUS_READY, 0, "", 0, GSM_CALL_IDLE },
+  { "incoming ignored", GSM_CMD_DIAL, READY "\r\nOK\r\n" CLCC(2) "\r\n+CLCC: 2,1,4,0,0,\"+14165550199\",145\r\n",
+    GSM_RESULT_OK, GSM_STATUS_IN_CALL, 0, "", 0, GSM_CALL_DIALING },
+  { "report when idle", GSM_CMD_NONE, READY CLCC(0), GSM_RESULT_PENDING, GSM_STATUS_READY, 0, "", 0, GSM_CALL_IDLE },
+  { "answered hung up", GSM_CMD_HANGUP, READY CLCC(6) "\r\nOK\r\n", GSM_RESULT_OK, GSM_STATUS_READY, 0, "", 0, GSM_CALL_IDLE },
+  { "incoming call",    GSM_CMD_NONE, READY "\r\nRING\r\n\r\nRING\r\n\r\nNO CARRIER\r\n", GSM_RESULT_PENDING, GSM_STATUS_READY, 0, "", 0, GSM_CALL_IDLE },
+  { "equipment error",  GSM_CMD_AT, "\r\n+CME ERROR: 10\r\n", GSM_RESULT_ERROR, GSM_STATUS_BOOTING, 0, "", 10, GSM_CALL_IDLE },
+  { "modem restarted",  GSM_CMD_NONE, READY "\r\nRDY\r\n", GSM_RESULT_PENDING, GSM_STATUS_RESET, 0, "", 0, GSM_CALL_IDLE },
+  { "no SIM",           GSM_CMD_NONE, "\r\nRDY\r\n\r\n+CFUN: 1\r\n\r\n+CPIN: NOT INSERTED\r\n", GSM_RESULT_PENDING, GSM_STATUS_NO_SIM, 0, "", 0, GSM_CALL_IDLE },
+  { "under-voltage",    GSM_CMD_NONE, READY "\r\nUNDER-VOLTAGE POWER DOWN\r\n", GSM_RESULT_PENDING, GSM_STATUS_POWER_DOWN, 0, "", 0, GSM_CALL_IDLE },
+  { "powered down",     GSM_CMD_HANGUP, READY "\r\nNORMAL POWER DOWN\r\n", GSM_RESULT_PENDING, GSM_STATUS_POWER_DOWN, 0, "", 0, GSM_CALL_IDLE },
+  { "near misses",      GSM_CMD_AT, "\r\nOKAY\r\n\r\nRINGING\r\nOK \r\n\r\n+CMTX: 1\r\n", GSM_RESULT_PENDING, GSM_STATUS_BOOTING, 0, "", 0, GSM_CALL_IDLE },
+  { "line noise",       GSM_CMD_AT, "\r\n\xff\x01\x80garbage\"\r\n\r\nOK\r\n", GSM_RESULT_OK, GSM_STATUS_BOOTING, 0, "", 0, GSM_CALL_IDLE },
+  { "stray OK",         GSM_CMD_NONE, READY "\r\nOK\r\n\r\nERROR\r\n", GSM_RESULT_PENDING, GSM_STATUS_READY, 0, "", 0, GSM_CALL_IDLE },
+};
+#define TRANSCRIPTS (sizeof(transcripts) / sizeof(transcripts[0]))
+
+// Begin Engine Under Test
+static unsigned int engineMessages;
+static unsigned int engineResults;
+static byte engineResult;
+static SerialGSM *engine;
+static char engineMessage[GSM_SMS_SIZE];
+
+static int engineSMS(){
+  engineMessages++;
+  strlcpy(engineMessage, engine->Message(), sizeof(engineMessage));
+  return 0;
+}
+
+static void engineDone(byte result){
+  engineResults++;
+  engineResult = result;
+}
+
+static void startEngine(SerialGSM *gsm, byte command){
+  engine = gsm;
+  engineMessages = 0;
+  engineResults = 0;
+  engineResult = GSM_RESULT_PENDING;
+  engineMessage[0] = '\0';
+  gsm->registerSMSCallback(engineSMS);
+  if(command != GSM_CMD_NONE){
+    const char *argument = command == GSM_CMD_SEND_SMS || command == GSM_CMD_DIAL ? BENCH_PHONE : NULL;
+    if(command == GSM_CMD_READ_SMS || command == GSM_CMD_DELETE_SMS) argument = "1";
+    gsm->Start(command, argument, BENCH_SMS_TEXT, engineDone);
+  }
+}
+
+static void feedEngine(SerialGSM *gsm, const std::string &modem){
+  for(size_t i = 0; i < modem.size(); i++) gsm->Feed(modem[i]);
+}
+// End Engine Under Test
+
+/**
+* Feed each transcript in one go and check what the engine made of it
+*
+* Returns:
+*   -false if any transcript gave another result, status or message
+*/
+static bool checkTranscripts(){
+  bool passed = true;
+  for(byte i = 0; i < TRANSCRIPTS; i++){
+    const AtTranscript *t = &transcripts[i];
+    TranscriptPort port;
+    SerialGSM gsm(port);
+    startEngine(&gsm, t->command);
+    feedEngine(&gsm, t->modem);
+
+    bool textOk = t->message == NULL ? strlen(engineMessage) == GSM_SMS_SIZE - 1 : strcmp(engineMessage, t->message) == 0;
+    bool ok = engineResult == t->result && engineResults == (t->result == GSM_RESULT_PENDING ? 0u : 1u)
+              && gsm.Busy() == (t->result == GSM_RESULT_PENDING && t->command != GSM_CMD_NONE)
+              && gsm.GetGSMStatus() == t->status && engineMessages == t->messages && textOk
+              && gsm.GetErrorCode() == t->errorCode && gsm.GetCallState() == t->call;
+    if(t->messages > 0) ok = ok && strcmp(gsm.Sender(), BENCH_PHONE) == 0;
+
+    // The text goes out once, after the prompt
+    if(t->command == GSM_CMD_SEND_SMS){
+      std::string expected = "AT+CMGS=\"" BENCH_PHONE "\"\r";
+      if(strstr(t->modem, ">") != NULL) expected += BENCH_SMS_TEXT "\x1A";
+      ok = ok && port.sent == expected;
+    }
+    if(!ok){
+      printf("  %-17s result %u, status %d, %u messages \"%s\", error %d, call %u, sent %zu bytes\n", t->name,
+             engineResult, gsm.GetGSMStatus(), engineMessages, engineMessage, gsm.GetErrorCode(), gsm.GetCallState(),
+             port.sent.size());
+      passed = false;
+    }
+  }
+  printf("  %u recorded transcripts: %s\n", (unsigned)TRANSCRIPTS, passed ? "as expected" : "FAILED");
+  return passed;
+}
+
+/**
+* Check the queue of +CMTI indices and the storage state: order, overflow,
+* nearly full and what AT+CPMS? reports
+*
+* Returns:
+*   -false if any of them is off
+*/
+static bool checkStorage(){
+  TranscriptPort port;
+  SerialGSM gsm(port);
+  startEngine(&gsm, GSM_CMD_NONE);
+  bool ok = gsm.TakeStoredSMS() == -1 && !gsm.TakeMissedSMS() && !gsm.StorageNearlyFull();
+
+  // One more than the queue holds: the last is missed
+  for(byte i = 1; i <= GSM_STORED_QUEUE_SIZE + 1; i++){
+    char report[24];
+    snprintf(report, sizeof(report), "\r\n+CMTI: \"SM\",%u\r\n", i);
+    feedEngine(&gsm, report);
+  }
+  for(byte i = 1; i <= GSM_STORED_QUEUE_SIZE; i++) ok = ok && gsm.TakeStoredSMS() == i;
+  ok = ok && gsm.TakeStoredSMS() == -1 && gsm.TakeMissedSMS() && !gsm.TakeMissedSMS();
+  ok = ok && !gsm.StorageNearlyFull();
+
+  // Stored near the end, until the read messages are deleted
+  feedEngine(&gsm, "\r\n+CMTI: \"SM\",18\r\n");
+  ok = ok && gsm.TakeStoredSMS() == 18 && gsm.StorageNearlyFull();
+  gsm.Start(GSM_CMD_DELETE_READ_SMS, NULL, NULL, engineDone);
+  feedEngine(&gsm, "\r\nERROR\r\n");
+  ok = ok && gsm.StorageNearlyFull();
+  gsm.Start(GSM_CMD_DELETE_READ_SMS, NULL, NULL, engineDone);
+  feedEngine(&gsm, "\r\nOK\r\n");
+  ok = ok && !gsm.StorageNearlyFull() && port.sent.find("AT+CMGD=1,3\r") != std::string::npos;
+
+  // Messages already stored at boot, in a bigger storage
+  gsm.Start(GSM_CMD_STORAGE, NULL, NULL, engineDone);
+  feedEngine(&gsm, "\r\n+CPMS: \"SM\",2,30,\"SM\",2,30,\"SM\",2,30\r\n\r\nOK\r\n");
+  ok = ok && gsm.StorageSize() == 30 && gsm.TakeMissedSMS() && !gsm.StorageNearlyFull();
+  gsm.Start(GSM_CMD_STORAGE, NULL, NULL, engineDone);
+  feedEngine(&gsm, "\r\n+CPMS: \"SM\",28,30,\"SM\",28,30,\"SM\",28,30\r\n\r\nOK\r\n");
+  ok = ok && gsm.StorageNearlyFull();
+
+  printf("  SMS storage queue and state: %s\n", ok ? "as expected" : "FAILED");
+  return ok;
+}
+
+static char interestingByte(){
+  static const char bytes[] = "\r\n\",>0123456789+: OKERRORINGCMT\x1A\x1B";
+  if(benchRandom() % 4 == 0) return (char)benchRandom();
+  return bytes[benchRandom() % (sizeof(bytes) - 1)];
+}
+
+/**
+* Damage a transcript: flipped, replaced, dropped, inserted and repeated
+* bytes, a cut, or a piece of another transcript spliced in
+*/
+static void mutateTranscript(std::string *modem){
+  byte edits = 1 + benchRandom() % 4;
+  for(byte e = 0; e < edits; e++){
+    size_t at = modem->empty() ? 0 : benchRandom() % modem->size();
+    switch(benchRandom() % 7){
+      case 0: if(!modem->empty()) (*modem)[at] ^= 1 << (benchRandom() % 8); break;
+      case 1: if(!modem->empty()) (*modem)[at] = interestingByte(); break;
+      case 2: if(!modem->empty()) modem->erase(at, 1 + benchRandom() % 8); break;
+      case 3: modem->insert(at, 1, interestingByte()); break;
+      case 4: modem->insert(at, modem->substr(at, 1 + benchRandom() % 32)); break;
+      case 5: modem->resize(at); break;
+      default: {
+        std::string other = transcripts[benchRandom() % TRANSCRIPTS].modem;
+        size_t from = benchRandom() % other.size();
+        modem->insert(at, other.substr(from, 1 + benchRandom() % 64));
+      }
+    }
+  }
+}
+
+/**
+* Feed damaged transcripts and check the engine stays within bounds and
+* answers the next command normally once the line is clean again
+*
+* Returns:
+*   -false on the first case that breaks an invariant
+*/
+static bool fuzzTranscripts(unsigned long cases){
+  unsigned long bytes = 0, timeouts = 0;
+  BenchClock::time_point start = BenchClock::now();
+
+  for(unsigned long n = 0; n < cases; n++){
+    const AtTranscript *t = &transcripts[n % TRANSCRIPTS];
+    std::string modem = t->modem;
+    mutateTranscript(&modem);
+    bytes += modem.size();
+
+    TranscriptPort port;
+    SerialGSM gsm(port);
+    startEngine(&gsm, t->command);
+    feedEngine(&gsm, modem);
+
+    int status = gsm.GetGSMStatus();
+    bool ok = memchr(gsm.Message(), '\0', GSM_SMS_SIZE) != NULL && memchr(gsm.Sender(), '\0', GSM_PHONE_SIZE) != NULL
+              && (status == GSM_STATUS_RESET || status == GSM_STATUS_BOOTING || status == GSM_STATUS_IN_CALL
+                  || status == GSM_STATUS_READY || status == GSM_STATUS_NO_SIM || status == GSM_STATUS_CALL_ENDED
+                  || status == GSM_STATUS_POWER_DOWN)
+              && engineResults <= 1 && gsm.Busy() == (t->command != GSM_CMD_NONE && engineResults == 0)
+              && (engineResults == 0 || engineResult == GSM_RESULT_OK || engineResult == GSM_RESULT_ERROR);
+
+    // A clean line end, then finish what is still in flight: by its
+    // timeout now and then, otherwise by an ERROR
+    feedEngine(&gsm, "\r\n\r\n");
+    if(gsm.Busy()){
+      if(n % 64 == 0){
+        simAdvanceMicros(60000000ULL + 1);
+        gsm.Poll();
+        ok = ok && engineResult == GSM_RESULT_TIMEOUT;
+        timeouts++;
+      }
+      else{
+        feedEngine(&gsm, "ERROR\r\n");
+        ok = ok && engineResult == GSM_RESULT_ERROR;
+      }
+    }
+    ok = ok && !gsm.Busy() && engineResults == (t->command != GSM_CMD_NONE ? 1u : 0u);
+
+    // Back in step
+    ok = ok && gsm.Start(GSM_CMD_AT, NULL, NULL, engineDone);
+    feedEngine(&gsm, "\r\nOK\r\n");
+    ok = ok && !gsm.Busy() && engineResult == GSM_RESULT_OK;
+
+    if(!ok){
+      printf("  Case %lu (%s) broke an invariant. Modem output:\n    ", n, t->name);
+      for(size_t i = 0; i < modem.size(); i++) printf(isprint((byte)modem[i]) ? "%c" : "\\x%02x", (byte)modem[i]);
+      printf("\n");
+      return false;
+    }
+  }
+
+  printf("  %lu damaged transcripts (%lu timed out): engine in bounds and back in step after each, %.1f ns per byte\n",
+         cases, timeouts, nanosSince(start, bytes));
+  return true;
+}
+
+/**
+* Check that messages come out of the inbox ring as they went in, in order,
+* across the wrap of the ring, and that a message without room is dropped
+*
+* Returns:
+*   -false if a check failed
+*/
+static bool benchInbox(){
+  static const char *senders[] = { "+14165550101", "14165550102", "+44770090012345", "MYBANK", "", "+1",
+                                  "+447700900123456" };
+  InboxMessage message;
+  bool ok = true;
+
+  // Round trips, long enough to wrap the ring many times
+  const unsigned long rounds = 100000;
+  char text[GSM_SMS_SIZE];
+  unsigned long bytes = 0;
+  BenchClock::time_point start = BenchClock::now();
+  for(unsigned long i = 0; i < rounds && ok; i++){
+    const char *sender = senders[i % 7];
+    byte length = benchRandom() % GSM_SMS_SIZE;
+    for(byte j = 0; j < length; j++) text[j] = ' ' + benchRandom() % 95;
+    text[length] = '\0';
+    bytes += length;
+
+    unsigned long sent = millis();
+    ok = inboxPush(sender, text) && inboxTake(&message) && !inboxTake(&message);
+    // Only numbers that fit Sender() are kept
+    bool number = strlen(sender) < GSM_PHONE_SIZE && (sender[0] == '+' || (sender[0] >= '0' && sender[0] <= '9'));
+    ok = ok && strcmp(message.sender, number ? sender : (sender[0] == '+' ? "+" : "")) == 0;
+    ok = ok && strcmp(message.text, text) == 0 && message.receivedAt == sent;
+    simAdvanceMicros(1000);
+  }
+  double nanos = nanosSince(start, bytes);
+
+  // Short replies queue up until the ring is full, then are dropped
+  unsigned int dropped = inboxGetStats()->dropped;
+  byte queued = 0;
+  while(inboxPush("+14165550101", "BIRLOFF")) queued++;
+  ok = ok && queued == INBOX_RING_SIZE / (1 + 4 + 1 + 6 + 7) && inboxGetStats()->dropped == dropped + 1;
+  for(byte i = 0; i < queued; i++){
+    ok = ok && inboxTake(&message) && strcmp(message.text, "BIRLOFF") == 0;
+  }
+  ok = ok && !inboxTake(&message);
+
+  printf("  %lu messages through the ring, %u queued when full: %s, %.1f ns per text byte\n",
+         rounds, queued, ok ? "as expected" : "FAILED", nanos);
+  return ok;
+}
+
+/**
+* Check the AT engine against recorded modem transcripts, then fuzz it
+* with damaged copies of them
+*
+* Returns:
+*   -false if a check failed
+*/
+static bool benchAtEngine(){
+  printf("AT engine\n");
+  return checkTranscripts() && checkStorage() && fuzzTranscripts(200000);
+}
+// End AT Engine
+
+/**
+* Run the named benchmark
+*
+* Returns:
+*   -false if there is no benchmark with that name
+*/
+bool simRunBenchmark(const char *name){
+  if(strcmp(name, "debounce") == 0){
+    if(!benchDebounce()) exit(1);
+    return true;
+  }
+  if(strcmp(name, "parser") == 0){
+    if(!benchParser()) exit(1);
+    return true;
+  }
+  if(strcmp(name, "templates") == 0){
+    if(!benchTemplates()) exit(1);
+    return true;
+  }
+  if(strcmp(name, "log") == 0){
+    if(!benchLog()) exit(1);
+    return true;
+  }
+  if(strcmp(name, "sound") == 0){
+    if(!benchSound()) exit(1);
+    return true;
+  }
+  if(strcmp(name, "uart") == 0){
+    if(!benchUart()) exit(1);
+    return true;
+  }
+  if(strcmp(name, "atengine") == 0){
+    if(!benchAtEngine()) exit(1);
+    return true;
+  }
+  if(strcmp(name, "inbox") == 0){
+    if(!benchInbox()) exit(1);
+    return true;
+  }
+  if(strcmp(name, "contactsync") == 0){
+    if(!benchContactSync()) exit(1);
+    return true;
+  }
+  if(strcmp(name, "lookup") == 0){
+    if(!benchLookup()) exit(1);
+    return true;
+  }
+  if(strcmp(name, "crc") == 0){
+    // A failed self-check fails the run
+    if(!benchCrc()) exit(1);
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,111 @@
+/*
+  Log Decoder
+
+  Turns the binary records sent by LOG() (see src/Log.h) back into text,
+  using the message table the firmware was built with. Bytes outside a
+  record, such as bootloader noise, are skipped until the next LOG_SYNC.
+  Used for the -v echo and by alarm-sim --decode-log on a capture from
+  the board.
+*/
+#include <Arduino.h>
+#include "Sim.h"
+#include "Log.h"
+
+#define LOG_FORMAT(id, level, format) format,
+#define LOG_LEVEL_OF(id, level, format) level,
+
+static const char *const logFormats[] = { LOG_MESSAGES(LOG_FORMAT) };
+static const uint8_t logLevels[] = { LOG_MESSAGES(LOG_LEVEL_OF) };
+static const char logLevelNames[] = "?EWID";
+
+unsigned long simLogSkippedBytes = 0;
+
+static uint8_t record[LOG_HEADER_SIZE + 255];
+static unsigned int recordUsed = 0;
+
+struct PayloadReader
+{
+  const uint8_t *data;
+  unsigned int length;
+  unsigned int position;
+};
+
+static bool readNumber(PayloadReader *reader, uint32_t *value){
+  uint32_t zigzag = 0;
+  for(uint8_t shift = 0; shift < 35; shift += 7){
+    if(reader->position == reader->length) return false;
+    uint8_t b = reader->data[reader->position++];
+    zigzag |= (uint32_t)(b & 0x7F) << shift;
+    if(!(b & 0x80)){
+      *value = (zigzag >> 1) ^ (0 - (zigzag & 1));
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+* Apply the format of a record to its payload
+*
+* Returns:
+*   -false if the payload does not match the format
+*/
+static bool formatRecord(uint8_t id, const uint8_t *payload, unsigned int length, char *line, size_t size){
+  PayloadReader reader = { payload, length, 0 };
+  size_t used = snprintf(line, size, "[%c] ", logLevelNames[logLevels[id]]);
+
+  for(const char *f = logFormats[id]; *f && used < size; f++){
+    if(*f != '%'){
+      line[used++] = *f;
+      continue;
+    }
+    f++;
+    uint32_t value;
+    if(*f == 's'){
+      if(reader.position == length) return false;
+      unsigned int textLength = payload[reader.position++];
+      if(reader.position + textLength > length) return false;
+      used += snprintf(line + used, size - used, "%.*s", textLength, (const char *)payload + reader.position);
+      reader.position += textLength;
+    }
+    else if(*f == 'd' || *f == 'u' || *f == 'x'){
+      if(!readNumber(&reader, &value)) return false;
+      const char *number = *f == 'd' ? "%ld" : *f == 'u' ? "%lu" : "%lx";
+      if(*f == 'd') used += snprintf(line + used, size - used, number, (long)(int32_t)value);
+      else used += snprintf(line + used, size - used, number, (unsigned long)value);
+    }
+    else{
+      line[used++] = *f;
+    }
+  }
+  if(used >= size) used = size - 1;
+  line[used] = '\0';
+  return reader.position == length;
+}
+
+/**
+* Feed one byte from the master's Serial
+* line: Receives the text of a record once it is complete
+*
+* Returns:
+*   -true when line holds a decoded record
+*/
+bool simLogDecodeByte(uint8_t c, char *line, size_t size){
+  if(recordUsed == 0 && c != LOG_SYNC){
+    simLogSkippedBytes++;
+    return false;
+  }
+
+  record[recordUsed++] = c;
+  if(recordUsed < LOG_HEADER_SIZE || recordUsed < LOG_HEADER_SIZE + (unsigned int)record[2]) return false;
+  recordUsed = 0;
+
+  uint8_t id = record[1];
+  if(id >= LOG_MESSAGE_COUNT){
+    snprintf(line, size, "[?] Unknown log message %u (%u bytes)", id, record[2]);
+  }
+  else if(!formatRecord(id, record + LOG_HEADER_SIZE, record[2], line, size)){
+    snprintf(line, size, "[?] Malformed log message %u (%u bytes)", id, record[2]);
+  }
+  return true;
+}
@@ -0,0 +1,467 @@
+/*
+  Modem (host stand-in)
+
+  SIM900 on the other end of USART1, in text mode. It answers the AT
+  commands the master sends with the latencies of the real shield. Echo is
+  on after power up, as on the SIM900.
+
+  The SMS messages of the scenario go to the SIM storage as soon as they
+  arrive, and are reported with +CMTI once AT+CNMI=2,1 asks for it, even
+  while a command is waiting on the network. AT+CMGR reads them and AT+CMGD
+  deletes them; a message deleted before it was read is counted as lost.
+  With AT+CNMI=2,2 they are sent as +CMT instead, between commands.
+
+  Each number it dials answers, rejects, is busy or just rings, as set by
+  the scenario (rings by default). Once AT+CLCC=1 is on, every change of the
+  call is reported with +CLCC: dialing with the OK of ATD, alerting when the
+  far end rings, active when answered and disconnected before the NO
+  CARRIER or BUSY that ends it.
+*/
+#include <Arduino.h>
+#include "Sim.h"
+
+#define MODEM_BOOT_MS       5000   // Power up to RDY
+#define MODEM_RESET_MS      3000   // AT+CFUN=1,1 to RDY
+#define MODEM_COMMAND_MS      20
+#define MODEM_SMS_MS        3500   // Network round trip of AT+CMGS
+#define MODEM_DIAL_MS        800
+#define MODEM_DELETE_MS     1500   // Every message of a kind
+#define MODEM_DELETE_ONE_MS  100
+#define MODEM_ALERT_MS      2000   // OK of ATD to the far end ringing
+
+#define INBOX_SIZE 8
+#define STORAGE_SIZE 20
+#define CALLEES_SIZE 8
+#define COMMAND_SIZE 64
+
+SimModemStats simModemStats;
+unsigned long simModemCallEndsMs = 25000;
+
+// Begin Inbox
+// Messages injected by the scenario, waiting to be sent as +CMT
+struct PendingSMS
+{
+  char sender[16];
+  char message[161];
+};
+static PendingSMS inbox[INBOX_SIZE];
+static byte inboxHead = 0;
+static byte inboxCount = 0;
+
+void simModemQueueSMS(const char *sender, const char *message){
+  if(inboxCount >= INBOX_SIZE) return;
+  PendingSMS *sms = &inbox[(inboxHead + inboxCount) % INBOX_SIZE];
+  strlcpy(sms->sender, sender, sizeof(sms->sender));
+  strlcpy(sms->message, message, sizeof(sms->message));
+  inboxCount++;
+  simModemStats.smsReceived++;
+}
+// End Inbox
+
+// Begin Storage
+// The SIM's message storage, index n at storage[n - 1]
+struct StoredSMS
+{
+  bool used;
+  bool unread;
+  PendingSMS sms;
+};
+static StoredSMS storage[STORAGE_SIZE];
+
+static unsigned int storageUsed(){
+  unsigned int used = 0;
+  for(byte i = 0; i < STORAGE_SIZE; i++) used += storage[i].used;
+  return used;
+}
+
+static void deleteStored(byte i){
+  if(!storage[i].used) return;
+  if(storage[i].unread) simModemStats.smsDeletedUnread++;
+  storage[i].used = false;
+}
+
+unsigned int simModemUnreadSMS(){
+  unsigned int unread = 0;
+  for(byte i = 0; i < STORAGE_SIZE; i++) unread += storage[i].used && storage[i].unread;
+  return unread + inboxCount;
+}
+// End Storage
+
+// Begin Callees
+// How the far end of each number takes a call
+struct Callee
+{
+  char digits[16];
+  byte behaviour;          // SIM_CALLEE_
+  unsigned long ms;        // From ringing to answer or reject, from dialing to busy
+};
+static Callee callees[CALLEES_SIZE];
+static byte calleeCount = 0;
+
+static void copyDigits(char *digits, size_t size, const char *number){
+  size_t length = 0;
+  for(; *number && length < size - 1; number++){
+    if(*number >= '0' && *number <= '9') digits[length++] = *number;
+  }
+  digits[length] = '\0';
+}
+
+void simModemSetCallee(const char *number, byte behaviour, unsigned long ms){
+  char digits[16];
+  copyDigits(digits, sizeof(digits), number);
+
+  byte i = 0;
+  while(i < calleeCount && strcmp(callees[i].digits, digits) != 0) i++;
+  if(i == CALLEES_SIZE) return;
+  if(i == calleeCount) calleeCount++;
+
+  strlcpy(callees[i].digits, digits, sizeof(callees[i].digits));
+  callees[i].behaviour = behaviour;
+  callees[i].ms = ms;
+}
+
+static const Callee *findCallee(const char *number){
+  static const Callee ringing = { "", SIM_CALLEE_RING, 0 };
+  char digits[16];
+  copyDigits(digits, sizeof(digits), number);
+
+  for(byte i = 0; i < calleeCount; i++){
+    if(strcmp(callees[i].digits, digits) == 0) return &callees[i];
+  }
+  return &ringing;
+}
+// End Callees
+
+// Begin Modem State
+static bool booted = false;
+static uint64_t bootAt = MODEM_BOOT_MS * 1000ULL;
+static bool echo = true;
+static byte newMessages = 0;       // <mt> of AT+CNMI: 0 kept quiet, 1 reported with +CMTI, 2 sent as +CMT
+static bool textEntry = false;     // After the AT+CMGS prompt, until Ctrl-Z
+static char command[COMMAND_SIZE];
+static byte commandLength = 0;
+
+// Answer to the last command, sent once its latency has passed
+static bool responding = false;
+static bool rebootAfterResponse = false;
+static uint64_t respondAt = 0;
+static char response[256];
+
+static bool callReports = false;   // AT+CLCC=1
+static bool inCall = false;
+static uint64_t callStartedAt = 0;
+static uint64_t callEndsAt = 0;
+static char callNumber[20];
+static const Callee *callee = NULL;
+static byte callPhase = 0;         // CALL_
+static uint64_t callEventAt = 0;   // Next change of the call
+static bool refused = false;       // The last call was ended by the far end or the network
+static uint64_t refusedAt = 0;
+static unsigned int messageReference = 0;
+// End Modem State
+
+static void respond(unsigned long ms, const char *text){
+  simModemStats.busyMicros += ms * 1000ULL;
+  responding = true;
+  respondAt = simNowMicros() + ms * 1000ULL;
+  strlcpy(response, text, sizeof(response));
+}
+
+// Call phases
+#define CALL_DIALING 0
+#define CALL_ALERTING 1
+#define CALL_ACTIVE 2
+
+/**
+* The +CLCC report of the call with the given <stat>, or nothing if reports are off
+*/
+static void callReport(char *text, size_t size, int stat){
+  if(callReports) snprintf(text, size, "\r\n+CLCC: 1,0,%d,0,0,\"%s\",145\r\n", stat, callNumber);
+  else text[0] = '\0';
+}
+
+static void endCall(uint64_t at){
+  simModemStats.callMicros += at - callStartedAt;
+  inCall = false;
+}
+
+/**
+* The far end or the network ends the call
+* result: NO CARRIER or BUSY
+*/
+static void dropCall(uint64_t at, const char *result){
+  char report[64];
+  callReport(report, sizeof(report), 6);
+  simUsart1Send(report);
+  simUsart1Send(result);
+  endCall(at);
+  refused = true;
+  refusedAt = at;
+  simModemStats.callsRefused++;
+}
+
+static void dial(const char *number){
+  simModemStats.calls++;
+  if(refused){
+    refused = false;
+    uint64_t gap = simNowMicros() - refusedAt;
+    if(gap > simModemStats.maxRefusedToDialMicros) simModemStats.maxRefusedToDialMicros = gap;
+  }
+
+  size_t length = strcspn(number, ";");
+  if(length >= sizeof(callNumber)) length = sizeof(callNumber) - 1;
+  memcpy(callNumber, number, length);
+  callNumber[length] = '\0';
+  callee = findCallee(callNumber);
+
+  char text[96];
+  char report[64];
+  callReport(report, sizeof(report), 2);
+  snprintf(text, sizeof(text), "\r\nOK\r\n%s", report);
+  respond(MODEM_DIAL_MS, text);
+
+  inCall = true;
+  callStartedAt = respondAt;
+  callEndsAt = callStartedAt + simModemCallEndsMs * 1000ULL;
+  callPhase = CALL_DIALING;
+  callEventAt = respondAt + (callee->behaviour == SIM_CALLEE_BUSY ? callee->ms : MODEM_ALERT_MS) * 1000ULL;
+}
+
+/**
+* The call moves on at callEventAt: rings, gets busy, answered or rejected
+*/
+static void advanceCall(uint64_t at){
+  char report[64];
+
+  if(callPhase == CALL_DIALING){
+    if(callee->behaviour == SIM_CALLEE_BUSY){
+      dropCall(at, "\r\nBUSY\r\n");
+      return;
+    }
+    callReport(report, sizeof(report), 3);
+    simUsart1Send(report);
+    callPhase = CALL_ALERTING;
+    callEventAt = callee->behaviour == SIM_CALLEE_RING ? UINT64_MAX : at + callee->ms * 1000ULL;
+  }
+  else if(callee->behaviour == SIM_CALLEE_REJECT){
+    dropCall(at, "\r\nNO CARRIER\r\n");
+  }
+  else{
+    callReport(report, sizeof(report), 0);
+    simUsart1Send(report);
+    callPhase = CALL_ACTIVE;
+    callEventAt = UINT64_MAX;
+    simModemStats.callsAnswered++;
+  }
+}
+
+static bool startsWith(const char *text, const char *prefix){
+  return strncasecmp(text, prefix, strlen(prefix)) == 0;
+}
+
+static void handleCommand(){
+  command[commandLength] = '\0';
+  commandLength = 0;
+  if(!startsWith(command, "AT")) return;
+  simModemStats.transactions++;
+  const char *body = command + 2;
+
+  if(*body == '\0' || startsWith(body, "+CMGF=") || startsWith(body, "+CREG=")){
+    respond(MODEM_COMMAND_MS, "\r\nOK\r\n");
+  }
+  else if(startsWith(body, "+CLCC=")){
+    callReports = body[6] == '1';
+    respond(MODEM_COMMAND_MS, "\r\nOK\r\n");
+  }
+  else if(startsWith(body, "E0") || startsWith(body, "E1")){
+    echo = body[1] == '1';
+    respond(MODEM_COMMAND_MS, "\r\nOK\r\n");
+  }
+  else if(startsWith(body, "+CNMI=")){
+    // +CNMI=<mode>,<mt>,...
+    newMessages = body[8] - '0';
+    respond(MODEM_COMMAND_MS, "\r\nOK\r\n");
+  }
+  else if(startsWith(body, "+CPMS?")){
+    char text[96];
+    unsigned int used = storageUsed();
+    snprintf(text, sizeof(text), "\r\n+CPMS: \"SM\",%u,%u,\"SM\",%u,%u,\"SM\",%u,%u\r\n\r\nOK\r\n",
+             used, STORAGE_SIZE, used, STORAGE_SIZE, used, STORAGE_SIZE);
+    respond(MODEM_COMMAND_MS, text);
+  }
+  else if(startsWith(body, "+CMGR=")){
+    unsigned int index = atoi(body + 6);
+    if(index < 1 || index > STORAGE_SIZE || !storage[index - 1].used){
+      respond(MODEM_COMMAND_MS, "\r\n+CMS ERROR: 321\r\n");
+    }
+    else{
+      StoredSMS *stored = &storage[index - 1];
+      char text[256];
+      snprintf(text, sizeof(text), "\r\n+CMGR: \"%s\",\"%s\",\"\",\"14/07/15,12:00:00+00\"\r\n%s\r\n\r\nOK\r\n",
+               stored->unread ? "REC UNREAD" : "REC READ", stored->sms.sender, stored->sms.message);
+      if(stored->unread) simModemStats.smsRead++;
+      stored->unread = false;
+      respond(MODEM_COMMAND_MS, text);
+    }
+  }
+  else if(startsWith(body, "+CREG?")){
+    respond(MODEM_COMMAND_MS, "\r\n+CREG: 1,1\r\n\r\nOK\r\n");
+  }
+  else if(startsWith(body, "+CMGD=")){
+    // +CMGD=<index>[,<flag>]: flag 1 read, 3 all but unread, 4 all
+    simModemStats.deletes++;
+    const char *flag = strchr(body, ',');
+    if(flag == NULL){
+      unsigned int index = atoi(body + 6);
+      if(index >= 1 && index <= STORAGE_SIZE) deleteStored(index - 1);
+      respond(MODEM_DELETE_ONE_MS, "\r\nOK\r\n");
+    }
+    else{
+      int kind = atoi(flag + 1);
+      for(byte i = 0; i < STORAGE_SIZE; i++){
+        if(kind == 4 || !storage[i].unread) deleteStored(i);
+      }
+      respond(MODEM_DELETE_MS, "\r\nOK\r\n");
+    }
+  }
+  else if(startsWith(body, "+CMGS=")){
+    textEntry = true;
+    respond(MODEM_COMMAND_MS, "\r\n> ");
+  }
+  else if(startsWith(body, "D")){
+    dial(body + 1);
+  }
+  else if(startsWith(body, "H")){
+    char text[96];
+    char report[64] = "";
+    if(inCall){
+      callReport(report, sizeof(report), 6);
+      endCall(simNowMicros());
+    }
+    snprintf(text, sizeof(text), "%s\r\nOK\r\n", report);
+    respond(MODEM_COMMAND_MS, text);
+  }
+  else if(startsWith(body, "+CFUN=1,1")){
+    respond(MODEM_COMMAND_MS, "\r\nOK\r\n");
+    rebootAfterResponse = true;
+  }
+  else{
+    respond(MODEM_COMMAND_MS, "\r\nERROR\r\n");
+  }
+}
+
+/**
+* A byte from the master, at the end of its frame on USART1
+*/
+void simModemReceive(uint8_t c){
+  // Not listening while booting
+  if(!booted) return;
+
+  if(textEntry){
+    if(c == 0x1A){
+      textEntry = false;
+      simModemStats.smsSent++;
+      char text[32];
+      snprintf(text, sizeof(text), "\r\n+CMGS: %u\r\n\r\nOK\r\n", ++messageReference % 256);
+      respond(MODEM_SMS_MS, text);
+    }
+    else if(c == 0x1B){
+      textEntry = false;
+    }
+    else if(echo){
+      char text[2] = { (char)c, '\0' };
+      simUsart1Send(text);
+    }
+    return;
+  }
+
+  if(echo){
+    char text[2] = { (char)c, '\0' };
+    simUsart1Send(text);
+  }
+  if(c == '\r'){
+    handleCommand();
+  }
+  else if(c != '\n' && commandLength < COMMAND_SIZE - 1){
+    command[commandLength++] = c;
+  }
+}
+
+/**
+* Act on what is due by now: boot, answers, the network ending a call and
+* incoming messages
+*/
+void simModemRun(){
+  uint64_t now = simNowMicros();
+
+  if(!booted && now >= bootAt){
+    booted = true;
+    echo = true;
+    newMessages = 0;
+    callReports = false;
+    textEntry = false;
+    commandLength = 0;
+    simUsart1Send("\r\nRDY\r\n\r\n+CFUN: 1\r\n\r\n+CPIN: READY\r\n\r\nCall Ready\r\n");
+  }
+
+  if(responding && now >= respondAt){
+    responding = false;
+    simUsart1Send(response);
+    if(rebootAfterResponse){
+      rebootAfterResponse = false;
+      if(inCall) endCall(now);
+      booted = false;
+      bootAt = now + MODEM_RESET_MS * 1000ULL;
+    }
+  }
+
+  if(inCall && now >= callEventAt) advanceCall(callEventAt);
+
+  // The network gives up on a call nobody answers
+  if(inCall && callPhase != CALL_ACTIVE && now >= callEndsAt){
+    dropCall(callEndsAt, "\r\nNO CARRIER\r\n");
+  }
+
+  // New messages go to storage unless they are to be sent as +CMT
+  while(booted && newMessages != 2 && !textEntry && inboxCount > 0){
+    byte i = 0;
+    while(i < STORAGE_SIZE && storage[i].used) i++;
+    if(i == STORAGE_SIZE) break;   // The network tries again later
+
+    storage[i].used = true;
+    storage[i].unread = true;
+    storage[i].sms = inbox[inboxHead];
+    inboxHead = (inboxHead + 1) % INBOX_SIZE;
+    inboxCount--;
+
+    unsigned int used = storageUsed();
+    if(used > simModemStats.storagePeak) simModemStats.storagePeak = used;
+    if(newMessages == 1){
+      char report[32];
+      snprintf(report, sizeof(report), "\r\n+CMTI: \"SM\",%u\r\n", i + 1);
+      simUsart1Send(report);
+    }
+  }
+
+  // Unsolicited results wait for the answer to a command
+  if(booted && newMessages == 2 && !responding && !textEntry && inboxCount > 0){
+    PendingSMS *sms = &inbox[inboxHead];
+    inboxHead = (inboxHead + 1) % INBOX_SIZE;
+    inboxCount--;
+
+    char header[64];
+    snprintf(header, sizeof(header), "\r\n+CMT: \"%s\",\"\",\"14/07/15,12:00:00+00\"\r\n", sms->sender);
+    simUsart1Send(header);
+    simUsart1Send(sms->message);
+    simUsart1Send("\r\n");
+  }
+}
+
+uint64_t simModemNextMicros(){
+  uint64_t next = UINT64_MAX;
+  if(!booted) next = bootAt;
+  if(responding && respondAt < next) next = respondAt;
+  if(inCall && callEventAt < next) next = callEventAt;
+  if(inCall && callPhase != CALL_ACTIVE && callEndsAt < next) next = callEndsAt;
+  return next;
+}
@@ -0,0 +1,191 @@
+/*
+  Scenario
+
+  Timed events replayed against the simulated hardware. A scenario file has
+  one event per line:
+
+    <time> <command> [arguments]
+
+  Times are in milliseconds unless suffixed with s, m or h. Commands:
+    input <pin> <0|1>       Drive an input pin (0 = alarm, inputs are pulled up)
+    sms <sender> <text>     Deliver an SMS message to the modem
+    disable <hours>         Set the alarm disabled hours on the slave
+    contacts-changed        Flag the contacts file as changed on the slave
+    contact <n> <line>      Replace line n of the contacts file (and flag it)
+    i2c-fail <code>         Make the slave stop acknowledging (0 restores it)
+    slave-protocol <1|2>    Contacts transfer protocol spoken by the slave
+    i2c-corrupt <count>     Corrupt the next count contacts chunks
+    call-ends <ms>          Time after dialing until the network ends a call
+    callee <number> <answer|reject|busy|ring> [ms]
+                            How the number takes calls: answer or reject ms
+                            after it starts ringing, busy ms after dialing
+    serial <text>           Send text to the master's Serial (p dumps the profiler)
+    end                     Stop the simulation
+  Lines starting with # are ignored.
+*/
+#include <Arduino.h>
+#include <vector>
+#include <algorithm>
+#include "Sim.h"
+
+struct Event
+{
+  uint64_t at;
+  char command[20];
+  char args[168];
+};
+
+static std::vector<Event> events;
+static size_t nextEvent = 0;
+uint64_t simScenarioEndMicros = UINT64_MAX;
+
+static bool eventBefore(const Event &a, const Event &b){
+  return a.at < b.at;
+}
+
+/**
+* Parse a time such as 1500, 90s, 15m or 2h into microseconds
+*/
+static bool parseTime(const char *text, uint64_t *micros){
+  char *end;
+  double value = strtod(text, &end);
+  if(end == text) return false;
+
+  double scale = 1;
+  if(*end == 's') scale = 1000;
+  else if(*end == 'm') scale = 60000;
+  else if(*end == 'h') scale = 3600000;
+  *micros = (uint64_t)(value * scale * 1000);
+  return true;
+}
+
+static bool addEvent(const char *line){
+  char timeText[24];
+  Event event;
+  int consumed = 0;
+
+  if(sscanf(line, "%23s %19s %n", timeText, event.command, &consumed) < 2) return false;
+  if(!parseTime(timeText, &event.at)) return false;
+  strlcpy(event.args, line + consumed, sizeof(event.args));
+
+  // Trim the line ending
+  size_t len = strlen(event.args);
+  while(len > 0 && (event.args[len - 1] == '\n' || event.args[len - 1] == '\r')) event.args[--len] = '\0';
+
+  if(strcmp(event.command, "end") == 0 && event.at < simScenarioEndMicros){
+    simScenarioEndMicros = event.at;
+  }
+  events.push_back(event);
+  return true;
+}
+
+bool simLoadScenario(const char *path){
+  FILE *file = fopen(path, "r");
+  if(!file) return false;
+
+  char line[256];
+  int lineNumber = 0;
+  while(fgets(line, sizeof(line), file)){
+    lineNumber++;
+    const char *start = line + strspn(line, " \t");
+    if(*start == '#' || *start == '\n' || *start == '\0') continue;
+    if(!addEvent(start)){
+      fprintf(stderr, "%s:%d: cannot parse event\n", path, lineNumber);
+      fclose(file);
+      return false;
+    }
+  }
+  fclose(file);
+
+  std::stable_sort(events.begin(), events.end(), eventBefore);
+  return true;
+}
+
+/**
+* One alarm on "Shandon TP" that is acknowledged and cleared, followed by a
+* short "Lab Power" dropout
+*/
+void simLoadDefaultScenario(){
+  static const char *lines[] = {
+    "1h input 49 0",
+    "62m sms +16479806182 BIRLOFF",
+    "2h input 49 1",
+    "3h input 53 0",
+    "3h input 51 0",
+    "181m input 53 1",
+    "182m input 51 1",
+    "4h end",
+  };
+  for(size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++){
+    addEvent(lines[i]);
+  }
+  std::stable_sort(events.begin(), events.end(), eventBefore);
+}
+
+uint64_t simNextEventMicros(){
+  return nextEvent < events.size() ? events[nextEvent].at : UINT64_MAX;
+}
+
+static void applyEvent(const Event &event){
+  const char *command = event.command;
+
+  if(strcmp(command, "input") == 0){
+    int pin, level;
+    if(sscanf(event.args, "%d %d", &pin, &level) == 2) simSetPin(pin, level);
+  }
+  else if(strcmp(command, "sms") == 0){
+    char sender[16];
+    int consumed = 0;
+    if(sscanf(event.args, "%15s %n", sender, &consumed) == 1){
+      simModemQueueSMS(sender, event.args + consumed);
+    }
+  }
+  else if(strcmp(command, "disable") == 0){
+    simSlaveSetDisabledHours(atoi(event.args));
+  }
+  else if(strcmp(command, "contacts-changed") == 0){
+    simSlaveMarkContactsChanged();
+  }
+  else if(strcmp(command, "contact") == 0){
+    int index, consumed = 0;
+    if(sscanf(event.args, "%d %n", &index, &consumed) == 1){
+      simSlaveSetContact(index, event.args + consumed);
+    }
+  }
+  else if(strcmp(command, "i2c-fail") == 0){
+    simSlaveSetFailure(atoi(event.args));
+  }
+  else if(strcmp(command, "slave-protocol") == 0){
+    simSlaveSetProtocol(atoi(event.args));
+  }
+  else if(strcmp(command, "i2c-corrupt") == 0){
+    simSlaveCorruptChunks(atoi(event.args));
+  }
+  else if(strcmp(command, "call-ends") == 0){
+    simModemCallEndsMs = strtoul(event.args, NULL, 10);
+  }
+  else if(strcmp(command, "callee") == 0){
+    static const char *behaviours[] = { "ring", "answer", "reject", "busy" };
+    char number[20], behaviour[8];
+    unsigned long ms = 0;
+    if(sscanf(event.args, "%19s %7s %lu", number, behaviour, &ms) >= 2){
+      for(byte i = 0; i < sizeof(behaviours) / sizeof(behaviours[0]); i++){
+        if(strcmp(behaviour, behaviours[i]) == 0) simModemSetCallee(number, i, ms);
+      }
+    }
+  }
+  else if(strcmp(command, "serial") == 0){
+    simSerialReceive(event.args);
+  }
+}
+
+void simApplyDueEvents(){
+  // Events can fall due inside a firmware call: what they allocate is the simulator's
+  bool tracking = simTrackHeap;
+  simTrackHeap = false;
+  while(nextEvent < events.size() && events[nextEvent].at <= simNowMicros()){
+    applyEvent(events[nextEvent]);
+    nextEvent++;
+  }
+  simTrackHeap = tracking;
+}
@@ -0,0 +1,132 @@
+/*
+  Simulator
+
+  Host-side model of the hardware around the MegaMaster: a virtual clock,
+  the input pins, the Ethernet slave on the I2C bus and the GSM modem on
+  USART1.
+  Scenario events are applied as the virtual clock passes their timestamp.
+*/
+#ifndef SIM_H
+#define SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Begin Clock
+extern uint64_t simNowMicros(void);
+extern void simAdvanceMicros(uint64_t us);
+
+struct SimTimerStats
+{
+  unsigned long interrupts;
+  unsigned long toggles;   // Interrupts that toggled an output
+  uint64_t toggleCycles;   // The time up to each of them
+};
+extern const SimTimerStats *simGetTimer2Stats(void);
+// End Clock
+
+// Begin Pins
+#define SIM_NUM_PINS 70
+extern uint8_t simPinLevel[SIM_NUM_PINS];
+extern void simSetPin(uint8_t pin, uint8_t level);
+// End Pins
+
+// Begin Serial
+extern unsigned long simSerialBaud;
+extern void (*simSerialTap)(uint8_t);   // Sees every byte the master writes to Serial
+extern void simSerialReceive(const char *text);
+// End Serial
+
+// Begin Log Decoder
+extern bool simLogDecodeByte(uint8_t c, char *line, size_t size);
+extern unsigned long simLogSkippedBytes;
+// End Log Decoder
+
+// Begin Scenario
+extern bool simLoadScenario(const char *path);
+extern void simLoadDefaultScenario(void);
+extern void simApplyDueEvents(void);
+extern uint64_t simNextEventMicros(void);
+extern uint64_t simScenarioEndMicros;
+// End Scenario
+
+// Begin Slave
+extern void simSlaveSetContacts(const char *csv);
+extern void simSlaveSetContact(uint8_t index, const char *line);
+extern void simSlaveMarkContactsChanged(void);
+extern void simSlaveSetDisabledHours(uint8_t hours);
+extern void simSlaveSetFailure(uint8_t code);
+extern void simSlaveSetProtocol(uint8_t version);
+extern void simSlaveCorruptChunks(unsigned int count);
+// End Slave
+
+// Begin Modem
+struct SimModemStats
+{
+  unsigned long smsSent;
+  unsigned long calls;
+  unsigned long deletes;
+  unsigned long transactions;
+  unsigned long smsReceived;         // From the scenario
+  unsigned long smsRead;             // Unread messages read with AT+CMGR
+  unsigned long smsDeletedUnread;    // Lost
+  unsigned int storagePeak;
+  uint64_t busyMicros;
+  uint64_t callMicros;
+  unsigned long callsAnswered;
+  unsigned long callsRefused;        // Ended by the far end or the network
+  uint64_t maxRefusedToDialMicros;   // From a call ending that way to the next ATD
+};
+
+// How the far end takes a call, for simModemSetCallee()
+#define SIM_CALLEE_RING 0            // Until the network gives up (call-ends)
+#define SIM_CALLEE_ANSWER 1
+#define SIM_CALLEE_REJECT 2
+#define SIM_CALLEE_BUSY 3
+
+extern unsigned long simModemCallEndsMs;
+extern SimModemStats simModemStats;
+extern void simModemQueueSMS(const char *sender, const char *message);
+extern void simModemSetCallee(const char *number, byte behaviour, unsigned long ms);
+extern unsigned int simModemUnreadSMS(void);
+extern void simModemReceive(uint8_t c);
+extern void simModemRun(void);
+extern uint64_t simModemNextMicros(void);
+// End Modem
+
+// Begin USART1
+struct SimUsartStats
+{
+  unsigned long toMaster;       // Bytes that reached the master's receiver
+  unsigned long unheard;        // Sent while the receiver was off
+  unsigned long toModem;
+  unsigned long dataOverruns;   // Arrived while UDR1 still held an unread byte
+};
+extern SimUsartStats simUsart1Stats;
+extern void simUsart1Send(const char *text);
+extern void simUsartRun(void);
+extern uint64_t simUsartNextMicros(void);
+// End USART1
+
+// Begin Benchmarks
+extern bool simRunBenchmark(const char *name);
+// End Benchmarks
+
+// Begin Heap
+struct SimHeapStats
+{
+  unsigned long blocks;     // Live blocks allocated by the firmware
+  unsigned long bytes;      // Their AVR cost, malloc headers included
+  unsigned long peakBytes;
+};
+extern bool simTrackHeap;
+extern SimHeapStats simHeapStats;
+// End Heap
+
+// Begin Watchdog
+extern unsigned long simWatchdogExpiries;
+extern unsigned long simHardwareResets;
+extern void simCheckWatchdog(void);
+// End Watchdog
+
+#endif
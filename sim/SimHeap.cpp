@@ -0,0 +1,63 @@
+/*
+  Heap accounting (host stand-in)
+
+  Counts the heap blocks the firmware allocates with new while setup() and
+  loop() run, and what they would cost on the AVR, where avr-libc's malloc
+  adds a 2 byte header to every block. Allocations made by the simulator
+  itself are not counted.
+*/
+#include <Arduino.h>
+#include <new>
+#include <stdlib.h>
+#include "Sim.h"
+
+// avr-libc keeps the block size in front of each allocation
+#define AVR_MALLOC_HEADER 2
+
+// Room kept in front of every host block to remember whether it was counted
+#define HEAP_PREFIX 16
+
+bool simTrackHeap = false;
+SimHeapStats simHeapStats = {0, 0, 0};
+
+static void *allocate(size_t size){
+  uint8_t *block = (uint8_t *)malloc(size + HEAP_PREFIX);
+  if(!block) throw std::bad_alloc();
+
+  size_t counted = simTrackHeap ? size : 0;
+  memcpy(block, &counted, sizeof(counted));
+  if(simTrackHeap){
+    simHeapStats.blocks++;
+    simHeapStats.bytes += size + AVR_MALLOC_HEADER;
+    if(simHeapStats.bytes > simHeapStats.peakBytes) simHeapStats.peakBytes = simHeapStats.bytes;
+  }
+  return block + HEAP_PREFIX;
+}
+
+static void release(void *pointer){
+  if(!pointer) return;
+  uint8_t *block = (uint8_t *)pointer - HEAP_PREFIX;
+
+  size_t counted;
+  memcpy(&counted, block, sizeof(counted));
+  if(counted > 0){
+    simHeapStats.blocks--;
+    simHeapStats.bytes -= counted + AVR_MALLOC_HEADER;
+  }
+  free(block);
+}
+
+void *operator new(size_t size){ return allocate(size); }
+void *operator new[](size_t size){ return allocate(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  try { return allocate(size); } catch(const std::bad_alloc &) { return NULL; }
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  try { return allocate(size); } catch(const std::bad_alloc &) { return NULL; }
+}
+void operator delete(void *pointer) noexcept { release(pointer); }
+void operator delete[](void *pointer) noexcept { release(pointer); }
+void operator delete(void *pointer, size_t) noexcept { release(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { release(pointer); }
+void operator delete(void *pointer, const std::nothrow_t &) noexcept { release(pointer); }
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept { release(pointer); }
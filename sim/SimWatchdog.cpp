@@ -0,0 +1,34 @@
+/*
+  Watchdog Functions (host stand-in)
+
+  Replaces the Timer1 based watchdog in WatchdogFunctions.cpp. Instead of
+  pulling the reset line, an expiry is counted so a scenario can report
+  every place the main loop would have been reset.
+*/
+#include <Arduino.h>
+#include "MegaMaster.h"
+#include "WatchdogFunctions.h"
+#include "Sim.h"
+
+unsigned long simWatchdogExpiries = 0;
+unsigned long simHardwareResets = 0;
+static unsigned long lastFeed = 0;
+
+void SetupWatchdog(){
+  lastFeed = millis();
+}
+
+void HardwareReset(){
+  simHardwareResets++;
+}
+
+void ResetWatchdog(){
+  lastFeed = millis();
+}
+
+void simCheckWatchdog(){
+  if((unsigned long)(millis() - lastFeed) >= WATCHDOG_TIMEOUT_SECONDS * 1000UL){
+    simWatchdogExpiries++;
+    lastFeed = millis();
+  }
+}
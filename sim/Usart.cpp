@@ -0,0 +1,173 @@
+/*
+  USART1 (host stand-in)
+
+  The serial line between the master and the modem, at the baud rate set in
+  UBRR1. Bytes from the modem arrive back to back, one frame (10 bits) apart,
+  and raise the RX interrupt. A byte that arrives while the previous one is
+  still unread in UDR1 is lost and DOR is set, as on the AVR (without its
+  second receive buffer level). Bytes the master writes to UDR1 go through
+  the shift register, raising the data register empty interrupt, and reach
+  the modem model when their frame is complete.
+*/
+#include <Arduino.h>
+#include "Sim.h"
+
+#define CYCLES_PER_MICRO (F_CPU / 1000000UL)
+
+SimDataRegister UDR1;
+SimStatusRegister UCSR1A;
+static uint8_t status = _BV(UDRE0);   // UCSR1A
+volatile uint8_t UCSR1B = 0;
+volatile uint8_t UCSR1C = 0;
+volatile uint16_t UBRR1 = 0;
+
+// Defined by the firmware's modem driver
+extern "C" void USART1_RX_vect(void) __attribute__((weak));
+extern "C" void USART1_UDRE_vect(void) __attribute__((weak));
+
+SimUsartStats simUsart1Stats;
+
+// Begin Line From Modem
+#define WIRE_SIZE 4096
+static uint8_t wire[WIRE_SIZE];
+static unsigned int wireHead = 0, wireTail = 0;
+static bool rxInFlight = false;
+static uint64_t rxDoneCycles = 0;
+static uint8_t rxData = 0;         // The byte in UDR1
+// End Line From Modem
+
+// Begin Line To Modem
+static bool txInFlight = false;
+static uint64_t txDoneCycles = 0;
+static uint8_t txShifter = 0;
+static uint8_t txData = 0;         // Written to UDR1 while the shifter was busy
+// End Line To Modem
+
+static uint64_t nowCycles(){
+  return simNowMicros() * CYCLES_PER_MICRO;
+}
+
+static uint64_t frameCycles(){
+  return 10ULL * (UBRR1 + 1) * (status & _BV(U2X0) ? 8 : 16);
+}
+
+SimStatusRegister::operator uint8_t(){
+  return status;
+}
+
+SimStatusRegister &SimStatusRegister::operator=(uint8_t value){
+  status = (status & ~_BV(U2X0)) | (value & _BV(U2X0));
+  return *this;
+}
+
+SimDataRegister::operator uint8_t(){
+  status &= ~(_BV(RXC0) | _BV(DOR0) | _BV(FE0));
+  return rxData;
+}
+
+SimDataRegister &SimDataRegister::operator=(uint8_t c){
+  if(!(UCSR1B & _BV(TXEN0))) return *this;
+
+  if(!txInFlight){
+    txShifter = c;
+    txInFlight = true;
+    txDoneCycles = nowCycles() + frameCycles();
+  }
+  else{
+    txData = c;
+    status &= ~_BV(UDRE0);
+  }
+  return *this;
+}
+
+/**
+* Put bytes on the line from the modem. They are heard only while the
+* master's receiver is on.
+*/
+void simUsart1Send(const char *text){
+  for(; *text; text++){
+    unsigned int next = (wireHead + 1) % WIRE_SIZE;
+    if(next == wireTail){
+      fprintf(stderr, "Modem output backed up on the line\n");
+      exit(1);
+    }
+    wire[wireHead] = *text;
+    wireHead = next;
+  }
+}
+
+static void receiveFrame(){
+  uint8_t c = wire[wireTail];
+  wireTail = (wireTail + 1) % WIRE_SIZE;
+
+  if(!(UCSR1B & _BV(RXEN0))){
+    simUsart1Stats.unheard++;
+    return;
+  }
+  simUsart1Stats.toMaster++;
+
+  if(status & _BV(RXC0)){
+    status |= _BV(DOR0);
+    simUsart1Stats.dataOverruns++;
+  }
+  else{
+    rxData = c;
+    status |= _BV(RXC0);
+  }
+  if((UCSR1B & _BV(RXCIE0)) && USART1_RX_vect) USART1_RX_vect();
+}
+
+static void transmitFrame(){
+  simUsart1Stats.toModem++;
+  simModemReceive(txShifter);
+
+  if(status & _BV(UDRE0)){
+    txInFlight = false;
+    return;
+  }
+  // The next byte was waiting in UDR1: send it back to back
+  txShifter = txData;
+  txDoneCycles += frameCycles();
+  status |= _BV(UDRE0);
+}
+
+/**
+* Complete the frames due by now and run the interrupts that are pending
+*/
+void simUsartRun(){
+  uint64_t now = nowCycles();
+
+  while(true){
+    // Data register empty is a level: it fires until the firmware disables it
+    while((UCSR1B & _BV(UDRIE0)) && (status & _BV(UDRE0)) && (UCSR1B & _BV(TXEN0)) && USART1_UDRE_vect){
+      USART1_UDRE_vect();
+    }
+
+    if(!rxInFlight && wireTail != wireHead){
+      rxInFlight = true;
+      rxDoneCycles = now + frameCycles();
+    }
+
+    if(rxInFlight && rxDoneCycles <= now){
+      receiveFrame();
+      rxInFlight = wireTail != wireHead;
+      rxDoneCycles += frameCycles();
+    }
+    else if(txInFlight && txDoneCycles <= now){
+      transmitFrame();
+    }
+    else{
+      break;
+    }
+  }
+}
+
+uint64_t simUsartNextMicros(){
+  uint64_t next = UINT64_MAX;
+  if(rxInFlight) next = (rxDoneCycles + CYCLES_PER_MICRO - 1) / CYCLES_PER_MICRO;
+  if(txInFlight){
+    uint64_t tx = (txDoneCycles + CYCLES_PER_MICRO - 1) / CYCLES_PER_MICRO;
+    if(tx < next) next = tx;
+  }
+  return next;
+}
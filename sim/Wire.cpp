@@ -0,0 +1,321 @@
+/*
+  Wire (host stand-in)
+
+  I2C bus and a model of the Ethernet slave. The slave serves the contacts
+  file, its checksum, the disabled hours and the saved alarm state using the
+  request ids shared with the master in MegaMaster.h. It speaks the block
+  transfer protocol (v2) unless set back to the original one, and can be
+  told to corrupt chunks.
+*/
+#include <Arduino.h>
+#include <Wire.h>
+#include <string>
+#include "MegaMaster.h"
+#include "CRC32.h"
+#include "Sim.h"
+
+#define SLAVE_ADDRESS 2
+
+// 9 clocks per byte at 100 kHz
+#define I2C_BYTE_MICROS 90
+
+TwoWire Wire;
+
+// Begin Slave
+static char slaveContacts[CONTACTS_MAX_NUMBER * 64 + 1] =
+  "1,Mayan,mayan@example.com,16479806182\n"
+  "1,Aaron,aaron@example.com,14165550101\n"
+  "2,Lab,lab@example.com,14165550102\n"
+  "12,Priya,priya@example.com,4165550103\n";
+static uint8_t slaveContactsChanged = 0;
+static uint8_t slaveDisabledHours = 0;
+static uint8_t slaveFailureCode = 0;
+static uint8_t slaveRequestId = 0;
+static unsigned int slaveReadOffset = 0;
+static uint8_t slaveProtocol = CONTACTS_PROTOCOL_VERSION;
+static uint8_t slaveChunk = 0;
+static uint8_t slaveRecord = 0;
+static uint8_t slaveFirstHash = 0;
+static unsigned int slaveCorruptChunks = 0;
+static unsigned long slaveFileReadyAt = 0;
+
+// Time the slave takes to open the contacts file on the SD card
+#define SLAVE_FILE_OPEN_MS 20
+
+void simSlaveSetContacts(const char *csv){
+  strlcpy(slaveContacts, csv, sizeof(slaveContacts));
+  slaveContactsChanged = 1;
+}
+
+void simSlaveMarkContactsChanged(){
+  slaveContactsChanged = 1;
+}
+
+void simSlaveSetDisabledHours(uint8_t hours){
+  slaveDisabledHours = hours;
+}
+
+void simSlaveSetFailure(uint8_t code){
+  slaveFailureCode = code;
+}
+
+/**
+* Replace one line of the contacts file, or append it after the last one
+*/
+void simSlaveSetContact(uint8_t index, const char *line){
+  std::string updated;
+  const char *c = slaveContacts;
+
+  for(uint8_t i = 0; *c || i <= index; i++){
+    const char *end = strchr(c, '\n');
+    size_t length = end ? (size_t)(end - c + 1) : strlen(c);
+    if(i == index){
+      updated.append(line).append("\n");
+    }
+    else{
+      updated.append(c, length);
+    }
+    c += length;
+  }
+  strlcpy(slaveContacts, updated.c_str(), sizeof(slaveContacts));
+  slaveContactsChanged = 1;
+}
+
+void simSlaveSetProtocol(uint8_t version){
+  slaveProtocol = version;
+}
+
+void simSlaveCorruptChunks(unsigned int count){
+  slaveCorruptChunks = count;
+}
+
+static uint32_t slaveContactsCheckSum(){
+  return ~crc_update_block(0xFFFFFFFF, (const uint8_t *)slaveContacts, strlen(slaveContacts));
+}
+
+static void slaveReceive(const uint8_t *data, uint8_t length){
+  if(length < 2 || data[0] != COMM_TYPE_REQUEST) return;
+
+  slaveRequestId = data[1];
+  if(slaveRequestId == REQUEST_ID_CONTACTS){
+    slaveReadOffset = 0;
+  }
+  else if(slaveRequestId == REQUEST_ID_CONTACTS_INFO){
+    slaveFileReadyAt = millis() + SLAVE_FILE_OPEN_MS;
+  }
+  else if(slaveRequestId == REQUEST_ID_CONTACTS_CHUNK && length >= 3){
+    slaveChunk = data[2];
+  }
+  else if(slaveRequestId == REQUEST_ID_CONTACTS_HASHES && length >= 3){
+    slaveFirstHash = data[2];
+  }
+  else if(slaveRequestId == REQUEST_ID_CONTACTS_RECORD && length >= 4){
+    slaveRecord = data[2];
+    slaveChunk = data[3];
+  }
+
+  // Requests of the block transfer protocol are unknown to an original slave
+  if(slaveProtocol < CONTACTS_PROTOCOL_VERSION && slaveRequestId >= REQUEST_ID_CONTACTS_INFO){
+    slaveRequestId = 0;
+  }
+}
+
+/**
+* Find a record (line) of the contacts file
+*
+* Returns:
+*   -Its length, newline included, with *start set to its first byte
+*/
+static unsigned int slaveFindRecord(uint8_t index, const char **start){
+  const char *c = slaveContacts;
+  for(uint8_t i = 0; i < index && *c; i++){
+    const char *end = strchr(c, '\n');
+    c = end ? end + 1 : c + strlen(c);
+  }
+  *start = c;
+  const char *end = strchr(c, '\n');
+  return end ? end - c + 1 : strlen(c);
+}
+
+static uint32_t slaveRecordHash(uint8_t index){
+  const char *record;
+  unsigned int length = slaveFindRecord(index, &record);
+  return ~crc_update_block(0xFFFFFFFF, (const uint8_t *)record, length);
+}
+
+/**
+* Reply with a chunk of data: sequence number, payload (zero padded) and CRC-8
+*/
+static uint8_t slaveChunkReply(uint8_t *buffer, const char *data, unsigned int length){
+  unsigned int offset = (unsigned int)slaveChunk * CONTACTS_CHUNK_PAYLOAD;
+  uint8_t crc = 0;
+  uint8_t n = 0;
+
+  buffer[n++] = slaveChunk;
+  for(uint8_t i = 0; i < CONTACTS_CHUNK_PAYLOAD; i++, offset++){
+    buffer[n++] = offset < length ? data[offset] : 0;
+  }
+  for(uint8_t i = 0; i < n; i++) crc = crc8_update(crc, buffer[i]);
+  buffer[n++] = crc;
+
+  // Flip a bit on the wire, after the CRC was computed
+  if(slaveCorruptChunks > 0){
+    slaveCorruptChunks--;
+    buffer[1 + slaveChunk % CONTACTS_CHUNK_PAYLOAD] ^= 0x10;
+  }
+  return n;
+}
+
+static uint8_t slaveRecordCount(){
+  uint8_t records = 0;
+  for(const char *c = slaveContacts; *c; c++){
+    if(*c == '\n') records++;
+  }
+  return records;
+}
+
+static uint8_t slaveRespond(uint8_t *buffer, uint8_t quantity){
+  uint8_t n = 0;
+
+  switch(slaveRequestId){
+  case REQUEST_ID_CONTACTS_CHANGED:
+    buffer[n++] = slaveContactsChanged;
+    slaveContactsChanged = 0;
+    break;
+
+  case REQUEST_ID_ALARMDISABLEHOURS:
+    buffer[n++] = slaveDisabledHours;
+    break;
+
+  case REQUEST_ID_CONTACTS_CHECKSUM:{
+    uint32_t crc = slaveContactsCheckSum();
+    for(; n < 4; n++) buffer[n] = (crc >> (8 * n)) & 0xff;
+    break;
+  }
+
+  case REQUEST_ID_ALARMSTATE:
+    while(n < quantity) buffer[n++] = 0;
+    break;
+
+  case REQUEST_ID_CONTACTS:{
+    // The file is padded with zeros once the end has been reached
+    unsigned int fileLength = strlen(slaveContacts);
+    while(n < quantity){
+      buffer[n++] = slaveReadOffset < fileLength ? slaveContacts[slaveReadOffset] : 0;
+      slaveReadOffset++;
+    }
+    break;
+  }
+
+  case REQUEST_ID_CONTACTS_INFO:{
+    if((long)(millis() - slaveFileReadyAt) < 0){
+      buffer[n++] = CONTACTS_STATUS_BUSY;
+      break;
+    }
+    unsigned int fileLength = strlen(slaveContacts);
+    uint32_t crc = slaveContactsCheckSum();
+    buffer[n++] = CONTACTS_PROTOCOL_VERSION;
+    buffer[n++] = fileLength & 0xff;
+    buffer[n++] = fileLength >> 8;
+    buffer[n++] = slaveRecordCount();
+    for(uint8_t i = 0; i < 4; i++) buffer[n++] = (crc >> (8 * i)) & 0xff;
+    break;
+  }
+
+  case REQUEST_ID_CONTACTS_CHUNK:
+    n = slaveChunkReply(buffer, slaveContacts, strlen(slaveContacts));
+    break;
+
+  case REQUEST_ID_CONTACTS_RECORD:{
+    const char *record;
+    unsigned int length = slaveRecord < slaveRecordCount() ? slaveFindRecord(slaveRecord, &record) : 0;
+    n = slaveChunkReply(buffer, record, length);
+    break;
+  }
+
+  case REQUEST_ID_CONTACTS_HASHES:{
+    uint8_t records = slaveRecordCount();
+    uint8_t crc = 0;
+    buffer[n++] = slaveFirstHash;
+    buffer[n++] = records;
+    for(uint8_t i = 0; i < CONTACTS_HASHES_PER_REPLY; i++){
+      uint8_t record = slaveFirstHash + i;
+      uint32_t hash = record < records ? slaveRecordHash(record) : 0;
+      for(uint8_t j = 0; j < 4; j++) buffer[n++] = (hash >> (8 * j)) & 0xff;
+    }
+    for(uint8_t i = 0; i < n; i++) crc = crc8_update(crc, buffer[i]);
+    buffer[n++] = crc;
+    break;
+  }
+
+  default:
+    buffer[n++] = I2C_STATUS_IDLE;
+    break;
+  }
+
+  return n < quantity ? n : quantity;
+}
+// End Slave
+
+
+void TwoWire::begin(){
+  txLength = 0;
+  rxIndex = 0;
+  rxLength = 0;
+}
+
+void TwoWire::beginTransmission(uint8_t address){
+  txAddress = address;
+  txLength = 0;
+}
+
+void TwoWire::beginTransmission(int address){
+  beginTransmission((uint8_t)address);
+}
+
+size_t TwoWire::write(uint8_t data){
+  if(txLength >= BUFFER_LENGTH) return 0;
+  txBuffer[txLength++] = data;
+  return 1;
+}
+
+/**
+* Returns the WSWire status code: 0 on success, 2 when the address is not
+* acknowledged.
+*/
+uint8_t TwoWire::endTransmission(){
+  simAdvanceMicros((uint64_t)(txLength + 1) * I2C_BYTE_MICROS);
+  if(txAddress != SLAVE_ADDRESS) return 2;
+  if(slaveFailureCode != 0) return slaveFailureCode;
+
+  slaveReceive(txBuffer, txLength);
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity){
+  rxIndex = 0;
+  rxLength = 0;
+  if(quantity > BUFFER_LENGTH) quantity = BUFFER_LENGTH;
+
+  if(address == SLAVE_ADDRESS && slaveFailureCode == 0){
+    rxLength = slaveRespond(rxBuffer, quantity);
+  }
+  simAdvanceMicros((uint64_t)(rxLength + 1) * I2C_BYTE_MICROS);
+  return rxLength;
+}
+
+uint8_t TwoWire::requestFrom(int address, int quantity){
+  return requestFrom((uint8_t)address, (uint8_t)quantity);
+}
+
+int TwoWire::available(){
+  return rxLength - rxIndex;
+}
+
+int TwoWire::read(){
+  return rxIndex < rxLength ? rxBuffer[rxIndex++] : -1;
+}
+
+int TwoWire::peek(){
+  return rxIndex < rxLength ? rxBuffer[rxIndex] : -1;
+}
@@ -0,0 +1,41 @@
+/*
+  Wire (host stand-in)
+
+  I2C master interface with the same API as WSWire. Transactions are
+  delivered to the simulated Ethernet slave at address 2 and take the time
+  they would at 100 kHz.
+*/
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include <Arduino.h>
+
+#define BUFFER_LENGTH 32
+
+class TwoWire : public Stream
+{
+  public:
+    void begin();
+    void beginTransmission(uint8_t);
+    void beginTransmission(int);
+    uint8_t endTransmission(void);
+    uint8_t requestFrom(uint8_t, uint8_t);
+    uint8_t requestFrom(int, int);
+    virtual size_t write(uint8_t);
+    virtual int available(void);
+    virtual int read(void);
+    virtual int peek(void);
+    using Print::write;
+
+  private:
+    uint8_t txAddress;
+    uint8_t txBuffer[BUFFER_LENGTH];
+    uint8_t txLength;
+    uint8_t rxBuffer[BUFFER_LENGTH];
+    uint8_t rxIndex;
+    uint8_t rxLength;
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,279 @@
+/*
+  MegaMaster Simulator
+
+  Runs setup() and loop() from MegaMaster.cpp against the simulated
+  hardware and reports how long each loop() iteration kept the processor
+  blocked in virtual time, and the worst-case interval of each scheduler
+  task. When no task is due the clock skips ahead to the next deadline.
+  The run fails if the firmware allocates from the heap, loses bytes from
+  the modem or counts more call outcomes than calls.
+
+  Usage: alarm-sim [-v] [--coalesce <ms>] [scenario-file]
+         alarm-sim --bench <name>
+         alarm-sim --decode-log <capture-file|->
+    -v          Echo the master's Serial output, decoded from the log records
+    --coalesce  Alarm notification coalescing window, 0 to send each
+                transition on its own
+    --bench     Run a host benchmark instead: debounce, crc, parser, lookup, templates, log, sound,
+                uart, atengine, inbox, contactsync
+    --decode-log  Print the log records in a raw capture of the board's Serial
+                  output (- for stdin), e.g. from pio device monitor --raw
+*/
+#include <Arduino.h>
+#include <time.h>
+#include "Sim.h"
+#include "MegaMaster.h"
+#include "Scheduler.h"
+#include "InputCapture.h"
+#include "Outbox.h"
+#include "Inbox.h"
+#include "ContactRecord.h"
+#include "ContactManagementFunctions.h"
+#include "SlaveCommunicationsFunctions.h"
+#include "Log.h"
+#include "Profiler.h"
+#include "ModemUart.h"
+
+extern void setup(void);
+extern void loop(void);
+
+// Loop durations are grouped in power of two buckets: [0,1) ms, [1,2) ms, [2,4) ms ...
+#define HISTOGRAM_BUCKETS 20
+
+struct LoopStats
+{
+  unsigned long iterations;
+  uint64_t totalMicros;
+  uint64_t maxMicros;
+  unsigned long maxAtMillis;
+  unsigned long histogram[HISTOGRAM_BUCKETS];
+};
+
+static void recordLoop(LoopStats *stats, uint64_t micros){
+  stats->iterations++;
+  stats->totalMicros += micros;
+  if(micros > stats->maxMicros){
+    stats->maxMicros = micros;
+    stats->maxAtMillis = millis();
+  }
+
+  byte bucket = 0;
+  for(uint64_t ms = micros / 1000; ms > 0 && bucket < HISTOGRAM_BUCKETS - 1; ms >>= 1) bucket++;
+  stats->histogram[bucket]++;
+}
+
+static void echoSerial(uint8_t c){
+  char line[512];
+  if(simLogDecodeByte(c, line, sizeof(line))) puts(line);
+}
+
+static int decodeLog(const char *path){
+  FILE *capture = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+  if(!capture){
+    fprintf(stderr, "Cannot open %s\n", path);
+    return 1;
+  }
+
+  int c;
+  char line[512];
+  while((c = fgetc(capture)) != EOF){
+    if(simLogDecodeByte(c, line, sizeof(line))) puts(line);
+  }
+  if(capture != stdin) fclose(capture);
+
+  if(simLogSkippedBytes > 0) fprintf(stderr, "%lu bytes outside log records skipped\n", simLogSkippedBytes);
+  return 0;
+}
+
+/**
+* Bytes the modem sent while the master was listening that never reached
+* the driver's ring
+*/
+static unsigned long modemBytesLost(){
+  ModemUartStats uart;
+  modemSerial.getStats(&uart);
+  return uart.rxOverruns + uart.framingErrors + (simUsart1Stats.toMaster - uart.rxBytes);
+}
+
+static void printReport(const LoopStats *stats, double realSeconds){
+  double virtualHours = simNowMicros() / 3.6e9;
+
+  printf("\n=== Simulation report ===\n");
+  printf("Virtual time:        %.2f h (%.1f virtual h per real s)\n",
+         virtualHours, realSeconds > 0 ? virtualHours / realSeconds : 0);
+  printf("Busy loop() passes:  %lu\n", stats->iterations);
+  printf("Blocked per loop():  avg %.1f ms, max %.1f ms (at %lu ms)\n",
+         stats->iterations ? stats->totalMicros / 1000.0 / stats->iterations : 0,
+         stats->maxMicros / 1000.0, stats->maxAtMillis);
+
+  printf("Blocked histogram:\n");
+  for(byte i = 0; i < HISTOGRAM_BUCKETS; i++){
+    if(stats->histogram[i] == 0) continue;
+    unsigned long low = i == 0 ? 0 : 1UL << (i - 1);
+    printf("  %8lu - %-8lu ms %lu\n", low, 1UL << i, stats->histogram[i]);
+  }
+
+  printf("Scheduler tasks:\n");
+  for(byte i = 0; i < schedulerTaskCount(); i++){
+    const Task *task = schedulerGetTask(i);
+    printf("  %-14s %8lu runs, every %lu ms, worst-case gap %lu ms, longest run %lu ms\n",
+           reinterpret_cast<const char *>(task->name), task->runs, task->interval,
+           task->maxGap, task->maxDuration);
+  }
+
+  printf("Loop phases:         runs      min us      avg us      max us  histogram (count from us)\n");
+  for(byte i = 0; i < PROFILE_PHASE_COUNT; i++){
+    const PhaseProfile *phase = profileGetPhase(i);
+    printf("  %-14s %8lu %11lu %11lu %11lu ", reinterpret_cast<const char *>(profilePhaseName(i)),
+           (unsigned long)phase->runs, (unsigned long)(phase->runs ? phase->minMicros : 0),
+           (unsigned long)(phase->sumRuns ? phase->sumMicros / phase->sumRuns : 0), (unsigned long)phase->maxMicros);
+    for(byte bucket = 0; bucket < PROFILE_BUCKETS; bucket++){
+      if(phase->histogram[bucket]) printf(" %u@%lu", phase->histogram[bucket], (unsigned long)profileBucketStart(bucket));
+    }
+    printf("\n");
+  }
+
+  printf("Input edges dropped: %u\n", inputCaptureOverruns());
+
+  printf("Modem:               %lu SMS, %lu calls, %lu deletes, %lu transactions\n",
+         simModemStats.smsSent, simModemStats.calls, simModemStats.deletes, simModemStats.transactions);
+  printf("Modem busy:          %.1f s in commands, %.1f s in calls\n",
+         simModemStats.busyMicros / 1e6, simModemStats.callMicros / 1e6);
+  ModemUartStats uart;
+  modemSerial.getStats(&uart);
+  printf("Modem UART:          %lu bytes received, %lu sent, %lu lost (%u ring overruns, %lu data overruns), "
+         "RX ring peak %u of %u\n", uart.rxBytes, uart.txBytes, modemBytesLost(), uart.rxOverruns,
+         simUsart1Stats.dataOverruns, uart.rxHighWater, MODEM_RX_BUFFER_SIZE - 1);
+  printf("Contacts transfer:   v%u, last load %lu ms, %u bytes, %u records fetched, %u chunk retries\n",
+         contactsTransferProtocol, contactsTransferTime, contactsTransferBytes,
+         contactsRecordsFetched, contactsChunkRetries);
+  const OutboxStats *outbox = outboxGetStats();
+  printf("Outbox:              %u sent, %u retries, %u failed, %u dropped, %u calls cancelled\n",
+         outbox->sent, outbox->retries, outbox->failed, outbox->dropped, outbox->cancelled);
+  printf("Outbox depth:        max %u, %u left\n", outbox->maxDepth, outboxDepth());
+  if(outbox->calls > 0){
+    printf("Outbox calls:        %u placed, %u answered, %u refused, %u rang out\n",
+           outbox->calls, outbox->callsAnswered, outbox->callsRefused, outbox->callsRangOut);
+    printf("Outbox call time:    avg %.1f s from placing to the next transaction (a fixed ring and gap was %.1f s)\n",
+           (double)outbox->callTime / outbox->calls / 1e3, (OUTBOX_CALL_RING_TIME + OUTBOX_CALL_GAP) / 1e3);
+
+    // A round calls everyone in group 1
+    unsigned int callees = 0;
+    for(ContactSet group = contactsInGroups(CONTACT_GROUP(1)); group != 0; group &= group - 1) callees++;
+    if(callees > 0){
+      double saved = ((double)outbox->calls * (OUTBOX_CALL_RING_TIME + OUTBOX_CALL_GAP) - outbox->callTime)
+                     / outbox->calls * callees / 1e3;
+      printf("Call rounds:         %u contacts each, %.1f s %s per round against the fixed ring and gap\n",
+             callees, saved < 0 ? -saved : saved, saved < 0 ? "lost" : "saved");
+    }
+  }
+  if(simModemStats.callsRefused > 0){
+    printf("Modem calls:         %lu answered, %lu ended by the far end, next dial at most %.2f s after one\n",
+           simModemStats.callsAnswered, simModemStats.callsRefused, simModemStats.maxRefusedToDialMicros / 1e6);
+  }
+  if(outbox->sent > 0){
+    printf("Outbox latency:      min %.1f s, avg %.1f s, max %.1f s\n",
+           outbox->minLatency / 1e3, (double)outbox->totalLatency / outbox->sent / 1e3, outbox->maxLatency / 1e3);
+  }
+  const InboxStats *inbox = inboxGetStats();
+  printf("Inbox:               %u read, %u deleted, %u sweeps, %u bulk cleanups\n",
+         inbox->read, inbox->deleted, inbox->sweeps, inbox->cleanups);
+  printf("Inbox ring:          %u received, %u dropped, peak %u waiting, longest wait %.1f s\n",
+         inbox->received, inbox->dropped, inbox->maxWaiting, inbox->maxWait / 1e3);
+  printf("Modem SMS storage:   %lu received, %lu read, %lu deleted unread, %u unread left, peak %u stored\n",
+         simModemStats.smsReceived, simModemStats.smsRead, simModemStats.smsDeletedUnread, simModemUnreadSMS(),
+         simModemStats.storagePeak);
+  const LogStats *log = logGetStats();
+  printf("Log:                 %lu records, %lu bytes, %u dropped\n", log->records, log->bytes, log->dropped);
+  const SimTimerStats *sound = simGetTimer2Stats();
+  printf("Sound:               %.1f s of tone, %lu Timer2 interrupts\n",
+         sound->toggleCycles / (F_CPU / 1e6) / 1e6, sound->interrupts);
+  printf("Inputs:              %u configured, %u bytes of state each in RAM, %u bytes of configuration each in flash\n",
+         (unsigned)NUMINPUTS, (unsigned)sizeof(Input), (unsigned)sizeof(InputConfig));
+  printf("Firmware heap:       %lu bytes in %lu blocks (peak %lu bytes, AVR malloc headers included)\n",
+         simHeapStats.bytes, simHeapStats.blocks, simHeapStats.peakBytes);
+  printf("Watchdog expiries:   %lu\n", simWatchdogExpiries);
+  printf("Hardware resets:     %lu\n", simHardwareResets);
+}
+
+int main(int argc, char **argv){
+  const char *scenario = NULL;
+
+  for(int i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-v") == 0){
+      simSerialTap = echoSerial;
+    }
+    else if(strcmp(argv[i], "--coalesce") == 0 && i + 1 < argc){
+      coalesceWindow = strtoul(argv[++i], NULL, 10);
+    }
+    else if(strcmp(argv[i], "--bench") == 0 && i + 1 < argc){
+      if(simRunBenchmark(argv[i + 1])) return 0;
+      fprintf(stderr, "Unknown benchmark %s\n", argv[i + 1]);
+      return 1;
+    }
+    else if(strcmp(argv[i], "--decode-log") == 0 && i + 1 < argc){
+      return decodeLog(argv[i + 1]);
+    }
+    else{
+      scenario = argv[i];
+    }
+  }
+
+  if(scenario){
+    if(!simLoadScenario(scenario)){
+      fprintf(stderr, "Cannot load scenario %s\n", scenario);
+      return 1;
+    }
+  }
+  else{
+    simLoadDefaultScenario();
+  }
+
+  clock_t started = clock();
+  LoopStats stats;
+  memset(&stats, 0, sizeof(stats));
+
+  simTrackHeap = true;
+  setup();
+  simTrackHeap = false;
+
+  while(simNowMicros() < simScenarioEndMicros){
+    uint64_t before = simNowMicros();
+    simTrackHeap = true;
+    loop();
+    simTrackHeap = false;
+    uint64_t blocked = simNowMicros() - before;
+
+    if(blocked > 0){
+      recordLoop(&stats, blocked);
+    }
+    else{
+      // Nothing ran: sleep until the next task is due
+      unsigned long idle = schedulerIdleMillis();
+      simAdvanceMicros(idle > 0 ? idle * 1000ULL : 1);
+    }
+  }
+
+  printReport(&stats, (double)(clock() - started) / CLOCKS_PER_SEC);
+
+  // A lost byte can cut an SMS or a result code short
+  if(modemBytesLost() > 0){
+    fprintf(stderr, "Modem UART lost %lu bytes at %lu baud\n", modemBytesLost(), (unsigned long)MODEM_BAUD);
+    return 1;
+  }
+
+  // Each call placed ends one way at most, or the call rounds report is off
+  const OutboxStats *outbox = outboxGetStats();
+  if(outbox->callsAnswered + outbox->callsRefused + outbox->callsRangOut > outbox->calls){
+    fprintf(stderr, "Outbox counted %u call outcomes for %u calls\n",
+            outbox->callsAnswered + outbox->callsRefused + outbox->callsRangOut, outbox->calls);
+    return 1;
+  }
+
+  // Objects live in static pools: any heap block eats into the AVR's headroom
+  if(simHeapStats.peakBytes > 0){
+    fprintf(stderr, "Firmware allocated %lu bytes on the heap\n", simHeapStats.peakBytes);
+    return 1;
+  }
+  return 0;
+}
@@ -1,4 +1,6 @@
 #ifndef CRC
 #define CRC
-extern unsigned long crc_update(unsigned long, byte);
+extern uint32_t crc_update(uint32_t, byte);
+extern uint32_t crc_update_block(uint32_t, const uint8_t *, unsigned int);
+extern byte crc8_update(byte, byte);
 #endif
\ No newline at end of file
@@ -8,194 +8,223 @@
 #include "SlaveCommunicationsFunctions.h"
 #include "GSMFunctions.h"
 #include "SerialGSM.h"
-#include "GSMSoftwareSerial.h"
 #include "DiagnosticFunctions.h"
 #include "MegaMaster.h"
 #include "ContactManagementFunctions.h"
 #include "MonitoringFunctions.h"
-#include "sounds.h"
+#include "Sounds.h"
 #include "Wire.h"
 #include "WatchdogFunctions.h"
+#include "Scheduler.h"
+#include "Outbox.h"
+#include "ContactRecord.h"
+#include "Log.h"
 
 /**
 * Requests contacts from the slave and verifies the transfer was successful.
 * Contacts are stored in the contacts array
 */
 
-static byte numContacts=0;
+byte numContacts=0;
 
 void loadAndValidateContacts(){
-  // Calculate the maximum possible file size
-  unsigned long fileSize = CONTACTS_MAX_NUMBER * 64;
+  unsigned long start = millis();
+  boolean valid = false;
+  byte result = CONTACTS_TRANSFER_UNSUPPORTED;
 
-  unsigned long checkSum = slaveGetContacts(fileSize);
-  if(checkSum == slaveGetContactsCheckSum() && checkSum > 0){
-    Serial.println(F("Contacts transferred successfully."));
+  contactsTransferBytes = 0;
+  contactsRecordsFetched = 0;
+
+  if(numContacts > 0){
+    // Only fetch the records that changed
+    result = slaveSyncContacts();
+    valid = result == CONTACTS_TRANSFER_OK;
+  }
+
+  if(!valid){
+    result = slaveGetContactsBlocks();
+    valid = result == CONTACTS_TRANSFER_OK;
+  }
+
+  if(result == CONTACTS_TRANSFER_UNSUPPORTED){
+    // The slave only speaks the original protocol
+    // Calculate the maximum possible file size
+    unsigned long fileSize = CONTACTS_MAX_NUMBER * 64;
+
+    unsigned long checkSum = slaveGetContacts(fileSize);
+    valid = checkSum == slaveGetContactsCheckSum() && checkSum > 0;
+    contactsTransferProtocol = 1;
+  }
+  else{
+    contactsTransferProtocol = CONTACTS_PROTOCOL_VERSION;
+  }
+  contactsTransferTime = millis() - start;
+
+  LOG(LOG_CONTACTS_TRANSFER, contactsTransferProtocol, contactsTransferTime, contactsTransferBytes);
+
+  if(valid){
+    LOG(LOG_CONTACTS_OK);
     playSuccessSound();
   }
   else{
-    Serial.println(F("Hash mismatch! Possible data corruption"));
+    LOG(LOG_CONTACTS_HASH);
     playAlarmSound();
     // Retry on the next loop
     numContacts = 0;
     numTimeouts++; // Count this as a timeout
   }
 
+  contactIndexBuild(numContacts);
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
   // Print all the contacts
   for(byte i = 0; i < numContacts; i++){        
-    Serial.print(F("Contact #"));
-    Serial.println(i);
-
-    Serial.print(F("Group: "));
-    Serial.println(contacts[i]->group);
+    char phone[CONTACT_PHONE_SIZE];
+    contactPhone(i, phone);
+    LOG(LOG_CONTACT, i, contacts[i]->groups, contactName(i), phone);
+  }
+#endif
+}
 
-    Serial.print(F("Name: "));
-    Serial.println(contacts[i]->name);
+/**
+* Find the contact an SMS came from. The number is matched exactly, once
+* normalized, against the phone index built when the contacts loaded.
+*
+* Returns:
+*   -The index of the contact, or -1
+*/
+int isInContactList(char* number){  
+  return contactFindPhone(number);
+}
 
-    Serial.print(F("Email: "));
-    Serial.println(contacts[i]->email);
+// Begin Notification Digest
+// Inputs with a transition waiting to be notified (bit n = input n)
+static_assert(NUMINPUTS <= 8, "Pending input sets are one byte");
+static byte pendingEntered = 0;
+static byte pendingStill = 0;
+static byte pendingCleared = 0;
+static unsigned long pendingSince = 0;
+unsigned long coalesceWindow = NOTIFY_COALESCE_WINDOW;
+// End Notification Digest
 
-    Serial.print(F("Phone: "));
-    Serial.println(contacts[i]->phone); 
+/**
+* Queue a SMS message to a set of contacts
+*/
+static void enqueueSMS(ContactSet recipients, byte templateId, byte arg0, byte arg1){
+  for(byte i = 0; recipients != 0; i++, recipients >>= 1){
+    if(recipients & 1) outboxEnqueue(OUTBOX_SMS, i, templateId, arg0, arg1);
   }
 }
 
-int isInContactList(char* number){  
-  for(int j = 0; j < numContacts; j++){
-    if(strstr(number, contacts[j]->phone)){
-      return j;      
+/**
+* Find which of a set of inputs group 1 still needs to be called about
+* inputSet: Bit n set for input n
+*
+* Returns:
+*   -The inputs in alarm that require a response which nobody has given yet
+*/
+byte inputsNeedingCalls(byte inputSet){
+  byte needed = 0;
+  for(byte i = 0; i < NUMINPUTS; i++){
+    if(!(inputSet & (1 << i))) continue;
+    if(INPUT_REQUIRES_RESPONSE(i) && inputs[i]->whoResponded == -1
+       && (inputStates.pressed & INPUT_BIT(i))){
+      needed |= 1 << i;
     }
-  }  
-  return -1;
+  }
+  return needed;
 }
 
 /**
-* Notify contacts that a machine state has changed
+* Notify contacts that a machine state has changed. The notification is
+* held for coalesceWindow so that transitions of other inputs, such as
+* several machines tripping in one power event, go out in the same digest.
 * switchNum: The machine id
 */
 void notifyContactsAlarmState(byte switchNum){
-  
-  // Message Buffer
-  const byte msgSize = 140;
-  char message[msgSize] = {0};
+  InputMask bit = INPUT_BIT(switchNum);
+  byte inputBit = 1 << switchNum;
 
-  char Responded = inputs[switchNum]->whoResponded;
-
-  
-  // Begin building the SMS message
-  // Add the machine name
-  strncat(message,  "The ", msgSize - strlen(message) - 1);
-  strncat(message, inputs[switchNum]->name, msgSize - strlen(message) - 1);
-
-  // Add the appropriate status update
-  if (justPressed[switchNum] == 1 || pressed[switchNum] == 1){
-    
-    if(justPressed[switchNum] == 1){
-      // Machine has just entered alarm state
-      strncat(message, " is in an alarm state.", msgSize - strlen(message) - 1);
-    }
-    else{
-      // Machine is still in alarm state
-      strncat(message, " is still in an alarm state.", msgSize - strlen(message) - 1);         
-    }
-    
-    if(inputs[switchNum]->requiresResponse){
-      // Ask the recipient to reply with BIRLOFF
-      strncat(message, " Please reply with 'BIRLOFF' if you are responding.", msgSize - strlen(message) - 1);    
-    }
-  }
-  else if (justReleased[switchNum] == 1){
-    strncat(message, " alarm has been cleared. The messages will now cease.", msgSize - strlen(message) - 1);
+  if((pendingEntered | pendingStill | pendingCleared) == 0){
+    pendingSince = millis();
   }
 
-  // Null terminate message
-  message[139] = '\0';
+  // Only the latest state of an input is reported
+  pendingEntered &= ~inputBit;
+  pendingStill &= ~inputBit;
+  pendingCleared &= ~inputBit;
 
-  // Notify groups 1 & 2
-  notifyContactsSMS(1, message);
-  notifyContactsSMS(2, message);
-  activeDelay(1000);
-
-  for(byte i = 0; i < numContacts; i++){
-    // Feed the watchdog (Calls are 15 seconds each)
-    ResetWatchdog();
-
-    // Call Group 1
-    if (contacts[i]->group == 1  && Responded == -1){
-      if(pressed[switchNum] == 1 && inputs[switchNum]->requiresResponse){
-
-        Serial.print(F("Calling: "));
-        Serial.println(contacts[i]->phone);
-
-        if(!cell.Call(contacts[i]->phone)) numTimeouts++;
-
-        // Keep monitoring the cell output while the call is ringing, to ensure no messages are missed
-        for(int j = 0; j < 150; j++){
-          cell.ReadLine();
-
-          if(gotSMS || cell.GetGSMStatus() == 9){
-            if(!cell.Hangup()) numTimeouts++;
-            cell.ReadLine();
-            break;
-          }
-
-          // Ensure the cell has not encountered problems
-          checkGSMProblems();
+  if(inputStates.justPressed & bit){
+    // Machine has just entered alarm state
+    pendingEntered |= inputBit;
+  }
+  else if(inputStates.pressed & bit){
+    // Machine is still in alarm state
+    pendingStill |= inputBit;
+  }
+  else if(inputStates.justReleased & bit){
+    pendingCleared |= inputBit;
+  }
 
-          delay(100);
-        }
+  if(coalesceWindow == 0) flushAlarmNotifications();
+}
 
-        if(!cell.Hangup()) numTimeouts++;        
-      }
-    }
+/**
+* Send the pending alarm notifications once the coalescing window is over:
+* one SMS per contact of groups 1 & 2, and one call round of group 1 for
+* all the inputs that need a response.
+*/
+void flushAlarmNotifications(){
+  byte pending = pendingEntered | pendingStill | pendingCleared;
+  if(pending == 0) return;
+  if(coalesceWindow != 0 && (unsigned long)(millis() - pendingSince) < coalesceWindow) return;
+
+  byte alarms = pendingEntered | pendingStill;
+  byte templateId = MSG_ALARM_DIGEST;
+  byte arg0 = alarms;
+  byte arg1 = pendingCleared;
+
+  // A single input keeps its own message
+  if((pending & (pending - 1)) == 0){
+    arg0 = 0;
+    while(!(pending & (1 << arg0))) arg0++;
+    arg1 = 0;
+
+    if(pendingEntered) templateId = MSG_ALARM_ENTERED;
+    else if(pendingStill) templateId = MSG_ALARM_STILL;
+    else templateId = MSG_ALARM_CLEARED;
+  }
 
-    activeDelay(1000);
+  pendingEntered = 0;
+  pendingStill = 0;
+  pendingCleared = 0;
 
-    // Someone has responded to the alarm
-    if(gotSMS){
-      Serial.println(F("Got SMS Message! Break #2"));
-      break; //TODO: Should verify this is a legit number before stopping calling
+  // Notify groups 1 & 2
+  notifyContactsSMS(CONTACT_GROUP(1) | CONTACT_GROUP(2), templateId, arg0, arg1);
+
+  // Call Group 1. Queued calls are dropped if someone responds first.
+  byte calls = inputsNeedingCalls(alarms);
+  if(calls){
+    ContactSet callees = contactsInGroups(CONTACT_GROUP(1));
+    for(byte i = 0; callees != 0; i++, callees >>= 1){
+      if(callees & 1) outboxEnqueue(OUTBOX_CALL, i, 0, calls, 0);
     }
   }
-
-  if(gotSMS){
-    Serial.println(F("Got SMS Message! Processing"));
-    checkIncomingSMS();
-  }
-
-  Serial.println(F("________"));
 }
+
 // --------------------------- July 2014 update ---------------------------------------------------------
 /*
 * Notify contacts that the person who responded failed to address the issue
 */
 void notifyContactsAlarmStillNotAddressed(byte switchNum){
-	const byte msgSize = 140;
-	// for warning Group 1 to expect the alarm to reset and someone new will have to take 
+  byte contactId = inputs[switchNum]->whoResponded;
+  ContactSet group1 = contactsInGroups(CONTACT_GROUP(1));
+
+	// Warn Group 1 to expect the alarm to reset and someone new will have to take 
 	// responsibility for address the alarm
-	char message1[msgSize] = {
-		'\0'  };
-	// For warning Group 2 that the person who had earlier responded has failed to address the alarm
-	char message2[msgSize] = {
-		'\0'  };
-		
-	//Message 1
-	strncat(message1, contacts[switchNum]->name, (msgSize - strlen(message1) - 1));
-  strncat(message1, "  has not addressed the " ,(msgSize - strlen(message1) - 1));
-	strncat(message1, inputs[switchNum]->name,msgSize - strlen(message1) - 1);
-	strncat(message1," alarm from 2 hours ago. The alarm has been reset, so please standby.", msgSize - strlen(message1) - 1);
-	Serial.println(message1);
-	
-	//Message 2
-	strncat(message2, contacts[switchNum]->name,(msgSize - strlen(message2) - 1));
-  strncat(message2, " has not addressed the " ,(msgSize - strlen(message2) - 1));
-	strncat(message2, inputs[switchNum]->name,(msgSize - strlen(message2) - 1));
-	strncat(message2," alarm from 2 hours ago. The alarm has been reset.", (msgSize - strlen(message2) - 1));
-	Serial.println(message2);
-	
-	// Notify groups 1 and 2
-  notifyContactsSMS(1, message1);
-  notifyContactsSMS(2, message2);
+  enqueueSMS(group1, MSG_NOT_ADDRESSED_1, switchNum, contactId);
+	// Warn Group 2 that the person who had earlier responded has failed to address the alarm
+  enqueueSMS(contactsInGroups(CONTACT_GROUP(2)) & ~group1, MSG_NOT_ADDRESSED_2, switchNum, contactId);
 }
 
 // ----------------------------------------- July 2014 update ----------------------------------------------------------
@@ -206,61 +235,23 @@ void notifyContactsAlarmStillNotAddressed(byte switchNum){
 */
 void notifyContactsAlarmResponse(byte switchNum)
 {
-  // Message Buffer
-  const byte msgSize = 140;
-  char message[msgSize] = {
-    '\0'  };
-  strncat(message,  contacts[switchNum]->name, (msgSize - strlen(message) - 1));
-  strncat(message,  " is responding to the ", (msgSize - strlen(message) - 1));
-  strncat(message, inputs[switchNum]->name, (msgSize - strlen(message) - 1));
-  strncat(message,  " alarm.", (msgSize - strlen(message) - 1));
-  Serial.println(message);
-
-  // Null terminate message
-  message[139] = '\0';
-
   // Notify groups 1 and 2
-  notifyContactsSMS(1, message);
-  notifyContactsSMS(2, message);
+  notifyContactsSMS(CONTACT_GROUP(1) | CONTACT_GROUP(2), MSG_ALARM_RESPONSE, switchNum, inputs[switchNum]->whoResponded);
 }
 
 /**
-* Send a SMS message to all contacts
-* @param contactGroup The contact group to send message to (1 or 2)
-* @param message The message to send. Should be null terminated
+* Queue a SMS message to all contacts of a group
+* @param contactGroups The contact groups to send message to (CONTACT_GROUP(1), CONTACT_GROUP(2) or both)
+* @param templateId The MSG_ template of the message
+* @param arg0, arg1 The template arguments
 */
-void notifyContactsSMS(byte contactGroup, char* message){
-
-  if (contactGroup == 3){
-    Serial.println(F("Cannot send SMS to group 3!"));
-    return; 
-  }
-
-  for(byte i = 0; i < numContacts; i++){
-    // Feed the watchdog
-    ResetWatchdog();
-
-    Serial.print(F("Processing contact: "));
-    Serial.println(contacts[i]->name);
-    Serial.print(F("Group: "));
-    Serial.println(contacts[i]->group);
-
-    Serial.println();
-
-    // Just send an SMS message
-    if (contacts[i]->group == contactGroup){
-      Serial.print(F("Sending SMS: "));
-      Serial.println(contacts[i]->phone);
-      trySendSMS(contacts[i]->phone, message);
-      cell.ReadLine();
-    }
-    cell.ReadLine();
+void notifyContactsSMS(uint16_t contactGroups, byte templateId, byte arg0, byte arg1){
 
+  if (contactGroups & CONTACT_GROUP(3)){
+    LOG(LOG_GROUP_3);
+    contactGroups &= ~CONTACT_GROUP(3);
   }
 
-  if(!cell.DeleteAllSMS()) numTimeouts++;
-  cell.ReadLine();
-
-  Serial.println("________");
+  // A contact in several of the groups gets the message once
+  enqueueSMS(contactsInGroups(contactGroups), templateId, arg0, arg1);
 }
-
@@ -1,7 +1,11 @@
 #ifndef CMF
 #define CMF
-extern void notifyContactsSMS(byte,char*);
+extern void notifyContactsSMS(uint16_t,byte,byte,byte);
 extern int isInContactList(char*);
 extern void notifyContactsAlarmState(byte);
-extern int notifyContactsAlarmResponse(int);
+extern void notifyContactsAlarmResponse(byte);
+extern void notifyContactsAlarmStillNotAddressed(byte);
+extern byte inputsNeedingCalls(byte);
+extern void flushAlarmNotifications(void);
+extern unsigned long coalesceWindow;
 #endif
\ No newline at end of file
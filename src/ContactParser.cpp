@@ -0,0 +1,151 @@
+/*
+  Contact Parser
+
+  Single pass state machine over the bytes of contacts.csv. See
+  ContactParser.h for the accepted format.
+*/
+#include <Arduino.h>
+#include "SerialGSM.h"
+#include "MegaMaster.h"
+#include "CRC32.h"
+#include "ContactParser.h"
+
+/**
+* Start parsing a new line into a contact
+* target: Receives the fields. Its contents are undefined until feed()
+*         returns CONTACT_PARSE_DONE.
+*/
+void ContactParser::begin(ContactText *target){
+  contact = target;
+  hash = 0;
+  startLine();
+}
+
+void ContactParser::startLine(){
+  lineLength = 0;
+  failed = false;
+  carriageReturn = false;
+  startField(0);
+}
+
+/**
+* Move on to the next field, at the start of a line or after a comma
+*
+* Returns:
+*   -false if the line has too many fields
+*/
+boolean ContactParser::startField(byte index){
+  switch(index){
+    case 0:
+      field = contact->groups;
+      fieldSize = sizeof(contact->groups);
+      break;
+    case 1:
+      field = contact->name;
+      fieldSize = sizeof(contact->name);
+      break;
+    case 2:
+      field = contact->email;
+      fieldSize = sizeof(contact->email);
+      break;
+    case 3:
+      field = contact->phone;
+      fieldSize = sizeof(contact->phone);
+      break;
+    case 4:
+      field = contact->ringTime;
+      fieldSize = sizeof(contact->ringTime);
+      break;
+    default:
+      return false;
+  }
+
+  // The field is terminated as bytes arrive. Nothing is written yet, as the
+  // target still holds the previous line until the caller has taken it.
+  fieldIndex = index;
+  fieldLength = 0;
+  return true;
+}
+
+/**
+* Process the next byte of the file
+*
+* Returns:
+*   -CONTACT_PARSE_MORE until a line ends, then CONTACT_PARSE_DONE or CONTACT_PARSE_ERROR
+*/
+byte ContactParser::feed(char c){
+  if(c == '\n') return endLine(true);
+  if(failed) return CONTACT_PARSE_MORE;
+
+  // Tolerate files saved with CRLF line endings, but nothing after the CR
+  if(++lineLength > CONTACT_LINE_MAX || carriageReturn){
+    failed = true;
+    return CONTACT_PARSE_MORE;
+  }
+  if(c == '\r'){
+    carriageReturn = true;
+    return CONTACT_PARSE_MORE;
+  }
+
+  if(c == ','){
+    if(fieldLength == 0 || !startField(fieldIndex + 1)) failed = true;
+    return CONTACT_PARSE_MORE;
+  }
+
+  // Reject rather than truncate a field that does not fit, control characters and non-digits in the groups, phone or ring time
+  boolean digits = fieldIndex == 0 || fieldIndex >= 3;
+  if(fieldLength >= fieldSize - 1 || (byte)c < ' ' || (digits && (c < '0' || c > '9'))){
+    failed = true;
+    return CONTACT_PARSE_MORE;
+  }
+
+  field[fieldLength++] = c;
+  field[fieldLength] = '\0';
+  return CONTACT_PARSE_MORE;
+}
+
+/**
+* End of the file. A last line without a newline still counts.
+*
+* Returns:
+*   -CONTACT_PARSE_MORE if no line was pending, otherwise as feed()
+*/
+byte ContactParser::finish(){
+  if(lineLength == 0 && !failed) return CONTACT_PARSE_MORE;
+  return endLine(false);
+}
+
+/**
+* CRC32 of a valid line. The line is exactly its fields and separators,
+* so it is hashed a field at a time rather than byte by byte.
+*/
+uint32_t ContactParser::lineHash(){
+  uint32_t crc = crc_update_block(0xFFFFFFFF, (const uint8_t *)contact->groups, strlen(contact->groups));
+  crc = crc_update_block(crc, (const uint8_t *)",", 1);
+  crc = crc_update_block(crc, (const uint8_t *)contact->name, strlen(contact->name));
+  crc = crc_update_block(crc, (const uint8_t *)",", 1);
+  crc = crc_update_block(crc, (const uint8_t *)contact->email, strlen(contact->email));
+  crc = crc_update_block(crc, (const uint8_t *)",", 1);
+  crc = crc_update_block(crc, (const uint8_t *)contact->phone, strlen(contact->phone));
+  if(fieldIndex == 4){
+    crc = crc_update_block(crc, (const uint8_t *)",", 1);
+    crc = crc_update_block(crc, (const uint8_t *)contact->ringTime, strlen(contact->ringTime));
+  }
+  if(carriageReturn) crc = crc_update_block(crc, (const uint8_t *)"\r", 1);
+  return crc;
+}
+
+byte ContactParser::endLine(boolean newline){
+  boolean valid = !failed && fieldIndex >= 3 && fieldLength > 0;
+  if(valid && fieldIndex == 3) contact->ringTime[0] = '\0';
+  if(valid && fieldIndex == 4 && atoi(contact->ringTime) > 255) valid = false;
+
+  // Lines without a newline (end of the file) are hashed without one
+  if(valid){
+    hash = ~crc_update_block(lineHash(), (const uint8_t *)"\n", newline ? 1 : 0);
+    contact->hash = hash;
+  }
+
+  startLine();
+  return valid ? CONTACT_PARSE_DONE : CONTACT_PARSE_ERROR;
+}
@@ -0,0 +1,49 @@
+#ifndef CP_H
+#define CP_H
+/*
+  Contact Parser
+
+  Streaming parser for the lines of contacts.csv (groups,name,email,phone),
+  optionally followed by ,ring: how many seconds a call to the contact may
+  ring, up to 255.
+  Bytes are written straight into the fields of the target ContactText as
+  they arrive, so no line buffer is needed. Each field is checked on the fly:
+  all fields must fit, the groups are one digit per group the contact is in
+  ("12" for groups 1 and 2) and the phone and ring time are digits only. A malformed line is skipped up to
+  its newline and reported, leaving the parser ready for the next one.
+*/
+
+// Results of ContactParser::feed() and finish()
+#define CONTACT_PARSE_MORE 0     // The line is not complete yet
+#define CONTACT_PARSE_DONE 1     // The target holds a valid contact
+#define CONTACT_PARSE_ERROR 2    // The line was malformed and has been skipped
+
+// Longest line, newline excluded
+#define CONTACT_LINE_MAX 64
+
+class ContactParser
+{
+public:
+  uint32_t hash;   // CRC32 of the last valid line, newline included
+
+  void begin(ContactText *target);
+  byte feed(char c);
+  byte finish(void);
+
+private:
+  ContactText *contact;
+  char *field;       // Field being written
+  byte fieldIndex;   // 0 groups, 1 name, 2 email, 3 phone, 4 ring time
+  byte fieldLength;
+  byte fieldSize;    // Size of the field, terminator included
+  byte lineLength;
+  boolean failed;
+  boolean carriageReturn;
+
+  void startLine(void);
+  boolean startField(byte index);
+  uint32_t lineHash(void);
+  byte endLine(boolean newline);
+};
+
+#endif
@@ -0,0 +1,215 @@
+/*
+  Contact Record
+
+  The name pool holds one NUL-terminated name per entry of the contacts
+  array, in the same order, with no gaps. Replacing a name moves the names
+  after it and updates their offsets, so the pool never fragments and a
+  record synced on its own costs no more than a full load.
+*/
+#include <Arduino.h>
+#include "SerialGSM.h"
+#include "MegaMaster.h"
+#include "ContactRecord.h"
+
+static_assert(CONTACT_PHONE_SIZE - 1 <= 2 * CONTACT_PHONE_BCD
+              && PHONE_NATIONAL_DIGITS + sizeof(PHONE_COUNTRY_CODE) - 1 <= 2 * CONTACT_PHONE_BCD,
+              "Every phone of the contacts file must fit the BCD digits once normalized");
+static_assert(CONTACTS_NAME_POOL_SIZE >= CONTACTS_MAX_NUMBER * CONTACT_NAME_SIZE && CONTACTS_NAME_POOL_SIZE <= 256,
+              "Every contact needs room for the longest name in the name pool, and offsets are one byte");
+
+// Begin Name Pool
+static char names[CONTACTS_NAME_POOL_SIZE];
+static unsigned int namesUsed = 0;
+// End Name Pool
+
+// Begin Phone Index
+static byte phoneIndex[CONTACTS_MAX_NUMBER];   // Contacts sorted by phone
+static byte phoneIndexCount = 0;
+// End Phone Index
+
+// Begin Group Lists
+static ContactSet groupMembers[CONTACT_GROUPS];
+// End Group Lists
+
+/**
+* Give every entry of the contacts array an empty name, before a full load.
+* The entries must already be allocated.
+*/
+void contactRecordsBegin(){
+  memset(names, 0, sizeof(names));
+  namesUsed = CONTACTS_MAX_NUMBER;
+  for(byte i = 0; i < CONTACTS_MAX_NUMBER; i++){
+    contacts[i]->nameOffset = i;
+  }
+}
+
+/**
+* Replace the name of a contact. The pool has room for the longest name on
+* every entry, so it always fits.
+*/
+static void setName(byte index, const char *name){
+  byte offset = contacts[index]->nameOffset;
+  unsigned int oldSize = strlen(names + offset) + 1;
+  unsigned int length = strlen(name);
+
+  unsigned int newSize = length + 1;
+  memmove(names + offset + newSize, names + offset + oldSize, namesUsed - offset - oldSize);
+  memcpy(names + offset, name, length);
+  names[offset + length] = '\0';
+  namesUsed = namesUsed - oldSize + newSize;
+
+  for(byte i = index + 1; i < CONTACTS_MAX_NUMBER; i++){
+    contacts[i]->nameOffset = contacts[i]->nameOffset - oldSize + newSize;
+  }
+}
+
+static byte phoneDigit(const Contact *contact, byte i){
+  byte pair = contact->phone[i >> 1];
+  return (i & 1) ? pair & 0x0F : pair >> 4;
+}
+
+/**
+* Normalize a phone number to E.164 digits and pack it as BCD. Anything but
+* digits (a leading +, spaces, dashes) is ignored, and a national number
+* gets PHONE_COUNTRY_CODE.
+* number: The number as text
+* key: Receives the packed phone in its phone fields
+*
+* Returns:
+*   -false if the number has no digits or too many to pack
+*/
+boolean contactPhoneKey(const char *number, Contact *key){
+  byte digits = 0;
+  unsigned int length = 0;
+
+  for(const char *c = number; *c; c++){
+    if(*c >= '0' && *c <= '9') length++;
+  }
+  const char *prefix = length == PHONE_NATIONAL_DIGITS ? PHONE_COUNTRY_CODE : "";
+  length += strlen(prefix);
+  if(length == 0 || length > 2 * CONTACT_PHONE_BCD) return false;
+
+  memset(key->phone, 0, sizeof(key->phone));
+  for(byte part = 0; part < 2; part++){
+    for(const char *c = part == 0 ? prefix : number; *c; c++){
+      if(*c < '0' || *c > '9') continue;
+      byte digit = *c - '0';
+      key->phone[digits >> 1] |= (digits & 1) ? digit : digit << 4;
+      digits++;
+    }
+  }
+  key->phoneDigits = digits;
+  return true;
+}
+
+/**
+* Order packed phones by length, then digits
+*
+* Returns:
+*   -Less than, equal to or greater than 0 as a is before, the same as or after b
+*/
+int8_t contactPhoneCompare(const Contact *a, const Contact *b){
+  if(a->phoneDigits != b->phoneDigits) return a->phoneDigits < b->phoneDigits ? -1 : 1;
+  int difference = memcmp(a->phone, b->phone, sizeof(a->phone));
+  return difference < 0 ? -1 : difference > 0;
+}
+
+/**
+* Pack a parsed contact into an entry of the contacts array
+* index: The entry
+* text: A contact accepted by the ContactParser
+*/
+void contactStore(byte index, const ContactText *text){
+  Contact *contact = contacts[index];
+
+  contact->groups = 0;
+  for(const char *c = text->groups; *c; c++){
+    contact->groups |= CONTACT_GROUP(*c - '0');
+  }
+  contactPhoneKey(text->phone, contact);
+  contact->ringTime = atoi(text->ringTime);
+  contact->hash = text->hash;
+
+  setName(index, text->name);
+}
+
+/**
+* Empty an entry that no longer holds a contact, returning its name to the pool
+*/
+void contactClear(byte index){
+  Contact *contact = contacts[index];
+  contact->groups = 0;
+  contact->phoneDigits = 0;
+  contact->ringTime = 0;
+  contact->hash = 0;
+  setName(index, "");
+}
+
+const char *contactName(byte index){
+  return names + contacts[index]->nameOffset;
+}
+
+/**
+* Returns:
+*   -How many seconds a call to the contact may ring, 0 if it has no ring time
+*/
+byte contactRingTime(byte index){
+  return contacts[index]->ringTime;
+}
+
+/**
+* Unpack the phone number of a contact
+* phone: Receives the number, CONTACT_PHONE_SIZE bytes
+*
+* Returns:
+*   -The number of digits
+*/
+byte contactPhone(byte index, char *phone){
+  const Contact *contact = contacts[index];
+  byte i;
+  for(i = 0; i < contact->phoneDigits; i++){
+    phone[i] = '0' + phoneDigit(contact, i);
+  }
+  phone[i] = '\0';
+  return i;
+}
+
+/**
+* Index the first count contacts once they are loaded: sort them by phone
+* and list the members of each group
+*/
+void contactIndexBuild(byte count){
+  memset(groupMembers, 0, sizeof(groupMembers));
+  for(byte i = 0; i < count; i++){
+    phoneIndex[i] = i;
+    for(byte group = 0; group < CONTACT_GROUPS; group++){
+      if(contacts[i]->groups & CONTACT_GROUP(group)) groupMembers[group] |= (ContactSet)1 << i;
+    }
+  }
+  contactIndexSort(contacts, phoneIndex, count);
+  phoneIndexCount = count;
+}
+
+/**
+* The contacts in any of a set of groups
+* groups: Bit n set for group n
+*/
+ContactSet contactsInGroups(uint16_t groups){
+  ContactSet members = 0;
+  for(byte group = 0; groups != 0; group++, groups >>= 1){
+    if(groups & 1) members |= groupMembers[group];
+  }
+  return members;
+}
+
+/**
+* Find the contact with a phone number, after normalizing it
+*
+* Returns:
+*   -The index of the contact in contacts, or -1
+*/
+int contactFindPhone(const char *number){
+  Contact key;
+  if(!contactPhoneKey(number, &key)) return -1;
+  return contactIndexSearch(contacts, phoneIndex, phoneIndexCount, &key);
+}
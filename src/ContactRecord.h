@@ -0,0 +1,68 @@
+#ifndef CR_H
+#define CR_H
+/*
+  Contact Record
+
+  Packs parsed contacts into the compact form kept in the contacts array:
+  the phone as BCD digits, the groups as a bitmask and the name in a shared
+  pool with room for the longest name on every entry. Matching and
+  addressing read the packed form directly.
+
+  Phones are normalized to E.164 digits when they are packed, and an index
+  of the contacts sorted by phone lets an SMS sender be matched exactly by
+  binary search. The members of each group are kept as a ContactSet, so a
+  notification only visits its recipients.
+*/
+
+extern void contactRecordsBegin(void);
+extern void contactStore(byte, const ContactText *);
+extern void contactClear(byte);
+extern const char *contactName(byte);
+extern byte contactPhone(byte, char *);
+extern byte contactRingTime(byte);
+extern boolean contactPhoneKey(const char *, Contact *);
+extern int8_t contactPhoneCompare(const Contact *, const Contact *);
+extern void contactIndexBuild(byte);
+extern int contactFindPhone(const char *);
+extern ContactSet contactsInGroups(uint16_t);
+
+/**
+* Sort an index of a contacts table by phone. Contacts with the same phone
+* keep their order. An insertion sort, as the tables are short and mostly
+* sorted already when contacts are reloaded.
+* table: The contacts
+* index: Positions in table, in any order
+*/
+template <typename T>
+void contactIndexSort(Contact *const *table, T *index, T count){
+  for(T i = 1; i < count; i++){
+    T position = index[i];
+    T j = i;
+    while(j > 0 && contactPhoneCompare(table[index[j - 1]], table[position]) > 0){
+      index[j] = index[j - 1];
+      j--;
+    }
+    index[j] = position;
+  }
+}
+
+/**
+* Binary search of an index sorted by contactIndexSort()
+* key: A phone packed by contactPhoneKey()
+*
+* Returns:
+*   -The first position in table with that phone, or -1
+*/
+template <typename T>
+int contactIndexSearch(Contact *const *table, const T *index, T count, const Contact *key){
+  T low = 0;
+  T high = count;
+  while(low < high){
+    T middle = low + (high - low) / 2;
+    if(contactPhoneCompare(table[index[middle]], key) < 0) low = middle + 1;
+    else high = middle;
+  }
+  if(low == count || contactPhoneCompare(table[index[low]], key) != 0) return -1;
+  return index[low];
+}
+#endif
@@ -0,0 +1,94 @@
+#ifndef DEBOUNCER_H
+#define DEBOUNCER_H
+/*
+  Debouncer
+
+  Bit-sliced debouncer: every input is one bit (lane) of a Mask, so all
+  inputs are debounced together with a handful of bitwise operations
+  whatever their number. Lanes are active low, as the inputs use pull-ups.
+
+  Edges are fed in time order with their timestamps. Time is divided into
+  windows of `window` milliseconds; at the end of each window, every lane
+  that saw no edge during it is stable and its pressed bit follows its
+  level. A lane that bounced keeps its previous state for another window.
+  Any state lasting two windows or more is therefore reported, even if the
+  edges are only processed later.
+*/
+
+template <typename Mask>
+class Debouncer
+{
+public:
+  Mask raw;          // Levels after the last edge (1 = HIGH)
+  Mask dirty;        // Lanes with an edge in the current window
+  Mask pressed;      // Debounced state (1 = pressed)
+  Mask justPressed;  // Latched until cleared by the caller
+  Mask justReleased; // Latched until cleared by the caller
+
+  /**
+  * Start from the current levels with every lane released
+  */
+  void begin(Mask levels, unsigned long now, unsigned long windowLength){
+    raw = levels;
+    dirty = 0;
+    pressed = 0;
+    justPressed = 0;
+    justReleased = 0;
+    window = windowLength;
+    windowEnd = now + window;
+  }
+
+  /**
+  * Record an edge. Windows that ended before it are closed first.
+  *
+  * Returns:
+  *   -Mask of the lanes whose debounced state changed
+  */
+  Mask edge(unsigned long time, Mask levels){
+    Mask changed = advance(time);
+    dirty |= raw ^ levels;
+    raw = levels;
+    return changed;
+  }
+
+  /**
+  * Close all windows that have ended by now
+  *
+  * Returns:
+  *   -Mask of the lanes whose debounced state changed
+  */
+  Mask advance(unsigned long now){
+    Mask changed = 0;
+
+    while((long)(now - windowEnd) >= 0){
+      changed |= closeWindow();
+
+      // Nothing pending: the next windows would not change anything either.
+      // Skip to the window that contains now, if the close has not reached it.
+      if(dirty == 0 && pressed == (Mask)~raw){
+        if((long)(now - windowEnd) >= 0) windowEnd += ((now - windowEnd) / window + 1) * window;
+        break;
+      }
+    }
+    return changed;
+  }
+
+private:
+  unsigned long window;
+  unsigned long windowEnd;
+
+  Mask closeWindow(){
+    Mask stable = ~dirty;
+    Mask next = (pressed & dirty) | ((Mask)~raw & stable);
+    Mask changed = next ^ pressed;
+
+    justPressed |= changed & next;
+    justReleased |= changed & pressed;
+    pressed = next;
+    dirty = 0;
+    windowEnd += window;
+    return changed;
+  }
+};
+
+#endif
@@ -6,48 +6,60 @@
 #include <Arduino.h>
 #include "SlaveCommunicationsFunctions.h"
 #include "GSMFunctions.h"
-#include "GSMSoftwareSerial.h"
 #include "SerialGSM.h"
+#include "ModemUart.h"
 #include "MegaMaster.h"
 #include "ContactManagementFunctions.h"
 #include "MonitoringFunctions.h"
 #include "Sounds.h"
 #include "DiagnosticFunctions.h"
 #include "WatchdogFunctions.h"
+#include "Outbox.h"
+#include "Log.h"
+#include "Profiler.h"
 
 
 
 static boolean doneSoftReset = false;
+static unsigned int modemBytesLost = 0;
 
 /**
 * Check for GSM errors and reset if required
 */
 void checkGSMProblems(){
+  PROFILE(PHASE_GSM_PROBLEMS);
   
   // Handle GSM Errors
   if(cell.GetErrorCode() != 0){
-    Serial.print(F("Error has occured! Restarting. Code: "));    
-    Serial.println(cell.GetErrorCode());    
+    LOG(LOG_GSM_ERROR, cell.GetErrorCode());
     doIncrementalReset();
   }
   
   // Handle Timeouts
   if(numTimeouts > 3){
-    Serial.print(numTimeouts);
-    Serial.println(F(" operations have timed out! Restarting."));
+    LOG(LOG_GSM_TIMEOUTS, numTimeouts);
     doIncrementalReset();
   }
   
+  // Bytes lost by the modem UART may have cut a message short
+  ModemUartStats uart;
+  modemSerial.getStats(&uart);
+  unsigned int lost = uart.rxOverruns + uart.dataOverruns + uart.framingErrors;
+  if(lost != modemBytesLost){
+    LOG(LOG_MODEM_BYTES_LOST, uart.rxOverruns, uart.dataOverruns, uart.framingErrors);
+    modemBytesLost = lost;
+  }
+
   // Handle unexpected status codes
-  if(cell.GetGSMStatus() == 1 || cell.GetGSMStatus() == 10){
-    // Cell has reset itself (Status 1 or 10)
+  if(cell.GetGSMStatus() == GSM_STATUS_RESET || cell.GetGSMStatus() == GSM_STATUS_POWER_DOWN){
+    // Cell has reset itself or powered down
     // Call bootGSMShield() to ensure that the cell reboots properly.
-    // This also ensures that FwdSMS2Serial is called, which allows SMS messages to be recieved.
+    // This also ensures that new SMS messages are reported again, so they can be recieved.
     bootGSMShield();
   }
-  else if(cell.GetGSMStatus() == 7){
-    // Unrecoverable Error - Status 7
-    Serial.println("Cell Status 7. Restarting.");
+  else if(cell.GetGSMStatus() == GSM_STATUS_NO_SIM){
+    // Unrecoverable Error - no SIM card
+    LOG(LOG_GSM_STATUS_7);
     doIncrementalReset();
   }
 }
@@ -72,25 +84,23 @@ void doIncrementalReset(){
 * Check for I2C errors and notify as appropriate
 */
 void checkI2CProblems(){ 
+  PROFILE(PHASE_I2C_PROBLEMS);
+
   // Check wire status.
-  Serial.print(F("Wire Status: "));
-  Serial.println(wireResponseCode);
+  LOG(LOG_WIRE_STATUS, wireResponseCode);
   if(wireResponseCode != 0){
     // Wire is malfunctioning
     playShortBeepSound();
     
     // Alert everyone
     if(!wireFailureResponse && (((unsigned long)(millis() - lastI2CFailNotification) > I2C_FAIL_NOTIFICATION_PERIOD) || lastI2CFailNotification == 0)){
-      char message[85] = "Master -> Slave I2C has failed. Reply with 'IKNOW' to stop these updates. Status: ";
-      message[83] = (wireResponseCode + 48); //Convert decimal code to ASCII equivalent
-      message[84] = '\0';
-      notifyContactsSMS(1, message);
+      notifyContactsSMS(CONTACT_GROUP(1), MSG_I2C_FAILED, wireResponseCode, 0);
       lastI2CFailNotification = millis();
     }
   }else{
     // I2C is working again, notify contacts
     if(lastI2CFailNotification != 0){
-      notifyContactsSMS(1,(char *) "Master -> Slave I2C has sucessfully restarted.\0");
+      notifyContactsSMS(CONTACT_GROUP(1), MSG_I2C_RESTORED, 0, 0);
       lastI2CFailNotification = 0;
     }
   }
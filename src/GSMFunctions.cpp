@@ -6,24 +6,32 @@
 #include <Arduino.h>
 #include "SlaveCommunicationsFunctions.h"
 #include "GSMFunctions.h"
-#include "GSMSoftwareSerial.h"
 #include "SerialGSM.h"
+#include "ModemUart.h"
 #include "DiagnosticFunctions.h"
 #include "MegaMaster.h"
 #include "ContactManagementFunctions.h"
 #include "Sounds.h"
 #include "MonitoringFunctions.h"
+#include "Scheduler.h"
+#include "Outbox.h"
+#include "Inbox.h"
+#include "Log.h"
+#include "Profiler.h"
 
 void (* resetFunc) (void) = 0;
 //declare reset function @ address 0
 int garbage =0;
+
+// The message being handled, taken from the inbox ring
+static InboxMessage incoming;
 /**
 * One time configuration for the GSM shield
 */
 void initializeGSMShield()
 {
-  cell.begin(9600);  
-  //The cellular shield will output all messages to serial. Disable in production.
+  modemSerial.begin(MODEM_BAUD);
+  // Log every line from the modem, in builds with LOG_LEVEL_DEBUG
   garbage++;
   cell.Verbose(true);
 }
@@ -33,97 +41,58 @@ void initializeGSMShield()
 * In case of failure, a reset will be performed.
 */
 void bootGSMShield(){
-  // Startup the modem
+  // Startup the modem. It also has new messages reported from now on.
   cell.Boot();
-  // Set the modem to forward all messages to the serial pins
-  cell.FwdSMS2Serial();
   
   // Boot GSM Module
-  Serial.print(F("Booting GSM Shield."));
+  LOG(LOG_GSM_BOOTING);
 
   // Wait for appropriate status
-  while (cellStatus != 4){
-    if(cellStatus == 7){
+  while (cellStatus != GSM_STATUS_READY){
+    if(cellStatus == GSM_STATUS_NO_SIM){
       //We have a problem
       playFailSound();
       playAlarmSound();
+      soundWait();
       resetFunc();
     }
 
-    Serial.println(cellStatus);
+    LOG(LOG_GSM_BOOT_STATUS, cellStatus);
     cellStatus = cell.GetGSMStatus();
-    cell.ReadLine();
+    cell.Poll();
 
     playShortBeepSound();
-    delay(300);
+    schedulerDelay(300);
   }
+  LOG(LOG_GSM_READY);
 }
 
 /**
-* Tries to send an SMS message. In case of failure, this is reattempted.
-* In case of a second failure, a reset will occur.
-*/
-void trySendSMS(char * cellnumber, char * outmsg){
-  if(!cell.SendSMS(cellnumber, outmsg)){
-    // Retry once
-    Serial.println(F("Attempt 1: SMS Failed to send. Retrying."));
-    numTimeouts++;
-    if(!cell.SendSMS(cellnumber, outmsg)){
-      // We got a problem.
-      Serial.println(F("Attempt 1: SMS Failed to send. Restarting GSM."));
-      numTimeouts++;
-      doIncrementalReset(); //Diagnostic Function
-    }
-  }
-}
-
-/**
-* Returns true if interrupted
-*/
-boolean activeDelay(int milliseconds){
-  
-  // Active Delay for 3000ms after calling SMS
-  for(int i = 0; i < (milliseconds/100); i++){       
-    cell.ReadLine();
-    Serial.println("Waiting.");
-    if(gotSMS) return true;
-    delay(100);
-  }  
-  
-  return false;
-}
-
-
-/**
-* Parse an incoming text message and verifiy it has come from a trusted source.
+* Parse the incoming text messages and verifiy each has come from a trusted source.
 * If it is trusted, take action based on the message contents.
 */
 void checkIncomingSMS(){
+  PROFILE(PHASE_INCOMING_SMS);
 
-  // Check for incoming SMS messages
-  if(gotSMS) {
+  // Handle the incoming SMS messages, oldest first
+  while(inboxTake(&incoming)) {
     
-    Serial.println(F("-------------------------------------------------------------------"));
-    Serial.println(F("Incoming SMS from: "));
-    Serial.println(cell.Sender());
-    Serial.println(F("*******************************************************************"));
-    Serial.println(F("Message: "));
-    Serial.println(lastSMS);
-    Serial.println(F("-------------------------------------------------------------------"));
+    LOG(LOG_SMS_RECEIVED, incoming.sender, incoming.text);
     
     // Verify the number
-    int contactId = isInContactList(cell.Sender());
+    int contactId = isInContactList(incoming.sender);
     if(contactId != -1){      
       // This is a trusted number, process the message
       
-      if(strstr(lastSMS, "BIRLOFF") != NULL){
+      if(strstr(incoming.text, "BIRLOFF") != NULL){
         // Check for an alarm response
         for (byte i = 0; i < NUMINPUTS; i++) {  
     
           // Only process if no one has responded
-          if(inputs[i]->requiresResponse && inputs[i]->whoResponded == -1 && (pressed[i] == 1 || justPressed[i] == 1) ){
+          if(INPUT_REQUIRES_RESPONSE(i) && inputs[i]->whoResponded == -1 && ((inputStates.pressed | inputStates.justPressed) & INPUT_BIT(i)) ){
      
               inputs[i]->whoResponded = contactId;
+              inputs[i]->responseTime = incoming.receivedAt;
 
               // Notify the slave
               slaveSetAlarmResponse(i, inputs[i]->whoResponded);
@@ -132,53 +101,33 @@ void checkIncomingSMS(){
           }
           else{
             // Ignore SMS
-            Serial.println(F("Ignoring SMS: Alarm already handled"));   
+            LOG(LOG_SMS_IGNORED);
           }
         }
       }
       
       // Check for an error handle response
       if(wireResponseCode != 0){
-        if(strstr(lastSMS, "IKNOW") != NULL){   
+        if(strstr(incoming.text, "IKNOW") != NULL){   
           
           wireFailureResponse = true;
-          
-          const byte msgSize = 140;
-          char message[msgSize] = {'\0'};
-
-          strncat(message,  contacts[contactId]->name, msgSize - strlen(message) - 1);
-          strncat(message,  " is responding to the I2C error", msgSize - strlen(message) - 1);
-          Serial.println(message);
-        
-          // Null terminate message
-          message[139] = '\0';
 
-          // Notify groups 1 and 2
-          notifyContactsSMS(1, message);
+          // Notify group 1
+          notifyContactsSMS(CONTACT_GROUP(1), MSG_I2C_RESPONSE, contactId, 0);
         }
       }
 
     }
-
-    //Reset flags
-    gotSMS = false;
-    
-    // If the method returns false, it has timed out. Increment numTimeouts
-    if (!cell.DeleteAllSMS()) numTimeouts++;
-    cell.ReadLine();
   }
 }
 
 /**
  * SMS Recieve Callback function. This is triggered when 
  * an SMS is received. This function should be executed quickly,
- * so the message parameters are saved and processed in the main loop.
+ * so the message is queued in the inbox ring and processed in the main loop.
  */
 int onReceiveSMS(void){
-  Serial.print(F("Master Got SMS :"));
-  gotSMS = true;
-  strncpy (lastSMS, cell.Message(), sizeof(lastSMS));
-  strncpy (smsSender, cell.Sender(), sizeof(smsSender));  
+  inboxPush(cell.Sender(), cell.Message());
   return 0;
 }
 
@@ -0,0 +1,254 @@
+/*
+  Inbox
+
+  Handles the SMS messages the modem stores and reports with +CMTI.
+  inboxTask() runs as a scheduler task and starts at most one modem command
+  per run, as the outbox does. Each reported message is read with AT+CMGR,
+  whose text reaches onReceiveSMS() while the GSM task polls the modem, and
+  deleted by its index with AT+CMGD once it is in the ring. A message that
+  arrives meanwhile only adds its index to the queue, so a reply is never
+  deleted before it is read.
+
+  The ring keeps received messages until checkIncomingSMS() handles them,
+  oldest first, so a burst of replies during an alarm is not overwritten.
+  Each entry is packed: the sender as BCD digits, the receive time and the
+  text with only its own length. A message is only read from storage while
+  the ring has room for the longest entry; one that arrives without room
+  (as a +CMT) is dropped and counted. The ring is in RAM, so messages not
+  handled yet are lost on a reset.
+
+  Indices the modem reported while the queue was full, and messages stored
+  before the modem booted, are found by reading every index of the storage.
+  Read messages left behind by a failed delete are removed in bulk, keeping
+  the unread ones, when the storage is nearly full.
+*/
+#include <Arduino.h>
+#include "SerialGSM.h"
+#include "MegaMaster.h"
+#include "Inbox.h"
+#include "Profiler.h"
+#include "Log.h"
+
+// Driver states
+#define INBOX_IDLE 0
+#define INBOX_WAITING 1     // A command is in flight
+
+static_assert(INBOX_RING_SIZE <= 256 && (INBOX_RING_SIZE & (INBOX_RING_SIZE - 1)) == 0,
+              "INBOX_RING_SIZE must be a power of two up to 256");
+static_assert(INBOX_ENTRY_MAX < INBOX_RING_SIZE, "The ring must hold the longest message");
+
+static InboxStats stats = {0, 0, 0, 0, 0, 0, 0, 0};
+
+// Begin Received Ring
+static byte ring[INBOX_RING_SIZE];
+static byte ringHead = 0;
+static byte ringTail = 0;
+static unsigned int ringUsed = 0;   // Bytes, so a full ring differs from an empty one
+static byte ringMessages = 0;
+// End Received Ring
+
+// Begin Driver State
+static byte state = INBOX_IDLE;
+static byte toDelete = 0;           // Storage index read and handled, 0 if none
+static byte sweepIndex = 0;         // Next index to read in a sweep, 0 if none
+// End Driver State
+
+// Begin Command In Flight
+static byte activeCommand = GSM_CMD_NONE;
+static byte activeIndex = 0;
+static byte commandResult = GSM_RESULT_PENDING;
+static char argument[4];
+// End Command In Flight
+
+const InboxStats *inboxGetStats(){
+  return &stats;
+}
+
+static void putByte(byte value){
+  ring[ringHead] = value;
+  ringHead = (ringHead + 1) & (INBOX_RING_SIZE - 1);
+}
+
+static byte getByte(){
+  byte value = ring[ringTail];
+  ringTail = (ringTail + 1) & (INBOX_RING_SIZE - 1);
+  return value;
+}
+
+/**
+* Add a received message to the ring. Called from the SMS callback.
+* sender: Phone number, digits with an optional leading '+'. Anything else
+*   (an alphanumeric sender, or one too long for Sender()) is kept as an
+*   empty number.
+* text: The message, up to GSM_SMS_SIZE - 1 characters
+*
+* Returns:
+*   -false if the ring had no room, and the message is dropped
+*/
+boolean inboxPush(const char *sender, const char *text){
+  boolean plus = sender[0] == '+';
+  const char *digits = plus ? sender + 1 : sender;
+  byte count = 0;
+  while(count < GSM_PHONE_SIZE - 1 - plus && digits[count] >= '0' && digits[count] <= '9') count++;
+  if(digits[count] != '\0') count = 0;
+
+  byte length = strnlen(text, GSM_SMS_SIZE - 1);
+  unsigned int size = 1 + 4 + 1 + (count + 1) / 2 + length;
+  if(ringUsed + size > INBOX_RING_SIZE){
+    stats.dropped++;
+    LOG(LOG_SMS_DROPPED, sender);
+    return false;
+  }
+
+  putByte(length);
+  unsigned long now = millis();
+  for(byte i = 0; i < 4; i++) putByte(now >> (8 * i));
+  putByte(plus ? count | INBOX_SENDER_PLUS : count);
+  // Two digits per byte, first digit in the high nibble, as in Contact
+  for(byte i = 0; i < count; i += 2){
+    byte high = digits[i] - '0';
+    byte low = i + 1 < count ? digits[i + 1] - '0' : 0;
+    putByte(high << 4 | low);
+  }
+  for(byte i = 0; i < length; i++) putByte(text[i]);
+
+  ringUsed += size;
+  ringMessages++;
+  stats.received++;
+  if(ringMessages > stats.maxWaiting) stats.maxWaiting = ringMessages;
+  return true;
+}
+
+/**
+* Take the oldest message out of the ring
+* message: Filled with the message
+*
+* Returns:
+*   -false if the ring is empty
+*/
+boolean inboxTake(InboxMessage *message){
+  if(ringMessages == 0) return false;
+
+  byte length = getByte();
+  message->receivedAt = 0;
+  for(byte i = 0; i < 4; i++) message->receivedAt |= (unsigned long)getByte() << (8 * i);
+
+  byte count = getByte();
+  char *sender = message->sender;
+  if(count & INBOX_SENDER_PLUS) *sender++ = '+';
+  count &= ~INBOX_SENDER_PLUS;
+  for(byte i = 0; i < count; i += 2){
+    byte pair = getByte();
+    *sender++ = '0' + (pair >> 4);
+    if(i + 1 < count) *sender++ = '0' + (pair & 0x0F);
+  }
+  *sender = '\0';
+
+  for(byte i = 0; i < length; i++) message->text[i] = getByte();
+  message->text[length] = '\0';
+
+  ringUsed -= 1 + 4 + 1 + (count + 1) / 2 + length;
+  ringMessages--;
+  unsigned long wait = millis() - message->receivedAt;
+  if(wait > stats.maxWait) stats.maxWait = wait;
+  return true;
+}
+
+static void onInboxResult(byte result){
+  commandResult = result;
+}
+
+/**
+* Start a modem command on a storage index and wait for its result in
+* INBOX_WAITING. The modem must not be busy.
+* index: Storage index, 0 for none
+*/
+static void startCommand(byte command, byte index){
+  if(index != 0) utoa(index, argument, 10);
+  cell.Start(command, index != 0 ? argument : NULL, NULL, onInboxResult);
+
+  activeCommand = command;
+  activeIndex = index;
+  commandResult = GSM_RESULT_PENDING;
+  state = INBOX_WAITING;
+}
+
+/**
+* Act on the result of the command in flight
+*/
+static void completeCommand(){
+  boolean success = commandResult == GSM_RESULT_OK;
+  state = INBOX_IDLE;
+
+  switch(activeCommand){
+    case GSM_CMD_READ_SMS:
+      // An empty index answers +CMS ERROR. A message read before is not
+      // passed on again, but deleted all the same. The text is in the ring
+      // by now, so the index can go.
+      if(success){
+        stats.read++;
+        toDelete = activeIndex;
+      }
+      else if(commandResult == GSM_RESULT_TIMEOUT){
+        numTimeouts++;
+      }
+      break;
+
+    case GSM_CMD_DELETE_SMS:
+      if(success) stats.deleted++;
+      else numTimeouts++;
+      break;
+
+    default:
+      // Bulk delete
+      if(!success) numTimeouts++;
+      break;
+  }
+  activeCommand = GSM_CMD_NONE;
+}
+
+/**
+* Inbox driver: advance by at most one modem command
+*/
+void inboxTask(){
+  PROFILE(PHASE_INBOX);
+
+  if(state == INBOX_WAITING){
+    // The GSM task polls the modem, which reports the result
+    if(commandResult == GSM_RESULT_PENDING) return;
+    completeCommand();
+  }
+
+  // Wait for the outbox's command
+  if(cell.Busy()) return;
+
+  if(toDelete != 0){
+    startCommand(GSM_CMD_DELETE_SMS, toDelete);
+    toDelete = 0;
+    return;
+  }
+
+  // Read only what the ring can take: a message read is not reported again
+  if(ringUsed + INBOX_ENTRY_MAX > INBOX_RING_SIZE) return;
+
+  int index = cell.TakeStoredSMS();
+  if(index > 0){
+    startCommand(GSM_CMD_READ_SMS, index);
+    return;
+  }
+
+  if(sweepIndex == 0 && cell.TakeMissedSMS()){
+    stats.sweeps++;
+    sweepIndex = 1;
+  }
+  if(sweepIndex != 0){
+    startCommand(GSM_CMD_READ_SMS, sweepIndex);
+    sweepIndex = sweepIndex < cell.StorageSize() ? sweepIndex + 1 : 0;
+    return;
+  }
+
+  if(cell.StorageNearlyFull()){
+    startCommand(GSM_CMD_DELETE_READ_SMS, 0);
+    stats.cleanups++;
+  }
+}
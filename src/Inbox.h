@@ -0,0 +1,45 @@
+#ifndef INBOX_H
+#define INBOX_H
+/*
+  Inbox
+
+  Reads the SMS messages the modem keeps in storage, one at a time, into a
+  ring of received messages that the GSM task drains, and deletes each from
+  storage once it is in the ring.
+*/
+
+#include "SerialGSM.h"
+
+#define INBOX_RING_SIZE 256   // Bytes of received messages, a power of two up to 256
+#define INBOX_SENDER_PLUS 0x80   // Set in the digit count of a sender that started with '+'
+
+// Largest entry of the ring: text length, receive time, digit count, BCD sender, text
+#define INBOX_ENTRY_MAX (1 + 4 + 1 + (GSM_PHONE_SIZE - 1 + 1) / 2 + GSM_SMS_SIZE - 1)
+
+// A received message, unpacked from the ring
+class InboxMessage
+{
+public:
+  unsigned long receivedAt;   // millis() when the modem passed it on
+  char sender[GSM_PHONE_SIZE];
+  char text[GSM_SMS_SIZE];
+};
+
+class InboxStats
+{
+public:
+  unsigned int read;      // AT+CMGR that found a message
+  unsigned int deleted;   // One by one, after reading
+  unsigned int sweeps;    // Reads of every index, after reports were missed
+  unsigned int cleanups;  // Bulk deletes, storage nearly full
+  unsigned int received;  // Put in the ring
+  unsigned int dropped;   // Ring was full
+  byte maxWaiting;        // Messages in the ring at once
+  unsigned long maxWait;  // Receive to handling, in ms
+};
+
+extern boolean inboxPush(const char *, const char *);
+extern boolean inboxTake(InboxMessage *);
+extern const InboxStats *inboxGetStats(void);
+extern void inboxTask(void);
+#endif
@@ -0,0 +1,138 @@
+/*
+  Input Capture
+
+  Samples the alarm inputs from the Timer0 compare B interrupt, about once
+  per millisecond, and records every edge with its millis() timestamp in a
+  ring buffer. The main loop drains the buffer in checkInputs(), so
+  transitions that happen while it is busy with the modem are not lost.
+
+  Pins 49/51/53 map to PL0/PB2/PB0. Port L has no pin change interrupts on
+  the ATmega2560, so a periodic sampler is used rather than PCINT. Timer0
+  already runs for millis(); the compare B interrupt shares its 1.024 ms
+  period without changing it.
+
+  The sampled ports are read whole and concatenated into one InputMask, so
+  sampling costs the same for 3 or 64 inputs. Lane 8 * n + b is bit b of
+  the n-th port in inputPorts.
+
+  The ring buffer has a single producer (the ISR, which only writes head)
+  and a single consumer (the main loop, which only writes tail). The
+  indices are single bytes, so no locking is needed on the AVR.
+*/
+#include <Arduino.h>
+#include "MegaMaster.h"
+#include "InputCapture.h"
+
+// Begin Sampler State
+// Ports providing the input lanes, in lane order. inputPinLane() must follow the same order.
+static volatile uint8_t * const inputPorts[] = { &PINA, &PINC, &PINL, &PINB };
+static_assert(sizeof(inputPorts) / sizeof(inputPorts[0]) == INPUT_PORT_COUNT,
+              "INPUT_PORT_COUNT must match the sampled ports");
+
+// A mask viewed as one byte per port (both the AVR and the host are little-endian)
+union PortSample
+{
+  InputMask mask;
+  uint8_t port[sizeof(InputMask)];
+};
+
+static InputMask unusedLanes = ~(InputMask)0;
+static volatile InputMask sampledLevels = ~(InputMask)0;
+// End Sampler State
+
+// Begin Edge Buffer
+static InputEdge edges[EDGE_BUFFER_SIZE];
+static volatile byte edgeHead = 0;
+static volatile byte edgeTail = 0;
+static volatile unsigned int overruns = 0;
+// End Edge Buffer
+
+/**
+* Producer side: record an edge, or count an overrun if the buffer is full
+*/
+static void pushEdge(InputMask levels){
+  byte head = edgeHead;
+  byte next = (head + 1) & (EDGE_BUFFER_SIZE - 1);
+
+  if(next == edgeTail){
+    overruns++;
+    return;
+  }
+
+  edges[head].time = millis();
+  edges[head].levels = levels;
+  edgeHead = next;
+}
+
+static InputMask readPorts(){
+  PortSample sample;
+  sample.mask = 0;
+  for(byte i = 0; i < INPUT_PORT_COUNT; i++){
+    sample.port[i] = *inputPorts[i];
+  }
+
+  // Unused lanes read as HIGH (released) so they never produce edges
+  return sample.mask | unusedLanes;
+}
+
+/**
+* Timer0 compare B interrupt: sample every input port and record changes
+*/
+ISR(TIMER0_COMPB_vect){
+  InputMask levels = readPorts();
+  if(levels != sampledLevels){
+    sampledLevels = levels;
+    pushEdge(levels);
+  }
+}
+
+/**
+* Start sampling. The inputs must already be configured with pinMode().
+* lanes: Mask of the lanes connected to inputs
+*/
+void inputCaptureBegin(InputMask lanes){
+  unusedLanes = ~lanes;
+  sampledLevels = readPorts();
+
+  // Fire halfway through each Timer0 period
+  OCR0B = 0x80;
+  TIMSK0 |= _BV(OCIE0B);
+}
+
+/**
+* Consumer side: take the oldest edge from the buffer
+*
+* Returns:
+*   -true if an edge was copied into edge, false if the buffer is empty
+*/
+boolean inputCapturePop(InputEdge *edge){
+  byte tail = edgeTail;
+  if(tail == edgeHead) return false;
+
+  edge->time = edges[tail].time;
+  edge->levels = edges[tail].levels;
+  edgeTail = (tail + 1) & (EDGE_BUFFER_SIZE - 1);
+  return true;
+}
+
+/**
+* The levels of all lanes at the last sample
+*/
+InputMask inputCaptureLevels(){
+  InputMask levels;
+  cli();
+  levels = sampledLevels;
+  sei();
+  return levels;
+}
+
+/**
+* Number of edges dropped because the buffer was full
+*/
+unsigned int inputCaptureOverruns(){
+  unsigned int count;
+  cli();
+  count = overruns;
+  sei();
+  return count;
+}
@@ -0,0 +1,18 @@
+#ifndef IC_H
+#define IC_H
+
+// Number of edges buffered between two checkInputs() calls. Must be a power of two.
+#define EDGE_BUFFER_SIZE 32
+
+class InputEdge
+{
+public:
+  unsigned long time;  // millis() when the edge was sampled
+  InputMask levels;    // Levels of all lanes after the edge (1 = HIGH)
+};
+
+extern void inputCaptureBegin(InputMask);
+extern boolean inputCapturePop(InputEdge *);
+extern InputMask inputCaptureLevels(void);
+extern unsigned int inputCaptureOverruns(void);
+#endif
@@ -0,0 +1,106 @@
+/*
+  Log
+
+  Record encoder for the LOG() statements. See Log.h for the format.
+*/
+#include <Arduino.h>
+#include "Log.h"
+
+static_assert(LOG_MESSAGE_COUNT <= 256, "Message ids are one byte");
+
+static LogStats stats;
+static unsigned int unreported = 0;   // Dropped since the last LOG_DROPPED record
+
+const LogStats *logGetStats(){
+  return &stats;
+}
+
+LogRecord::LogRecord(byte id) : used(LOG_HEADER_SIZE), overflow(false){
+  buffer[0] = LOG_SYNC;
+  buffer[1] = id;
+}
+
+/**
+* Append a number as a zigzag varint: small values of either sign take one byte
+*/
+void LogRecord::addNumber(int32_t value){
+  uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+  do{
+    if(used == LOG_RECORD_MAX){
+      overflow = true;
+      return;
+    }
+    byte low = zigzag & 0x7F;
+    zigzag >>= 7;
+    buffer[used++] = zigzag ? low | 0x80 : low;
+  } while(zigzag);
+}
+
+/**
+* Append a string, truncated to the room left in the record
+*/
+void LogRecord::add(const char *text){
+  if(used == LOG_RECORD_MAX){
+    overflow = true;
+    return;
+  }
+  byte room = LOG_RECORD_MAX - used - 1;
+  byte length = 0;
+  while(length < room && text[length]) length++;
+
+  buffer[used++] = length;
+  memcpy(buffer + used, text, length);
+  used += length;
+}
+
+/**
+* Append a string stored in flash, truncated to the room left in the record
+*/
+void LogRecord::add(const __FlashStringHelper *text){
+  if(used == LOG_RECORD_MAX){
+    overflow = true;
+    return;
+  }
+  const char *flash = (const char *)text;
+  byte room = LOG_RECORD_MAX - used - 1;
+  byte length = 0;
+  char c;
+  while(length < room && (c = pgm_read_byte(flash + length)) != '\0'){
+    buffer[used + 1 + length] = c;
+    length++;
+  }
+
+  buffer[used++] = length;
+  used += length;
+}
+
+/**
+* Hand the record to Serial if its TX buffer can take all of it
+*
+* Returns:
+*   -false if it would have blocked
+*/
+boolean LogRecord::transmit(){
+  buffer[2] = used - LOG_HEADER_SIZE;
+  if(Serial.availableForWrite() < used) return false;
+  Serial.write(buffer, used);
+  stats.records++;
+  stats.bytes += used;
+  return true;
+}
+
+/**
+* Send the record, or drop it if the TX buffer is full
+*/
+void LogRecord::send(){
+  if(!overflow && unreported > 0){
+    LogRecord notice(LOG_DROPPED);
+    notice.add(unreported);
+    if(notice.transmit()) unreported = 0;
+  }
+
+  if(overflow || unreported > 0 || !transmit()){
+    stats.dropped++;
+    unreported++;
+  }
+}
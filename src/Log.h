@@ -0,0 +1,143 @@
+#ifndef LOG_H
+#define LOG_H
+/*
+  Log
+
+  Tokenized logging on Serial. A log statement sends a short binary record
+  instead of text: the message id and its arguments, with the format string
+  kept out of the firmware and applied by the host-side decoder
+  (alarm-sim --decode-log, see sim/LogDecoder.cpp).
+
+  Record: LOG_SYNC, message id, payload length, payload. Numbers are sent as
+  zigzag varints of their 32 bit value, strings as a length byte and their
+  characters. A record is only handed to Serial if the TX buffer has room
+  for all of it; otherwise it is dropped and counted, and the next record
+  that fits is preceded by a LOG_DROPPED record. Logging never blocks.
+
+  Messages above LOG_LEVEL are compiled out. Build with
+  -D LOG_LEVEL=LOG_LEVEL_DEBUG to get all of them.
+*/
+
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_SYNC 0xA5
+#define LOG_HEADER_SIZE 3
+#define LOG_RECORD_MAX 48   // Header included, well within the 64 byte TX buffer
+
+// Begin Messages
+// X(id, level, format). Formats take %d, %u, %x and %s, one per argument.
+// Append new messages at the end so older logs still decode.
+#define LOG_MESSAGES(X) \
+  X(LOG_DROPPED,               LOG_LEVEL_WARN,  "%u log records dropped") \
+  X(LOG_BOOT,                  LOG_LEVEL_INFO,  "Alarm Initialized with %u inputs") \
+  X(LOG_POOLS,                 LOG_LEVEL_INFO,  "Static pools: %u bytes of contacts, %u bytes of contact names, %u bytes of inputs") \
+  X(LOG_INPUT_SIZES,           LOG_LEVEL_INFO,  "Per input: %u bytes of state in RAM, %u bytes of configuration in flash") \
+  X(LOG_SLAVE_READY,           LOG_LEVEL_INFO,  "Ethernet Arduino ready after %u ms") \
+  X(LOG_SAVED_STATE,           LOG_LEVEL_DEBUG, "Got savestate: %u") \
+  X(LOG_GSM_BOOTING,           LOG_LEVEL_INFO,  "Booting GSM Shield") \
+  X(LOG_GSM_BOOT_STATUS,       LOG_LEVEL_DEBUG, "Waiting for cell status 4: %u") \
+  X(LOG_GSM_READY,             LOG_LEVEL_INFO,  "GSM Shield ready") \
+  X(LOG_GSM_STATUS,            LOG_LEVEL_DEBUG, "Cell Status: %u") \
+  X(LOG_GSM_ERROR,             LOG_LEVEL_ERROR, "Error has occured! Restarting. Code: %d") \
+  X(LOG_GSM_TIMEOUTS,          LOG_LEVEL_ERROR, "%u operations have timed out! Restarting.") \
+  X(LOG_GSM_STATUS_7,          LOG_LEVEL_ERROR, "Cell Status 7. Restarting.") \
+  X(LOG_WIRE_STATUS,           LOG_LEVEL_DEBUG, "Wire Status: %u") \
+  X(LOG_HARDWARE_RESET,        LOG_LEVEL_ERROR, "Reset") \
+  X(LOG_ALARM_ENABLED,         LOG_LEVEL_INFO,  "Alarm Enabled") \
+  X(LOG_INPUT_PRESSED,         LOG_LEVEL_INFO,  "Input %u just pressed at %u") \
+  X(LOG_INPUT_RELEASED,        LOG_LEVEL_INFO,  "Input %u just released at %u") \
+  X(LOG_INPUT_REMINDER,        LOG_LEVEL_INFO,  "Reminding contacts about input %u") \
+  X(LOG_INPUT_NOT_ADDRESSED,   LOG_LEVEL_INFO,  "Although contact %d had taken responsibility for attending to the alarm, input %u is still active 2 hours later. Group 1 will be called again until another person takes responsibility to address the alarm.") \
+  X(LOG_SMS_RECEIVED,          LOG_LEVEL_INFO,  "Incoming SMS from %s: %s") \
+  X(LOG_SMS_IGNORED,           LOG_LEVEL_INFO,  "Ignoring SMS: Alarm already handled") \
+  X(LOG_SYNC_DONE,             LOG_LEVEL_DEBUG, "Completed 15 sec event.") \
+  X(LOG_CONTACTS_UPDATED,      LOG_LEVEL_INFO,  "Getting Contacts") \
+  X(LOG_ALARM_DISABLED,        LOG_LEVEL_INFO,  "Alarm disabled for %u hours") \
+  X(LOG_CONTACT_REJECTED,      LOG_LEVEL_WARN,  "Rejected malformed contact on line %u") \
+  X(LOG_CONTACTS_PROGRESS,     LOG_LEVEL_DEBUG, "Transferred: %u/%u") \
+  X(LOG_CONTACTS_BYTES,        LOG_LEVEL_INFO,  "Total bytes transferred: %u") \
+  X(LOG_CONTACTS_CHUNK_FAILED, LOG_LEVEL_ERROR, "Contacts chunk failed: %u") \
+  X(LOG_CONTACT_RECORD_FAILED, LOG_LEVEL_ERROR, "Contact record failed: %u") \
+  X(LOG_CONTACTS_TRANSFER,     LOG_LEVEL_INFO,  "Contacts transfer (v%u) took %u ms, %u bytes") \
+  X(LOG_CONTACTS_OK,           LOG_LEVEL_INFO,  "Contacts transferred successfully.") \
+  X(LOG_CONTACTS_HASH,         LOG_LEVEL_ERROR, "Hash mismatch! Possible data corruption") \
+  X(LOG_CONTACT,               LOG_LEVEL_DEBUG, "Contact #%u: groups 0x%x, %s, %s") \
+  X(LOG_GROUP_3,               LOG_LEVEL_WARN,  "Cannot send SMS to group 3!") \
+  X(LOG_OUTBOX_FULL,           LOG_LEVEL_ERROR, "Outbox full! Message dropped") \
+  X(LOG_SEND_FAILED,           LOG_LEVEL_ERROR, "Message failed to send. Restarting GSM.") \
+  X(LOG_SEND_RETRY,            LOG_LEVEL_WARN,  "Attempt %u: Message failed to send. Retrying later.") \
+  X(LOG_CALLING,               LOG_LEVEL_INFO,  "Calling contact %u: %s") \
+  X(LOG_SENDING_SMS,           LOG_LEVEL_INFO,  "Sending SMS (template %u) to contact %u: %s") \
+  X(LOG_PROFILE_PHASE,         LOG_LEVEL_INFO,  "%s: %u runs, min %u us, avg %u us, max %u us") \
+  X(LOG_PROFILE_BUCKET,        LOG_LEVEL_INFO,  "  %s from %u us: %u") \
+  X(LOG_MEMORY,                LOG_LEVEL_DEBUG, "Free SRAM: %d bytes now, %u lowest since reset, heap %u bytes") \
+  X(LOG_MEMORY_LOW,            LOG_LEVEL_WARN,  "Stack reached a new depth: %u bytes of SRAM never used") \
+  X(LOG_MODEM_LINE,            LOG_LEVEL_DEBUG, "Modem: %s") \
+  X(LOG_MODEM_BYTES_LOST,      LOG_LEVEL_WARN,  "Modem UART lost bytes: %u RX ring overruns, %u data overruns, %u framing errors") \
+  X(LOG_GSM_STORED_SMS,        LOG_LEVEL_INFO,  "SMS stored by the modem at index %u") \
+  X(LOG_GSM_RING,              LOG_LEVEL_DEBUG, "Incoming call not answered") \
+  X(LOG_CALL_ANSWERED,         LOG_LEVEL_INFO,  "Call answered") \
+  X(LOG_CALL_REFUSED,          LOG_LEVEL_INFO,  "Call rejected, busy or not answered") \
+  X(LOG_SMS_DROPPED,           LOG_LEVEL_ERROR, "Inbox full! SMS from %s dropped")
+
+#define LOG_ID(id, level, format) id,
+#define LOG_ID_LEVEL(id, level, format) id##_LEVEL = level,
+enum LogMessage { LOG_MESSAGES(LOG_ID) LOG_MESSAGE_COUNT };
+enum LogMessageLevel { LOG_MESSAGES(LOG_ID_LEVEL) };
+// End Messages
+
+struct LogStats
+{
+  unsigned long records;
+  unsigned long bytes;
+  unsigned int dropped;
+};
+
+// Builds one record on the stack and sends it if it fits the TX buffer
+class LogRecord
+{
+public:
+  LogRecord(byte id);
+  void add(const char *text);
+  void add(char *text) { add((const char *)text); }
+  void add(const __FlashStringHelper *text);
+  template <typename T> void add(T value) { addNumber((int32_t)value); }
+  boolean transmit(void);
+  void send(void);
+
+private:
+  void addNumber(int32_t value);
+
+  byte buffer[LOG_RECORD_MAX];
+  byte used;
+  boolean overflow;
+};
+
+extern const LogStats *logGetStats(void);
+
+inline void logAppend(LogRecord &){
+}
+
+template <typename T, typename... Rest>
+inline void logAppend(LogRecord &record, T value, Rest... rest){
+  record.add(value);
+  logAppend(record, rest...);
+}
+
+template <typename... Args>
+inline void logWrite(byte id, Args... args){
+  LogRecord record(id);
+  logAppend(record, args...);
+  record.send();
+}
+
+// The level test is a constant, so messages above LOG_LEVEL leave no code
+#define LOG(id, ...) do{ if(id##_LEVEL <= LOG_LEVEL) logWrite(id, ##__VA_ARGS__); }while(0)
+#endif
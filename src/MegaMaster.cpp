@@ -20,126 +20,125 @@
 #include <Arduino.h>
 #include "SlaveCommunicationsFunctions.h"
 #include "GSMFunctions.h"
-#include "GSMSoftwareSerial.h"
 #include "SerialGSM.h"
+#include "ModemUart.h"
 #include "DiagnosticFunctions.h"
 #include "MegaMaster.h"
 #include "ContactManagementFunctions.h"
 #include "MonitoringFunctions.h"
 #include "Sounds.h"
 #include "WatchdogFunctions.h"
+#include "Scheduler.h"
+#include "Outbox.h"
+#include "Inbox.h"
+#include "StaticPool.h"
+#include "ContactRecord.h"
+#include "Log.h"
+#include "Profiler.h"
+#include "MemoryMonitor.h"
 #include <Wire.h> //A custom Wire library which has timeouts: https://github.com/steamfire/WSWireLib
 
 // Begin Cellular Variables
-
-static int cellStatus = 0;
-static boolean gotSMS = false;
-static char lastSMS[160] = {0};
-static char smsSender[13] = {0};
-static int numTimeouts = 0;
+SerialGSM cell(modemSerial);
+int cellStatus = 0;
+int numTimeouts = 0;
 // End Cellular Variables
 
 
 // Begin I2C Variables
-static byte wireResponseCode = 0;
-static unsigned long lastI2CFailNotification = 0;
+byte wireResponseCode = 0;
+unsigned long lastI2CFailNotification = 0;
 #define I2C_FAIL_NOTIFICATION_PERIOD 21600000
-static boolean wireFailureResponse = false;
+boolean wireFailureResponse = false;
 // End I2C Variables
 
-static Contact *contacts[CONTACTS_MAX_NUMBER];
-static Input *inputs[NUMINPUTS];
+Contact *contacts[CONTACTS_MAX_NUMBER];
+Input *inputs[NUMINPUTS];
+
+// Input configuration, built from INPUT_TABLE at compile time
+#define INPUT_CONFIG(label, pin, interval, response) \
+  { label, pin, (InputMask)1 << inputPinLane(pin), interval, response },
+const InputConfig inputConfig[NUMINPUTS] PROGMEM = { INPUT_TABLE(INPUT_CONFIG) };
+
+#define INPUT_CHECK(label, pin, interval, response) \
+  static_assert(inputPinLane(pin) != INPUT_NO_LANE, "Input pin " #pin " is not on a sampled port"); \
+  static_assert(sizeof(label) <= sizeof(InputConfig::name), "Input name " label " is too long");
+INPUT_TABLE(INPUT_CHECK)
+
+// Storage behind the contacts and inputs tables, so nothing is allocated on the heap
+static StaticPool<Contact, CONTACTS_MAX_NUMBER> contactPool;
+static StaticPool<Input, NUMINPUTS> inputPool;
  
-static byte previousState[NUMINPUTS];
-static byte currentState[NUMINPUTS];
-static long lastTime;
 
-static long lastContactsCheck = 0;
+long lastContactsCheck = 0;
 //End Monitoring Variables
 
 // Alarm disable variables
-static unsigned long alarmDisabledTime = 0;
-static byte disabledHours = 0;
+unsigned long alarmDisabledTime = 0;
+byte disabledHours = 0;
 // End alarm disable variables
 
 
 
-static byte pressed[NUMINPUTS], justPressed[NUMINPUTS], justReleased[NUMINPUTS];
-
-static byte alarmStatus = 1; // 0 = Disabled, 1 = Enabled
+byte alarmStatus = 1; // 0 = Disabled, 1 = Enabled
 // End Common Code
 
-static unsigned long TimeResponded = 0;
 static unsigned long AlCallRestartTime = 120000;
 
+// Scheduler tasks
+static void inputTask(void);
+static void soundTask(void);
+static void gsmTask(void);
+static void notificationTask(void);
+static void slaveSyncTask(void);
+static void profilerTask(void);
+
 
 
 
 void setup()
 {
   SetupWatchdog();
-  SerialGSM cell(10,11);
   Wire.begin();
   Serial.begin(9600); 
 
-  // Manually setup inputs
-  inputs[0] = new Input();
-  strlcpy(inputs[0]->name, "Shandon TP", sizeof(inputs[0]->name));
-  inputs[0]->pin = 49;
-  inputs[0]->notificationInterval = 420000;  //7 Minutes
-  inputs[0]->lastNotificationTime = 0;
-  inputs[0]->requiresResponse = true;
-  inputs[0]->whoResponded = -1;
-
-  inputs[1] = new Input();
-  strlcpy(inputs[1]->name, "Pathos Delta", sizeof(inputs[1]->name));
-  inputs[1]->pin = 51;
-  inputs[1]->notificationInterval = 420000;  //7 Minutes
-  inputs[1]->lastNotificationTime = 0;
-  inputs[1]->requiresResponse = true;
-  inputs[1]->whoResponded = -1;
-
-  inputs[2] = new Input();
-  strlcpy(inputs[2]->name, "Lab Power", sizeof(inputs[2]->name));
-  inputs[2]->pin = 53;
-  inputs[2]->notificationInterval = 21600000;  //6 Hours
-  inputs[2]->lastNotificationTime = 0;
-  inputs[2]->requiresResponse = false;
-  inputs[2]->whoResponded = -1;
-  // End manual input setup
+  // Take the runtime state of the inputs from their pool
+  for(byte i = 0; i < NUMINPUTS; i++){
+    inputs[i] = inputPool.allocate();
+    inputs[i]->whoResponded = -1;
+  }
 
   // Time before re-phoning all if alarm has not been dealt with
   
   
 
-  // Enable inputs (with pull-up resistors on switch pins)
-  for (byte i = 0; i < NUMINPUTS; i++) {
-    pinMode(inputs[i]->pin, INPUT_PULLUP);
-  }
-  Serial.print(F("Alarm Initialized with "));
-  Serial.print(NUMINPUTS, DEC);
-  Serial.println(F(" inputs"));
+  // Enable inputs and start capturing their edges
+  beginInputs();
+  LOG(LOG_BOOT, NUMINPUTS);
 
-  // Allocate memory for the contacts
-  for(byte i = 0; i < 12; i++){
-    contacts[i] = new Contact();
+  // Take the contacts from their pool
+  for(byte i = 0; i < CONTACTS_MAX_NUMBER; i++){
+    contacts[i] = contactPool.allocate();
   }
+  contactRecordsBegin();
+
+  LOG(LOG_POOLS, contactPool.BYTES, CONTACTS_NAME_POOL_SIZE, inputPool.BYTES);
+  LOG(LOG_INPUT_SIZES, sizeof(Input), sizeof(InputConfig));
 
   // Setup and test the speaker
-  pinMode(PIN_SPEAKER, OUTPUT);
+  soundBegin();
   playLongBeepSound();
   playSuccessSound();
 
 
 
   // Wait for the Ethernet shield to boot
-  Serial.print(F("Waiting for Ethernet Arduino."));
+  unsigned long slaveWaitStart = millis();
   while(Wire.requestFrom(2, 1) <= 0){
-    Serial.print('.');
     playShortBeepSound();
     delay(300); 
   }
-  Serial.println(F("..Done"));
+  LOG(LOG_SLAVE_READY, millis() - slaveWaitStart);
   delay(4000);
   
   // Get data from slave
@@ -157,15 +156,12 @@ void setup()
 
 
   // Boot GSM Module
-  Serial.print(F("Booting GSM Shield."));
   initializeGSMShield();
   bootGSMShield();
 
 // &&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&
   cell.registerSMSCallback(onReceiveSMS);
 
-  Serial.println(F("..Done"));
-
   // GSM Module is ready
   playLongBeepSound();
 
@@ -175,19 +171,33 @@ void setup()
   delay(1000); 
 
   playSuccessSound();
-}
 
+  // Background tasks first, so they also run while the others wait
+  schedulerAddTask(inputTask, F("Inputs"), DEBOUNCE, TASK_BACKGROUND);
+  schedulerAddTask(soundTask, F("Sound"), 500, TASK_BACKGROUND);
+  schedulerAddTask(gsmTask, F("GSM"), 100, 0);
+  schedulerAddTask(notificationTask, F("Notifications"), 100, 0);
+  // Replies are read before the next notification goes out
+  schedulerAddTask(inboxTask, F("Inbox"), 100, 0);
+  schedulerAddTask(outboxTask, F("Outbox"), 100, 0);
+  schedulerAddTask(slaveSyncTask, F("I2C sync"), 1000, 0);
+#if PROFILING
+  schedulerAddTask(profilerTask, F("Profiler"), 100, 0);
+#endif
+}
 
-void loop() {
-
-  Serial.print(F("Cell Status: "));
-  Serial.println(cell.GetGSMStatus());
 
-  // Feed the watchdog
-  ResetWatchdog();
+/**
+* GSM pump: drain the modem output, handle replies and check for faults
+*/
+static void gsmTask(){
+  LOG(LOG_GSM_STATUS, cell.GetGSMStatus());
 
-  // Fill the cell buffer
-  cell.ReadLine();
+  // Handle what the modem has sent, and time out the command in flight
+  {
+    PROFILE(PHASE_MODEM_POLL);
+    cell.Poll();
+  }
 
   // Check for a response
   checkIncomingSMS();
@@ -195,84 +205,132 @@ void loop() {
   // Diagnostics
   checkGSMProblems();
   checkI2CProblems();
+}
 
-  // Fire every 15 seconds or if contacts have never been loaded
-  if (((unsigned long)(millis() - lastContactsCheck) > 15000) || numContacts == 0){
-
-    // Slave communication if not in alarm state
-    if(!inAlarmState()){
+/**
+* Log the SRAM use, and warn whenever the stack has gone deeper than before
+*/
+static void reportMemory(){
+  static unsigned int lowestReported = 0xFFFF;
+  const MemoryStats *memory = memoryScan();
+  if(memory == NULL) return;
+
+  LOG(LOG_MEMORY, memory->freeNow, memory->freeLowest, memory->heapUsed);
+  if(memory->freeLowest < lowestReported){
+    LOG(LOG_MEMORY_LOW, memory->freeLowest);
+    lowestReported = memory->freeLowest;
+  }
+}
 
-      //Load contacts if there is an update, or they have never been loaded
-      if(slaveGetContactsFileChanged() == 1 || numContacts == 0){
-        loadAndValidateContacts();
-        Serial.println(F("Getting Contacts"));
-      }
-      
-      Serial.println(F("Checked for Contact updates"));
+/**
+* I2C sync: fires every 15 seconds or if contacts have never been loaded
+*/
+static void slaveSyncTask(){
+  if (((unsigned long)(millis() - lastContactsCheck) <= 15000) && numContacts != 0){
+    return;
+  }
+  PROFILE(PHASE_SLAVE_SYNC);
 
-      // Get Disabled hours
-      byte hours = slaveGetAlarmDisabledHours();
+  // Slave communication if not in alarm state
+  if(!inAlarmState()){
 
-      // Check for a change
-      if(hours != disabledHours){ 
+    //Load contacts if there is an update, or they have never been loaded.
+    //Queued messages refer to contacts by index, so wait for the outbox to drain.
+    if((slaveGetContactsFileChanged() == 1 || numContacts == 0) && outboxDepth() == 0){
+      loadAndValidateContacts();
+      LOG(LOG_CONTACTS_UPDATED);
+    }
 
-        disabledHours = hours;
+    // Get Disabled hours
+    byte hours = slaveGetAlarmDisabledHours();
 
-        if(disabledHours == 0){
-          // Enable Alarm
-          alarmStatus = 1;
-          alarmDisabledTime = 0;
-          disabledHours = 0;
-        }
-        else if (0 < disabledHours){
-          alarmStatus = 0;      
-          alarmDisabledTime = millis();   
+    // Check for a change
+    if(hours != disabledHours){ 
 
-          Serial.print(F("Alarm disabled for "));
-          Serial.print(disabledHours); 
-          Serial.println(F(" hours"));
+      disabledHours = hours;
 
-          notifyContactsSMS(1, (char*) "Alarm has been disabled.");
-        }
+      if(disabledHours == 0){
+        // Enable Alarm
+        alarmStatus = 1;
+        alarmDisabledTime = 0;
+        disabledHours = 0;
       }
-      
-      Serial.println(F("Checked for Alarm Disable"));      
-    }
+      else if (0 < disabledHours){
+        alarmStatus = 0;      
+        alarmDisabledTime = millis();   
 
-    //Always test cell connectivity and ensure messages are forwarded to the serial output
-    cell.FwdSMS2Serial();
+        LOG(LOG_ALARM_DISABLED, disabledHours);
 
-    Serial.println(F("Completed 15 sec event."));
-    lastContactsCheck = millis();
+        notifyContactsSMS(CONTACT_GROUP(1), MSG_ALARM_DISABLED, disabledHours, 0);
+      }
+    }
   }
 
+  //Always test cell connectivity and ensure messages are forwarded to the serial output.
+  //A command in flight already shows the modem is there, so don't queue behind it.
+  if(!cell.Busy()) cell.FwdSMS2Serial();
 
+  reportMemory();
+  LOG(LOG_SYNC_DONE);
+  lastContactsCheck = millis();
+}
+
+/**
+* Input polling. Runs in the background so inputs are sampled even while
+* a notification is waiting on the modem.
+*/
+static void inputTask(){
   // Only update the inputs if the alarm is enabled
   if(alarmStatus == 1){
     // Read the state of the switches into the state arrays
-    Serial.println(F("Checking inputs.."));
     checkInputs();
   }
-  else{
+}
+
+/**
+* Sound engine: keep the siren going while any input is in alarm
+*/
+static void soundTask(){
+  if (inputStates.pressed) {
+    playAlarmSound();
+  }
+}
+
+/**
+* Profiler dump: 'p' on Serial sends the phase statistics, paced by the
+* TX buffer so the dump never blocks
+*/
+static void profilerTask(){
+  while(Serial.available() > 0){
+    if(Serial.read() == 'p') profileDumpBegin();
+  }
+  profileDumpContinue();
+}
+
+/**
+* Notification dispatcher: act on input transitions flagged by checkInputs()
+* and on ongoing alarms that are due for a reminder
+*/
+static void notificationTask(){
+  PROFILE(PHASE_NOTIFICATIONS);
+
+  if(alarmStatus == 0){
     // Check how much time is left        
     if ((millis() - alarmDisabledTime)/3600000 > disabledHours){
       alarmStatus = 1; 
-      Serial.println(F("Alarm Enabled"));
-      notifyContactsSMS(1, (char *)"Alarm has been automatically enabled.");
+      LOG(LOG_ALARM_ENABLED);
+      notifyContactsSMS(CONTACT_GROUP(1), MSG_ALARM_ENABLED, 0, 0);
     }
-
-    Serial.print(F("Alarm turning on in "));
-    Serial.print(disabledHours - ((unsigned long)(millis() - alarmDisabledTime) / 3600000));
-    Serial.println(F(" hours"));
   }
 
   // Check switch states
   for (byte i = 0; i < NUMINPUTS; i++) {
 
+    InputMask bit = INPUT_BIT(i);
+
     // Handle a new alarm
-    if (justPressed[i]) {
-      Serial.print(i, DEC);
-      Serial.println(" Just pressed"); 
+    if (inputStates.justPressed & bit) {
+      LOG(LOG_INPUT_PRESSED, i, inputs[i]->alarmOnsetTime);
 
       // Set an alarm for the current machine (i)
       slaveSetAlarm(i);
@@ -283,13 +341,12 @@ void loop() {
       inputs[i]->lastNotificationTime = millis();
 
       // Clear the flag
-      justPressed[i] = 0;
+      inputStates.justPressed &= ~bit;
     }
 
     // Handle a cleared alarm
-    if (justReleased[i]) {
-      Serial.print(i, DEC);
-      Serial.println(F(" Just released"));
+    if (inputStates.justReleased & bit) {
+      LOG(LOG_INPUT_RELEASED, i, inputs[i]->alarmClearedTime);
 
       // Clear the alarm for the current machine (i)
       slaveClearAlarm(i);
@@ -299,21 +356,16 @@ void loop() {
       inputs[i]->whoResponded = -1;
 
       // Clear the flag
-      justReleased[i] = 0;
+      inputStates.justReleased &= ~bit;
     }
 
     // Handle an ongoing alarm
-    if (pressed[i]) { 
-      Serial.print(i, DEC);
-      Serial.println(F(" pressed"));
-
-      playAlarmSound();
-
+    if (inputStates.pressed & bit) { 
       // Only notify contacts if no-one has responded
       if(inputs[i]->whoResponded == -1){
         // Check if it is time to notify the contacts again
-        if((unsigned long)(millis() - inputs[i]->lastNotificationTime) >= inputs[i]->notificationInterval){
-          Serial.println(F("Reminding contacts"));
+        if((unsigned long)(millis() - inputs[i]->lastNotificationTime) >= INPUT_NOTIFICATION_INTERVAL(i)){
+          LOG(LOG_INPUT_REMINDER, i);
           notifyContactsAlarmState(i);
           inputs[i]->lastNotificationTime = millis(); 
         }
@@ -324,37 +376,30 @@ void loop() {
 	// been unable to take care of the issue
 
 	
-	  if(((unsigned long) (millis() - TimeResponded) >= AlCallRestartTime) && justPressed[i]==0){
-		Serial.println("Although someone had taken responsibility for attending to the alarm, the alarm is still active 2 hours later. Group 1 will be called again until another person takes responsibility to address the alarm.");
+	  else if(((unsigned long) (millis() - inputs[i]->responseTime) >= AlCallRestartTime) && !(inputStates.justPressed & bit)){
+		LOG(LOG_INPUT_NOT_ADDRESSED, inputs[i]->whoResponded, i);
     
-		notifyContactsAlarmResponse(i); 
+		notifyContactsAlarmStillNotAddressed(i); 
 		
 		// reset the alarm to start from scratch
-		justPressed[i] = 1;
+		inputStates.justPressed |= bit;
 		//clearing the name of the person who had responded last
 		inputs[i]->whoResponded = -1;
 		
 		
 	  }
     }
-	
-	
-
-	
-	
-	
-	
-	
-	
-
   }
 
-  Serial.println(freeRam());
+  // Send the transitions collected over the coalescing window
+  flushAlarmNotifications();
 }
 
-int freeRam () {
-  extern int __heap_start, *__brkval; 
-  int v; 
-  return (int) &v - (__brkval == 0 ? (int) &__heap_start : (int) __brkval); 
+
+void loop() {
+  // Feed the watchdog
+  ResetWatchdog();
+
+  schedulerRun();
 }
 
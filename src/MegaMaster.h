@@ -4,16 +4,64 @@
 extern void loadAndValidateContacts(void);
 extern byte slaveGetSavedAlarmState(void);
 extern void checkInputs(void);
-extern int freeRam (void);
 
 #include "SerialGSM.h"
+#include "Debouncer.h"
 
 // Set the backup contact. They will be alerted if the alarm fails, in addition to group one contacts.
 #define BACKUPCONTACT "16479806182" // Mayan
 
+// Phone numbers are stored and matched as E.164 digits. National numbers get the country code.
+#define PHONE_COUNTRY_CODE "1"
+#define PHONE_NATIONAL_DIGITS 10
+
 
 // Begin Common Code
-#define NUMINPUTS 3
+
+// The alarm inputs, one line each: name (max 12 chars), pin, notification interval in ms
+// and whether someone must respond. The pins must be on one of the sampled ports.
+#define INPUT_TABLE(X) \
+  X("Shandon TP",   49, 420000,   true)   /* 7 Minutes */ \
+  X("Pathos Delta", 51, 420000,   true)   /* 7 Minutes */ \
+  X("Lab Power",    53, 21600000, false)  /* 6 Hours */
+
+#define INPUT_COUNT_ONE(label, pin, interval, response) + 1
+#define NUMINPUTS (0 INPUT_TABLE(INPUT_COUNT_ONE))
+
+// Input pins must be on one of the sampled ports (see InputCapture.cpp).
+// Each port provides 8 lanes of the input masks.
+#define INPUT_PORT_COUNT 4
+#if INPUT_PORT_COUNT <= 1
+typedef uint8_t InputMask;
+#define pgm_read_mask(addr) pgm_read_byte(addr)
+#elif INPUT_PORT_COUNT <= 2
+typedef uint16_t InputMask;
+#define pgm_read_mask(addr) pgm_read_word(addr)
+#elif INPUT_PORT_COUNT <= 4
+typedef uint32_t InputMask;
+#define pgm_read_mask(addr) pgm_read_dword(addr)
+#else
+typedef uint64_t InputMask;
+#define pgm_read_mask(addr) (pgm_read_dword(addr) | (uint64_t)pgm_read_dword((const byte *)(addr) + 4) << 32)
+#endif
+#define INPUT_NO_LANE 255
+
+/**
+* Lane of an Arduino Mega pin on the sampled ports A, C, L and B, in the
+* order InputCapture.cpp reads them. Evaluated at compile time for the
+* input table.
+*
+* Returns:
+*   -The lane, or INPUT_NO_LANE if the pin is not on a sampled port
+*/
+constexpr byte inputPinLane(byte pin){
+  return (pin >= 22 && pin <= 29) ? pin - 22            // PA0-PA7
+       : (pin >= 30 && pin <= 37) ? 8 + (37 - pin)      // PC7-PC0
+       : (pin >= 42 && pin <= 49) ? 16 + (49 - pin)     // PL7-PL0
+       : (pin >= 50 && pin <= 53) ? 24 + (53 - pin)     // PB3-PB0
+       : (pin >= 10 && pin <= 13) ? 24 + 4 + (pin - 10) // PB4-PB7
+       : INPUT_NO_LANE;
+}
 
 // Wire Communication Codes
 #define COMM_TYPE_REQUEST 30
@@ -28,6 +76,29 @@ extern int freeRam (void);
 #define REQUEST_ID_STATUS 34
 #define REQUEST_ID_ALARMDISABLEHOURS 35
 #define REQUEST_ID_ALARMSTATE 36
+#define REQUEST_ID_CONTACTS_INFO 37
+#define REQUEST_ID_CONTACTS_CHUNK 38
+#define REQUEST_ID_CONTACTS_HASHES 39
+#define REQUEST_ID_CONTACTS_RECORD 40
+
+// Block transfer of the contacts file (protocol v2). Multi-byte values are little-endian.
+// CONTACTS_INFO reply: version, file length (2 bytes), record count, file CRC32 (4 bytes).
+//   A slave still opening the file replies CONTACTS_STATUS_BUSY instead of the version.
+// CONTACTS_CHUNK request: chunk number. Reply: chunk number, 30 file bytes
+//   (zero padded after the end of the file), CRC-8 of the previous 31 bytes.
+#define CONTACTS_PROTOCOL_VERSION 2
+#define CONTACTS_STATUS_BUSY 0
+#define CONTACTS_INFO_SIZE 8
+#define CONTACTS_CHUNK_SIZE 32
+#define CONTACTS_CHUNK_PAYLOAD 30
+#define CONTACTS_CHUNK_RETRIES 5
+// CONTACTS_HASHES request: first record. Reply: first record, record count, CRC32 of
+//   up to 7 records (zero after the last record), CRC-8 of the previous 30 bytes.
+//   The CRC32 of a record covers its line of the file, newline included.
+// CONTACTS_RECORD request: record, part. Reply: same as a chunk, with part as the
+//   chunk number and the record's line as the file.
+#define CONTACTS_HASHES_PER_REPLY 7
+#define CONTACTS_HASHES_SIZE 31
 
 #define I2C_STATUS_IDLE 255
 
@@ -47,38 +118,98 @@ extern byte alarmStatus;
 
 // Begin Contacts variables
 #define CONTACTS_MAX_NUMBER 12
+
+// A set of contacts, bit n for contacts[n]
+#if CONTACTS_MAX_NUMBER <= 8
+typedef uint8_t ContactSet;
+#elif CONTACTS_MAX_NUMBER <= 16
+typedef uint16_t ContactSet;
+#elif CONTACTS_MAX_NUMBER <= 32
+typedef uint32_t ContactSet;
+#else
+typedef uint64_t ContactSet;
+#endif
+
+// Contact groups are the digits 0-9. A set of groups has bit n set for group n.
+#define CONTACT_GROUPS 10
+#define CONTACT_GROUP(n) ((uint16_t)1 << (n))
 extern SerialGSM cell;
 extern int cellStatus;
-extern boolean gotSMS;
-extern char lastSMS[160];
-extern char smsSender[13];
 extern int numTimeouts;
 // End Cellular Variables
 
-class Contact
+// Shared storage for the names of all contacts (see ContactRecord.cpp). Sized for
+// the longest name the parser accepts on every line, so no name is ever cut.
+#define CONTACTS_NAME_POOL_SIZE (CONTACTS_MAX_NUMBER * CONTACT_NAME_SIZE)
+
+// Field sizes of a line of the contacts file, terminator included
+#define CONTACT_GROUPS_SIZE (CONTACT_GROUPS + 1)   //One digit per group
+#define CONTACT_NAME_SIZE 9     //Max  9-1= 8 chars
+#define CONTACT_EMAIL_SIZE 39   //Max 39-1= 38 chars
+#define CONTACT_PHONE_SIZE 12   //Max 12-1= 11 chars
+#define CONTACT_RING_SIZE 4     //Max  4-1=  3 digits, seconds up to 255
+#define CONTACT_PHONE_BCD ((CONTACT_PHONE_SIZE - 1 + 1) / 2)
+
+// A line of the contacts file as text, while it is parsed
+class ContactText
 {
 public:
-  byte group;
-  char name[9];    //Max  9-1= 8 chars
-  char email[39];  //Max 39-1= 38 chars
-  char phone[12];  //Max 12-1= 11 chars
+  char groups[CONTACT_GROUPS_SIZE];
+  char name[CONTACT_NAME_SIZE];
+  char email[CONTACT_EMAIL_SIZE];
+  char phone[CONTACT_PHONE_SIZE];
+  char ringTime[CONTACT_RING_SIZE];   //Empty if the line has no ring time
+  uint32_t hash;   //CRC32 of the line in the contacts file
 };
 
+// A loaded contact. The phone is packed BCD, the name is in the name pool and
+// the email stays on the slave, as nothing on the master uses it.
+class Contact
+{
+public:
+  uint16_t groups;                //Bit n set for group n
+  byte phoneDigits;
+  byte phone[CONTACT_PHONE_BCD];  //Two digits per byte, first digit in the high nibble
+  byte nameOffset;                //Start of the name in the name pool
+  byte ringTime;                  //Seconds to let a call ring, 0 for OUTBOX_CALL_RING_TIME
+  uint32_t hash;                  //CRC32 of the line in the contacts file
+};
 
 extern Contact *contacts[CONTACTS_MAX_NUMBER];
 // End Contacts variables
-// Class to represent a machine input
-class Input
+// Fixed configuration of a machine input, generated from INPUT_TABLE and kept in flash
+class InputConfig
 {
 public:
   char name[13];   //Max 13-1= 12 chars
   byte pin;
-  unsigned long notificationInterval;
-  unsigned long lastNotificationTime; 
+  InputMask bit;   //Bit of the input masks sampled from this pin
+  uint32_t notificationInterval;
   boolean requiresResponse;
+};
+extern const InputConfig inputConfig[NUMINPUTS] PROGMEM;
+
+// Runtime state of a machine input
+class Input
+{
+public:
+  unsigned long lastNotificationTime; 
   char whoResponded;  //The contact who has taken responsibility for this alarm
+  unsigned long responseTime; //When whoResponded took responsibility
+  unsigned long alarmOnsetTime;   //Time of the edge that started the last alarm
+  unsigned long alarmClearedTime; //Time of the edge that ended it
 };
 extern Input *inputs[NUMINPUTS];
+
+// Readers for the configuration of input i
+#define INPUT_BIT(i) ((InputMask)pgm_read_mask(&inputConfig[i].bit))
+#define INPUT_PIN(i) pgm_read_byte(&inputConfig[i].pin)
+#define INPUT_NOTIFICATION_INTERVAL(i) ((unsigned long)pgm_read_dword(&inputConfig[i].notificationInterval))
+#define INPUT_REQUIRES_RESPONSE(i) ((boolean)pgm_read_byte(&inputConfig[i].requiresResponse))
+
+// Lanes connected to any input
+#define INPUT_LANE_BIT(label, pin, interval, response) | ((InputMask)1 << inputPinLane(pin))
+#define INPUT_LANES ((InputMask)0 INPUT_TABLE(INPUT_LANE_BIT))
 //End Monitoring Variables
 
 
@@ -91,9 +222,6 @@ extern boolean wireFailureResponse;
 
 extern byte numContacts;
 
-extern byte previousState[NUMINPUTS];
-extern byte currentState[NUMINPUTS];
-extern long lastTime;
 
 extern long lastContactsCheck;
 
@@ -101,10 +229,13 @@ extern unsigned long alarmDisabledTime;
 extern byte disabledHours;
 
 
-extern byte pressed[NUMINPUTS], justPressed[NUMINPUTS], justReleased[NUMINPUTS];
+// Debounced pressed/justPressed/justReleased masks of all inputs
+extern Debouncer<InputMask> inputStates;
 
 // Begin Monitoring Variables
 #define DEBOUNCE 50
+// Alarm transitions closer together than this are sent as one digest
+#define NOTIFY_COALESCE_WINDOW 10000
 
 
 #endif
\ No newline at end of file
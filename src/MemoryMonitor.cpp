@@ -0,0 +1,77 @@
+/*
+  Memory Monitor
+
+  Stack painting and the scan for the stack high-water mark. The simulator
+  has no AVR heap/stack layout to measure.
+*/
+#include <Arduino.h>
+#include "MemoryMonitor.h"
+
+#ifdef __AVR__
+static MemoryStats stats;
+
+extern uint8_t _end;
+extern uint8_t __stack;
+extern uint8_t __heap_start;
+extern uint8_t *__brkval;
+
+/**
+* Fill the free SRAM, from the end of .bss to the top of the stack, with
+* the canary. Placed in .init3, after the stack pointer is set up and before
+* the static constructors, with nothing on the stack yet. Naked, so it has
+* no frame of its own, and written in assembly as that is all GCC supports
+* in a naked function.
+*/
+void memoryPaintStack(void) __attribute__((naked, used, section(".init3")));
+void memoryPaintStack(void){
+  __asm__ volatile(
+    "    ldi r30, lo8(_end)\n"
+    "    ldi r31, hi8(_end)\n"
+    "    ldi r24, %0\n"
+    "    ldi r25, hi8(__stack)\n"
+    "    rjmp 2f\n"
+    "1:  st Z+, r24\n"
+    "2:  cpi r30, lo8(__stack)\n"
+    "    cpc r31, r25\n"
+    "    brlo 1b\n"
+    "    breq 1b\n"
+    :: "M" (STACK_CANARY));
+}
+
+static uint8_t *heapTop(){
+  return __brkval == 0 ? &__heap_start : __brkval;
+}
+#endif
+
+int freeRam () {
+#ifdef __AVR__
+  uint8_t v;
+  return (int) &v - (int) heapTop();
+#else
+  return 0;
+#endif
+}
+
+/**
+* Measure the SRAM use. Counting the canary bytes above the heap takes
+* about a microsecond per free byte.
+*
+* Returns:
+*   -The current and lowest free SRAM and the heap size, or NULL in the
+*    simulator
+*/
+const MemoryStats *memoryScan(){
+#ifdef __AVR__
+  uint8_t *top = heapTop();
+  uint8_t *stackPointer = (uint8_t *)SP;
+  unsigned int painted = 0;
+  while(top + painted < stackPointer && top[painted] == STACK_CANARY) painted++;
+
+  stats.freeNow = freeRam();
+  stats.freeLowest = painted;
+  stats.heapUsed = top - &__heap_start;
+  return &stats;
+#else
+  return NULL;
+#endif
+}
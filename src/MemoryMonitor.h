@@ -0,0 +1,26 @@
+#ifndef MEM_H
+#define MEM_H
+/*
+  Memory Monitor
+
+  SRAM telemetry. freeRam() only sees the gap between heap and stack at the
+  moment it is called, so the free SRAM is also tracked since reset: the
+  space above the heap is painted with STACK_CANARY before main() runs, and
+  memoryScan() counts the painted bytes the stack has never reached.
+
+  The worst-case stack depth of each call path is computed at build time
+  instead, from -fstack-usage (see scripts/stack_usage.py).
+*/
+
+#define STACK_CANARY 0xC5
+
+struct MemoryStats
+{
+  int freeNow;                // Between the heap and the stack right now
+  unsigned int freeLowest;    // Never touched by the stack since reset
+  unsigned int heapUsed;
+};
+
+extern int freeRam(void);
+extern const MemoryStats *memoryScan(void);
+#endif
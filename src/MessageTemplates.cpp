@@ -0,0 +1,163 @@
+/*
+  Message Templates
+
+  Format strings and renderer for the queued SMS messages. See
+  MessageTemplates.h for the placeholders.
+*/
+#include <Arduino.h>
+#include "SerialGSM.h"
+#include "MegaMaster.h"
+#include "ContactRecord.h"
+#include "Outbox.h"
+#include "MessageTemplates.h"
+
+// Begin Templates
+static const char tplAlarmEntered[] PROGMEM = "The %i0 is in an alarm state.%b0";
+static const char tplAlarmStill[] PROGMEM = "The %i0 is still in an alarm state.%b0";
+static const char tplAlarmCleared[] PROGMEM = "The %i0 alarm has been cleared. The messages will now cease.";
+static const char tplAlarmResponse[] PROGMEM = "%c1 is responding to the %i0 alarm.";
+static const char tplNotAddressed1[] PROGMEM = "%c1 has not addressed the %i0 alarm from 2 hours ago. The alarm has been reset, so please standby.";
+static const char tplNotAddressed2[] PROGMEM = "%c1 has not addressed the %i0 alarm from 2 hours ago. The alarm has been reset.";
+static const char tplAlarmDisabled[] PROGMEM = "Alarm has been disabled for %n0 hours.";
+static const char tplAlarmEnabled[] PROGMEM = "Alarm has been automatically enabled.";
+static const char tplI2CFailed[] PROGMEM = "Master -> Slave I2C has failed. Reply with 'IKNOW' to stop these updates. Status: %n0";
+static const char tplI2CRestored[] PROGMEM = "Master -> Slave I2C has sucessfully restarted.";
+static const char tplI2CResponse[] PROGMEM = "%c0 is responding to the I2C error";
+static const char tplAlarmDigest[] PROGMEM = "%?0%l0 in alarm.%;%?1%?0 %;%l1 cleared.%;%B0";
+
+static const char birloffRequest[] PROGMEM = " Please reply with 'BIRLOFF' if you are responding.";
+
+// Indexed by MSG_ id - 1
+static const char *const templates[] PROGMEM = {
+  tplAlarmEntered,    // MSG_ALARM_ENTERED
+  tplAlarmStill,      // MSG_ALARM_STILL
+  tplAlarmCleared,    // MSG_ALARM_CLEARED
+  tplAlarmResponse,   // MSG_ALARM_RESPONSE
+  tplNotAddressed1,   // MSG_NOT_ADDRESSED_1
+  tplNotAddressed2,   // MSG_NOT_ADDRESSED_2
+  tplAlarmDisabled,   // MSG_ALARM_DISABLED
+  tplAlarmEnabled,    // MSG_ALARM_ENABLED
+  tplI2CFailed,       // MSG_I2C_FAILED
+  tplI2CRestored,     // MSG_I2C_RESTORED
+  tplI2CResponse,     // MSG_I2C_RESPONSE
+  tplAlarmDigest,     // MSG_ALARM_DIGEST
+};
+static_assert(sizeof(templates) / sizeof(templates[0]) == MSG_ALARM_DIGEST,
+              "There must be one template per MSG_ id");
+// End Templates
+
+// Begin Message Writer
+MessageWriter::MessageWriter(char *buffer, byte size) : buffer(buffer), size(size), used(0){
+}
+
+void MessageWriter::put(char c){
+  if(used + 1 < size) buffer[used++] = c;
+}
+
+/**
+* Terminate the text once it is complete
+*/
+void MessageWriter::end(){
+  buffer[used] = '\0';
+}
+
+void MessageWriter::print(const char *text){
+  while(*text) put(*text++);
+}
+
+/**
+* Append a string stored in flash
+*/
+void MessageWriter::printFlash(const char *text){
+  char c;
+  while((c = pgm_read_byte(text++)) != '\0') put(c);
+}
+
+void MessageWriter::printNumber(unsigned int value){
+  char digits[5];
+  byte count = 0;
+  do{
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  } while(value > 0);
+  while(count > 0) put(digits[--count]);
+}
+// End Message Writer
+
+/**
+* The names of a set of inputs, separated by commas
+*/
+static void printInputNames(MessageWriter *out, byte inputSet){
+  boolean first = true;
+  for(byte i = 0; i < NUMINPUTS; i++){
+    if(!(inputSet & (1 << i))) continue;
+    if(!first) out->print(", ");
+    out->printFlash(inputConfig[i].name);
+    first = false;
+  }
+}
+
+/**
+* Ask the recipient to reply with BIRLOFF if one of the inputs needs a response
+*/
+static void printBirloffRequest(MessageWriter *out, byte inputSet){
+  for(byte i = 0; i < NUMINPUTS; i++){
+    if((inputSet & (1 << i)) && INPUT_REQUIRES_RESPONSE(i)){
+      out->printFlash(birloffRequest);
+      return;
+    }
+  }
+}
+
+/**
+* Build the text of a queued message
+* templateId: The MSG_ template
+* args: The template arguments
+* message: Buffer for the text, null terminated on return
+* msgSize: Size of the buffer
+*/
+void renderMessage(byte templateId, const byte *args, char *message, byte msgSize){
+  MessageWriter out(message, msgSize);
+  if(templateId == 0 || templateId > sizeof(templates) / sizeof(templates[0])){
+    out.end();
+    return;
+  }
+
+  const char *format = (const char *)pgm_read_ptr(&templates[templateId - 1]);
+  byte skipping = 0;   // Depth of the %? sections being left out
+  char c;
+
+  while((c = pgm_read_byte(format++)) != '\0'){
+    if(c != '%'){
+      if(!skipping) out.put(c);
+      continue;
+    }
+
+    char type = pgm_read_byte(format++);
+    if(type == '%'){
+      if(!skipping) out.put('%');
+      continue;
+    }
+    if(type == ';'){
+      if(skipping) skipping--;
+      continue;
+    }
+
+    byte arg = args[pgm_read_byte(format++) - '0'];
+    if(type == '?'){
+      if(skipping || arg == 0) skipping++;
+      continue;
+    }
+    if(skipping) continue;
+
+    switch(type){
+      case 'i': out.printFlash(inputConfig[arg].name); break;
+      case 'l': printInputNames(&out, arg); break;
+      case 'c': out.print(contactName(arg)); break;
+      case 'n': out.printNumber(arg); break;
+      case 'b': printBirloffRequest(&out, 1 << arg); break;
+      case 'B': printBirloffRequest(&out, arg); break;
+    }
+  }
+  out.end();
+}
@@ -0,0 +1,37 @@
+#ifndef MT_H
+#define MT_H
+/*
+  Message Templates
+
+  The text of every SMS, stored in flash as a format string per MSG_ id
+  (see Outbox.h) and rendered in one pass when the message is sent.
+  Placeholders take the template argument n (0 or 1):
+    %in  Name of input n          %ln  Names of the inputs in set n
+    %cn  Name of contact n        %nn  n as a decimal number
+    %bn  BIRLOFF request if input n requires a response
+    %Bn  BIRLOFF request if an input in set n requires a response
+    %?n ... %;  Only rendered if n is not 0 (may be nested)
+    %%   A percent sign
+*/
+
+// Appends to a fixed buffer, keeping the write position so nothing has to be
+// rescanned. Text that does not fit is dropped. end() adds the terminator.
+class MessageWriter
+{
+public:
+  MessageWriter(char *buffer, byte size);
+  void put(char c);
+  void print(const char *text);
+  void printFlash(const char *text);
+  void printNumber(unsigned int value);
+  void end(void);
+  byte length(void) const { return used; }
+
+private:
+  char *buffer;
+  byte size;
+  byte used;
+};
+
+extern void renderMessage(byte, const byte *, char *, byte);
+#endif
@@ -0,0 +1,147 @@
+/*
+  Modem UART
+
+  Ring buffered USART driver for the GSM shield. Each ring has a single
+  producer and a single consumer that only write their own index, as in
+  InputCapture. The indices are single bytes, so the main loop only turns
+  interrupts off around the read-modify-write of the control register.
+
+  Bit positions are the same in all the USARTs, so the USART0 names are
+  used for every port, as in the Arduino core.
+*/
+#include <Arduino.h>
+#include "ModemUart.h"
+
+static_assert(MODEM_RX_BUFFER_SIZE <= 256 && (MODEM_RX_BUFFER_SIZE & (MODEM_RX_BUFFER_SIZE - 1)) == 0,
+              "MODEM_RX_BUFFER_SIZE must be a power of two up to 256");
+static_assert(MODEM_TX_BUFFER_SIZE <= 256 && (MODEM_TX_BUFFER_SIZE & (MODEM_TX_BUFFER_SIZE - 1)) == 0,
+              "MODEM_TX_BUFFER_SIZE must be a power of two up to 256");
+
+// Registers and vectors of the USART selected by MODEM_UART
+#define MODEM_PASTE_(prefix, n, suffix) prefix##n##suffix
+#define MODEM_PASTE(prefix, n, suffix) MODEM_PASTE_(prefix, n, suffix)
+#define MODEM_REGISTER(prefix, suffix) MODEM_PASTE(prefix, MODEM_UART, suffix)
+#define MODEM_UDR MODEM_REGISTER(UDR, )
+#define MODEM_UCSRA MODEM_REGISTER(UCSR, A)
+#define MODEM_UCSRB MODEM_REGISTER(UCSR, B)
+#define MODEM_UCSRC MODEM_REGISTER(UCSR, C)
+#define MODEM_UBRR MODEM_REGISTER(UBRR, )
+#define MODEM_RX_VECTOR MODEM_REGISTER(USART, _RX_vect)
+#define MODEM_UDRE_VECTOR MODEM_REGISTER(USART, _UDRE_vect)
+
+ModemUart modemSerial;
+
+// Begin Receive Ring
+static byte rxBuffer[MODEM_RX_BUFFER_SIZE];
+static volatile byte rxHead = 0;
+static volatile byte rxTail = 0;
+// End Receive Ring
+
+// Begin Transmit Ring
+static byte txBuffer[MODEM_TX_BUFFER_SIZE];
+static volatile byte txHead = 0;
+static volatile byte txTail = 0;
+// End Transmit Ring
+
+// Updated by the interrupts, copied with interrupts off
+static volatile ModemUartStats stats;
+
+ISR(MODEM_RX_VECTOR){
+  // The error flags belong to the byte in UDR and must be read first
+  byte status = MODEM_UCSRA;
+  byte c = MODEM_UDR;
+  stats.rxBytes++;
+
+  if(status & _BV(FE0)){
+    stats.framingErrors++;
+    return;
+  }
+  if(status & _BV(DOR0)) stats.dataOverruns++;
+
+  byte head = rxHead;
+  byte next = (head + 1) & (MODEM_RX_BUFFER_SIZE - 1);
+  if(next == rxTail){
+    stats.rxOverruns++;
+    return;
+  }
+  rxBuffer[head] = c;
+  rxHead = next;
+
+  byte waiting = (byte)(next - rxTail) & (MODEM_RX_BUFFER_SIZE - 1);
+  if(waiting > stats.rxHighWater) stats.rxHighWater = waiting;
+}
+
+ISR(MODEM_UDRE_VECTOR){
+  byte tail = txTail;
+  MODEM_UDR = txBuffer[tail];
+  tail = (tail + 1) & (MODEM_TX_BUFFER_SIZE - 1);
+  txTail = tail;
+  stats.txBytes++;
+
+  if(tail == txHead) MODEM_UCSRB &= ~_BV(UDRIE0);
+}
+
+/**
+* Start the USART at 8N1
+* baud: Bits per second. The modem detects it from the first AT.
+*/
+void ModemUart::begin(unsigned long baud){
+  // Double speed halves the rounding error of the divider
+  MODEM_UCSRA = _BV(U2X0);
+  MODEM_UBRR = (F_CPU / 4 / baud - 1) / 2;
+  MODEM_UCSRC = _BV(UCSZ01) | _BV(UCSZ00);
+  MODEM_UCSRB = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
+}
+
+int ModemUart::available(){
+  return (byte)(rxHead - rxTail) & (MODEM_RX_BUFFER_SIZE - 1);
+}
+
+int ModemUart::peek(){
+  byte tail = rxTail;
+  return tail == rxHead ? -1 : rxBuffer[tail];
+}
+
+int ModemUart::read(){
+  byte tail = rxTail;
+  if(tail == rxHead) return -1;
+
+  byte c = rxBuffer[tail];
+  rxTail = (tail + 1) & (MODEM_RX_BUFFER_SIZE - 1);
+  return c;
+}
+
+/**
+* Queue a byte for sending. Only waits when the TX ring is full, which
+* needs interrupts to be on.
+*/
+size_t ModemUart::write(uint8_t c){
+  byte head = txHead;
+  byte next = (head + 1) & (MODEM_TX_BUFFER_SIZE - 1);
+  while(next == txTail) delayMicroseconds(10);
+
+  txBuffer[head] = c;
+  cli();
+  txHead = next;
+  MODEM_UCSRB |= _BV(UDRIE0);
+  sei();
+  return 1;
+}
+
+/**
+* Wait until the TX ring has been handed to the USART
+*/
+void ModemUart::flush(){
+  while(txHead != txTail) delayMicroseconds(10);
+}
+
+void ModemUart::getStats(ModemUartStats *copy){
+  cli();
+  copy->rxBytes = stats.rxBytes;
+  copy->txBytes = stats.txBytes;
+  copy->rxOverruns = stats.rxOverruns;
+  copy->dataOverruns = stats.dataOverruns;
+  copy->framingErrors = stats.framingErrors;
+  copy->rxHighWater = stats.rxHighWater;
+  sei();
+}
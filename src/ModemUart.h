@@ -0,0 +1,49 @@
+#ifndef MODEM_UART_H
+#define MODEM_UART_H
+/*
+  Modem UART
+
+  Interrupt-driven driver for the hardware USART wired to the GSM shield.
+  Received bytes go into a ring buffer from the RX interrupt and written
+  bytes leave from a ring buffer through the data register empty interrupt,
+  so neither direction needs the main loop to keep pace byte by byte.
+*/
+
+// USART of the modem: 1, 2 or 3 (the pins of Serial1/2/3). The core's
+// Serial1/2/3 object of the same number must not be used as well, as it
+// defines the same interrupts.
+#ifndef MODEM_UART
+#define MODEM_UART 1
+#endif
+#define MODEM_BAUD 115200
+
+// Ring sizes, powers of two up to 256. A +CMT notification is a header line
+// of up to about 70 characters and 160 characters of text with line ends.
+#define MODEM_RX_BUFFER_SIZE 256
+#define MODEM_TX_BUFFER_SIZE 256
+
+struct ModemUartStats
+{
+  unsigned long rxBytes;        // Received by the USART, lost ones included
+  unsigned long txBytes;
+  unsigned int rxOverruns;      // Dropped because the RX ring was full
+  unsigned int dataOverruns;    // Lost by the USART before the interrupt ran
+  unsigned int framingErrors;
+  byte rxHighWater;             // Most bytes waiting in the RX ring
+};
+
+class ModemUart : public Stream
+{
+public:
+  void begin(unsigned long baud);
+  virtual int available();
+  virtual int read();
+  virtual int peek();
+  virtual void flush();
+  virtual size_t write(uint8_t);
+  using Print::write;
+  void getStats(ModemUartStats *);
+};
+
+extern ModemUart modemSerial;
+#endif
@@ -1,5 +1,5 @@
 /*
-  Slave Communication Functions
+  Monitoring Functions
   
   Provides functions used to monitor alarm inputs.
   Used:  http://www.adafruit.com/blog/2009/10/20/example-code-for-multi-button-checker-with-debouncing/
@@ -7,56 +7,90 @@
 #include <Arduino.h>
 #include "SlaveCommunicationsFunctions.h"
 #include "GSMFunctions.h"
-#include "GSMSoftwareSerial.h"
 #include "SerialGSM.h"
 #include "DiagnosticFunctions.h"
 #include "MegaMaster.h"
 #include "ContactManagementFunctions.h"
 
 #include "MonitoringFunctions.h"
+#include "InputCapture.h"
+#include "Profiler.h"
+
+// Begin Debounce State
+Debouncer<InputMask> inputStates;
+static unsigned long lastEdge[NUMINPUTS];   // Time of the last edge on each input
+static unsigned int handledOverruns = 0;
+// End Debounce State
 
 /**
-* Read switch input values and updates the status arrays (justPressed, justReleased, pressed)
-* Also handles debouncing of inputs.
+* Configure the input pins (with pull-up resistors on switch pins) and start
+* capturing their edges
 */
-void checkInputs(){
-  
-  // Handle rollover properly
-  if ((unsigned long)(millis() - lastTime) < DEBOUNCE){
-    // Not enough time has passed to debounce
-    return; 
+void beginInputs(){
+  for (byte i = 0; i < NUMINPUTS; i++) {
+    pinMode(INPUT_PIN(i), INPUT_PULLUP);
+    lastEdge[i] = millis();
   }
 
-  // DEBOUNCE milliseconds have passed, reset the timer
-  lastTime = millis();
+  inputCaptureBegin(INPUT_LANES);
+  inputStates.begin(inputCaptureLevels(), millis(), DEBOUNCE);
+}
 
-  // Loop over all the buttons
-  for (byte index = 0; index < NUMINPUTS; index++) {
+/**
+* Record the time of an edge on each input it touches
+*/
+static void stampEdges(InputMask changed, unsigned long time){
+  for (byte i = 0; changed != 0 && i < NUMINPUTS; i++) {
+    if (changed & INPUT_BIT(i)) {
+      lastEdge[i] = time;
+      changed &= ~INPUT_BIT(i);
+    }
+  }
+}
 
-    // Clear all previous flags
-    justPressed[index] = 0;
-    justReleased[index] = 0;
+/**
+* Copy the time of the edge that started the new state of each input that
+* has just changed state
+*/
+static void stampTransitions(InputMask changed){
+  for (byte i = 0; changed != 0 && i < NUMINPUTS; i++) {
+    if (!(changed & INPUT_BIT(i))) continue;
 
-    // Get the current state
-    currentState[index] = digitalRead(inputs[index]->pin);
+    if (inputStates.pressed & INPUT_BIT(i)) inputs[i]->alarmOnsetTime = lastEdge[i];
+    else inputs[i]->alarmClearedTime = lastEdge[i];
+    changed &= ~INPUT_BIT(i);
+  }
+}
 
-    if (currentState[index] == previousState[index]) {
-      if ((pressed[index] == LOW) && (currentState[index] == LOW)) {
-        // Button has just been pressed
-        justPressed[index] = 1;
-      }
-      else if ((pressed[index] == HIGH) && (currentState[index] == HIGH)) {
-        // Button has just been released
-        justReleased[index] = 1;
-      }
+/**
+* Drain the captured edges into the debouncer, which updates the pressed,
+* justPressed and justReleased masks of all inputs at once.
+* A state that lasted longer than two DEBOUNCE windows is reported even if
+* it ended before this call.
+* justPressed and justReleased are latched until the notification task has
+* handled them, as inputs are also sampled while that task is busy.
+*/
+void checkInputs(){
+  PROFILE(PHASE_INPUTS);
+  InputEdge edge;
 
-      // This is a pullup, digital HIGH means NOT pressed
-      pressed[index] = !currentState[index];
-    }
+  while (inputCapturePop(&edge)) {
+    InputMask edgeLanes = inputStates.raw ^ edge.levels;
+    stampTransitions(inputStates.edge(edge.time, edge.levels));
+    stampEdges(edgeLanes, edge.time);
+  }
 
-    // Keep a running tally of the inputs
-    previousState[index] = currentState[index];
+  // Edges were dropped: resynchronize with the sampled levels
+  unsigned int overruns = inputCaptureOverruns();
+  if (overruns != handledOverruns) {
+    handledOverruns = overruns;
+    InputMask levels = inputCaptureLevels();
+    InputMask edgeLanes = inputStates.raw ^ levels;
+    stampTransitions(inputStates.edge(millis(), levels));
+    stampEdges(edgeLanes, millis());
   }
+
+  stampTransitions(inputStates.advance(millis()));
 }
 
 /**
@@ -64,10 +98,5 @@ void checkInputs(){
 * Returns: true or false
 */
 boolean inAlarmState(){
-  for (byte i = 0; i < NUMINPUTS; i++){
-    if (justPressed[i] || pressed[i] || justReleased[i]){
-      return true;
-    }
-  }
-  return false;
+  return (inputStates.pressed | inputStates.justPressed | inputStates.justReleased) != 0;
 }
@@ -1,5 +1,6 @@
 #ifndef MF_H
 #define MF_H
+extern void beginInputs(void);
 extern void checkInputs(void);
 extern boolean inAlarmState(void);
 #endif
\ No newline at end of file
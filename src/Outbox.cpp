@@ -0,0 +1,305 @@
+/*
+  Outbox
+
+  Sends queued notifications through the GSM shield without holding up the
+  rest of the alarm. outboxTask() runs as a scheduler task and starts at
+  most one modem command per run: one SMS, one dial or one hang up. The
+  result arrives while the GSM task polls the modem and is acted on by a
+  later run, so the outbox never waits for the network. A call is left
+  ringing across runs and hung up once it is answered, times out or nobody
+  needs to be called any more.
+
+  Call progress comes from the call state reports of the modem, so a call
+  that is rejected, busy or not answered makes way for the next one as soon
+  as the network ends it, without the pause after a live call. The ring time
+  of each contact runs from when the far end starts ringing.
+
+  Failed transactions are retried after OUTBOX_RETRY_DELAY, doubled with
+  each attempt. After OUTBOX_MAX_ATTEMPTS the message is given up and the
+  shield is reset, as trySendSMS() used to do.
+*/
+#include <Arduino.h>
+#include "SerialGSM.h"
+#include "MegaMaster.h"
+#include "ContactManagementFunctions.h"
+#include "DiagnosticFunctions.h"
+#include "Outbox.h"
+#include "MessageTemplates.h"
+#include "ContactRecord.h"
+#include "Log.h"
+#include "Profiler.h"
+
+// Driver states
+#define OUTBOX_IDLE 0
+#define OUTBOX_RINGING 1
+#define OUTBOX_PAUSE 2
+#define OUTBOX_WAITING 3     // A command is in flight
+
+// Begin Queue
+static OutboxMessage queue[OUTBOX_SIZE];
+static byte depth = 0;
+static OutboxStats stats = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFFFFFFFF, 0, 0};
+// End Queue
+
+// Begin Driver State
+static byte state = OUTBOX_IDLE;
+static unsigned long stateTime = 0;
+static byte ringingInputs = 0;
+static unsigned long ringTime = 0;   // Of the contact being called, in ms
+static boolean alerting = false;     // The far end has started ringing
+static boolean callLive = false;     // Hanging up a call the network has not ended
+static unsigned long callStarted = 0;   // When the modem placed the call
+// End Driver State
+
+// Begin Command In Flight
+static byte activeCommand = GSM_CMD_NONE;
+static byte activeMessage = 0;       // Queue index of the SMS or call being sent
+static byte commandResult = GSM_RESULT_PENDING;
+static char smsText[OUTBOX_TEXT_SIZE];   // The modem reads it at the AT+CMGS prompt
+// End Command In Flight
+
+/**
+* Queue an SMS or a call
+* kind: OUTBOX_SMS or OUTBOX_CALL
+* contact: Index of the recipient in contacts
+* templateId: The MSG_ template of an SMS
+* arg0, arg1: Template arguments. For a call, arg0 has bit n set for each input n in alarm.
+*
+* Returns:
+*   -false if the queue is full and the message was dropped
+*/
+boolean outboxEnqueue(byte kind, byte contact, byte templateId, byte arg0, byte arg1){
+  if(depth == OUTBOX_SIZE){
+    LOG(LOG_OUTBOX_FULL);
+    stats.dropped++;
+    return false;
+  }
+
+  OutboxMessage *message = &queue[depth++];
+  message->kind = kind;
+  message->contact = contact;
+  message->templateId = templateId;
+  message->args[0] = arg0;
+  message->args[1] = arg1;
+  message->attempts = 0;
+  message->enqueuedAt = millis();
+  message->notBefore = message->enqueuedAt;
+
+  if(depth > stats.maxDepth) stats.maxDepth = depth;
+  return true;
+}
+
+/**
+* Number of messages waiting to be sent
+*/
+byte outboxDepth(){
+  return depth;
+}
+
+const OutboxStats *outboxGetStats(){
+  return &stats;
+}
+
+static void removeMessage(byte index){
+  memmove(&queue[index], &queue[index + 1], (depth - index - 1) * sizeof(OutboxMessage));
+  depth--;
+}
+
+static void completeMessage(byte index){
+  unsigned long latency = millis() - queue[index].enqueuedAt;
+
+  stats.sent++;
+  stats.totalLatency += latency;
+  if(latency < stats.minLatency) stats.minLatency = latency;
+  if(latency > stats.maxLatency) stats.maxLatency = latency;
+
+  removeMessage(index);
+}
+
+static void failMessage(byte index){
+  OutboxMessage *message = &queue[index];
+
+  numTimeouts++;
+  message->attempts++;
+
+  if(message->attempts >= OUTBOX_MAX_ATTEMPTS){
+    LOG(LOG_SEND_FAILED);
+    stats.failed++;
+    removeMessage(index);
+    doIncrementalReset(); //Diagnostic Function
+    return;
+  }
+
+  LOG(LOG_SEND_RETRY, message->attempts);
+  stats.retries++;
+  message->notBefore = millis() + ((unsigned long)OUTBOX_RETRY_DELAY << (message->attempts - 1));
+}
+
+/**
+* Find the oldest message that is not waiting for a retry
+*
+* Returns:
+*   -Its index, or depth if there is none
+*/
+static byte nextReadyMessage(){
+  unsigned long now = millis();
+  byte index = 0;
+  while(index < depth && (long)(now - queue[index].notBefore) < 0){
+    index++;
+  }
+  return index;
+}
+
+static void onCommandResult(byte result){
+  commandResult = result;
+}
+
+/**
+* Start a modem command and wait for its result in OUTBOX_WAITING
+*
+* Returns:
+*   -false if the modem is busy with another command
+*/
+static boolean startCommand(byte command, const char *argument, const char *text){
+  if(!cell.Start(command, argument, text, onCommandResult)) return false;
+
+  activeCommand = command;
+  commandResult = GSM_RESULT_PENDING;
+  state = OUTBOX_WAITING;
+  return true;
+}
+
+/**
+* Act on the result of the command in flight
+*/
+static void completeCommand(){
+  boolean success = commandResult == GSM_RESULT_OK;
+  state = OUTBOX_IDLE;
+
+  switch(activeCommand){
+    case GSM_CMD_SEND_SMS:
+      if(success) completeMessage(activeMessage);
+      else failMessage(activeMessage);
+      break;
+
+    case GSM_CMD_DIAL:
+      if(!success){
+        failMessage(activeMessage);
+        break;
+      }
+      ringingInputs = queue[activeMessage].args[0];
+      ringTime = contactRingTime(queue[activeMessage].contact) * 1000UL;
+      if(ringTime == 0) ringTime = OUTBOX_CALL_RING_TIME;
+      alerting = false;
+      callStarted = millis();
+      stats.calls++;
+      completeMessage(activeMessage);
+      state = OUTBOX_RINGING;
+      stateTime = millis();
+      break;
+
+    case GSM_CMD_HANGUP:
+      if(!success) numTimeouts++;
+      if(callLive){
+        state = OUTBOX_PAUSE;
+        stateTime = millis();
+      }
+      else{
+        // The network ended the call, the line is free already
+        stats.callTime += millis() - callStarted;
+      }
+      break;
+  }
+  activeCommand = GSM_CMD_NONE;
+}
+
+static void sendMessage(byte index){
+  OutboxMessage *message = &queue[index];
+  char phone[CONTACT_PHONE_SIZE];
+  contactPhone(message->contact, phone);
+
+  if(message->kind == OUTBOX_CALL){
+    // Someone responded or the alarm cleared while this call was queued
+    if(inputsNeedingCalls(message->args[0]) == 0){
+      stats.cancelled++;
+      removeMessage(index);
+      return;
+    }
+
+    LOG(LOG_CALLING, message->contact, phone);
+    if(startCommand(GSM_CMD_DIAL, phone, NULL)) activeMessage = index;
+    return;
+  }
+
+  renderMessage(message->templateId, message->args, smsText, sizeof(smsText));
+
+  LOG(LOG_SENDING_SMS, message->templateId, message->contact, phone);
+  if(startCommand(GSM_CMD_SEND_SMS, phone, smsText)) activeMessage = index;
+}
+
+/**
+* Hang up the call once it is ended, answered, has rung for the contact's
+* ring time or is no longer needed. The GSM task keeps reading the call
+* state reports while it rings.
+*/
+static void ringCall(){
+  byte call = cell.GetCallState();
+  boolean needed = inputsNeedingCalls(ringingInputs) != 0;
+
+  if(call != GSM_CALL_ENDED && call != GSM_CALL_ACTIVE && needed){
+    // The ring time counts from the far end ringing, not from the dial
+    if(call == GSM_CALL_ALERTING && !alerting){
+      alerting = true;
+      stateTime = millis();
+    }
+    if((unsigned long)(millis() - stateTime) < ringTime) return;
+  }
+
+  // The inbox may hold the modem for a read: the call is counted once, when
+  // its hang up starts
+  if(!startCommand(GSM_CMD_HANGUP, NULL, NULL)) return;
+  callLive = call != GSM_CALL_ENDED;
+
+  if(call == GSM_CALL_ENDED){
+    LOG(LOG_CALL_REFUSED);
+    stats.callsRefused++;
+  }
+  else if(call == GSM_CALL_ACTIVE){
+    LOG(LOG_CALL_ANSWERED);
+    stats.callsAnswered++;
+  }
+  else if(needed){
+    stats.callsRangOut++;
+  }
+}
+
+/**
+* Outbox driver: advance the state machine by at most one modem command
+*/
+void outboxTask(){
+  PROFILE(PHASE_OUTBOX);
+
+  if(state == OUTBOX_WAITING){
+    // The GSM task polls the modem, which reports the result
+    if(commandResult == GSM_RESULT_PENDING) return;
+    completeCommand();
+    if(state != OUTBOX_IDLE) return;
+  }
+
+  if(state == OUTBOX_RINGING){
+    ringCall();
+    return;
+  }
+
+  if(state == OUTBOX_PAUSE){
+    if((unsigned long)(millis() - stateTime) < OUTBOX_CALL_GAP) return;
+    stats.callTime += millis() - callStarted;
+    state = OUTBOX_IDLE;
+  }
+
+  // The inbox runs first and may have taken the modem to read a reply
+  if(cell.Busy()) return;
+
+  byte index = nextReadyMessage();
+  if(index < depth) sendMessage(index);
+}
@@ -0,0 +1,69 @@
+#ifndef OUTBOX_H
+#define OUTBOX_H
+/*
+  Outbox
+
+  Bounded queue of outgoing SMS messages and calls. Messages are stored as
+  a template id and arguments and only rendered when they are sent.
+*/
+
+#define OUTBOX_SIZE 24
+#define OUTBOX_MAX_ATTEMPTS 3
+#define OUTBOX_RETRY_DELAY 5000   // First retry after 5 s, doubling with each attempt
+#define OUTBOX_CALL_RING_TIME 15000   // For contacts without a ring time of their own
+#define OUTBOX_CALL_GAP 1000      // Pause after hanging up a live call before the next transaction
+#define OUTBOX_TEXT_SIZE 140      // Rendered SMS, terminator included
+
+#define OUTBOX_SMS 0
+#define OUTBOX_CALL 1
+
+// Message template ids (texts in MessageTemplates.cpp)
+#define MSG_ALARM_ENTERED 1       // args: input
+#define MSG_ALARM_STILL 2         // args: input
+#define MSG_ALARM_CLEARED 3       // args: input
+#define MSG_ALARM_RESPONSE 4      // args: input, contact
+#define MSG_NOT_ADDRESSED_1 5     // args: input, contact
+#define MSG_NOT_ADDRESSED_2 6     // args: input, contact
+#define MSG_ALARM_DISABLED 7      // args: hours
+#define MSG_ALARM_ENABLED 8
+#define MSG_I2C_FAILED 9          // args: wire status code
+#define MSG_I2C_RESTORED 10
+#define MSG_I2C_RESPONSE 11       // args: contact
+#define MSG_ALARM_DIGEST 12       // args: inputs in alarm, cleared inputs (bit n = input n)
+
+class OutboxMessage
+{
+public:
+  byte kind;           // OUTBOX_SMS or OUTBOX_CALL
+  byte contact;        // Index into contacts
+  byte templateId;     // MSG_ id (unused for calls)
+  byte args[2];        // Template arguments, or the inputs to call about (bit n = input n)
+  byte attempts;
+  unsigned long enqueuedAt;
+  unsigned long notBefore;
+};
+
+class OutboxStats
+{
+public:
+  unsigned int sent;
+  unsigned int failed;    // Given up after OUTBOX_MAX_ATTEMPTS
+  unsigned int dropped;   // Queue was full
+  unsigned int retries;
+  unsigned int cancelled; // Calls no longer needed when their turn came
+  unsigned int calls;     // Placed by the modem (OK to ATD)
+  unsigned int callsAnswered;
+  unsigned int callsRefused;    // Ended by the far end or the network: rejected, busy, no answer
+  unsigned int callsRangOut;    // Hung up after the contact's ring time
+  unsigned long callTime;       // From placed to ready for the next transaction, all calls, in ms
+  byte maxDepth;
+  unsigned long minLatency;   // Enqueue to completion, in ms
+  unsigned long maxLatency;
+  unsigned long totalLatency;
+};
+
+extern boolean outboxEnqueue(byte, byte, byte, byte, byte);
+extern byte outboxDepth(void);
+extern const OutboxStats *outboxGetStats(void);
+extern void outboxTask(void);
+#endif
@@ -0,0 +1,108 @@
+/*
+  Profiler
+
+  Per-phase timing statistics and their dump as log records. See
+  Profiler.h for the markers.
+*/
+#include <Arduino.h>
+#include "Profiler.h"
+#include "Log.h"
+
+#define PROFILE_PHASE_NAME(id, name) static const char name_##id[] PROGMEM = name;
+PROFILE_PHASES(PROFILE_PHASE_NAME)
+#define PROFILE_PHASE_NAME_ENTRY(id, name) name_##id,
+static const char *const phaseNames[] PROGMEM = { PROFILE_PHASES(PROFILE_PHASE_NAME_ENTRY) };
+
+static PhaseProfile phases[PROFILE_PHASE_COUNT];
+
+// Begin Dump State
+#define DUMP_IDLE 0xFF
+static byte dumpPhase = DUMP_IDLE;
+static byte dumpBucket = 0;
+static boolean dumpHeaderSent = false;
+// End Dump State
+
+/**
+* Add one run of a phase
+* micros: How long it took
+*/
+void profileRecord(byte phase, uint32_t micros){
+  PhaseProfile *profile = &phases[phase];
+
+  if(profile->runs == 0 || micros < profile->minMicros) profile->minMicros = micros;
+  if(micros > profile->maxMicros) profile->maxMicros = micros;
+  profile->runs++;
+
+  if(profile->sumMicros > 0xFFFFFFFFUL - micros){
+    profile->sumMicros >>= 1;
+    profile->sumRuns >>= 1;
+  }
+  profile->sumMicros += micros;
+  profile->sumRuns++;
+
+  byte bucket = 0;
+  for(uint32_t t = micros >> 3; t > 0 && bucket < PROFILE_BUCKETS - 1; t >>= 1) bucket++;
+  if(profile->histogram[bucket] < 0xFFFF) profile->histogram[bucket]++;
+}
+
+const PhaseProfile *profileGetPhase(byte phase){
+  return &phases[phase];
+}
+
+const __FlashStringHelper *profilePhaseName(byte phase){
+  return (const __FlashStringHelper *)pgm_read_ptr(&phaseNames[phase]);
+}
+
+/**
+* Returns:
+*   -The shortest time counted in a histogram bucket, in us
+*/
+uint32_t profileBucketStart(byte bucket){
+  return bucket == 0 ? 0 : (uint32_t)1 << (bucket + 2);
+}
+
+/**
+* Start sending the statistics. A dump already running starts over.
+*/
+void profileDumpBegin(){
+  dumpPhase = 0;
+  dumpBucket = 0;
+  dumpHeaderSent = false;
+}
+
+/**
+* Send as much of the dump as the Serial TX buffer takes without blocking,
+* one record at a time. Call until the dump is complete.
+*/
+void profileDumpContinue(){
+  while(dumpPhase < PROFILE_PHASE_COUNT){
+    const PhaseProfile *profile = &phases[dumpPhase];
+
+    if(!dumpHeaderSent){
+      LogRecord record(LOG_PROFILE_PHASE);
+      record.add(profilePhaseName(dumpPhase));
+      record.add(profile->runs);
+      record.add(profile->runs ? profile->minMicros : 0);
+      record.add(profile->sumRuns ? profile->sumMicros / profile->sumRuns : 0);
+      record.add(profile->maxMicros);
+      if(!record.transmit()) return;
+      dumpHeaderSent = true;
+    }
+
+    while(dumpBucket < PROFILE_BUCKETS){
+      if(profile->histogram[dumpBucket] != 0){
+        LogRecord record(LOG_PROFILE_BUCKET);
+        record.add(profilePhaseName(dumpPhase));
+        record.add(profileBucketStart(dumpBucket));
+        record.add(profile->histogram[dumpBucket]);
+        if(!record.transmit()) return;
+      }
+      dumpBucket++;
+    }
+
+    dumpPhase++;
+    dumpBucket = 0;
+    dumpHeaderSent = false;
+  }
+  dumpPhase = DUMP_IDLE;
+}
@@ -0,0 +1,76 @@
+#ifndef PROF_H
+#define PROF_H
+/*
+  Profiler
+
+  Wall-clock time spent in each phase of the loop, measured with micros()
+  (the free-running Timer0, 4 us resolution) by a scoped marker:
+
+    PROFILE(PHASE_MODEM_POLL);  // Times the rest of the enclosing block
+
+  Each phase keeps its run count, min/avg/max and a log2 histogram in RAM.
+  The time includes any schedulerDelay() inside the phase, during which the
+  background tasks run. Send 'p' on Serial to get a dump as log records.
+  Build with -D PROFILING=0 to leave the markers out.
+*/
+
+#ifndef PROFILING
+#define PROFILING 1
+#endif
+
+// Bucket 0 is under 8 us, bucket n covers [2^(n+2), 2^(n+3)) us and the
+// last one everything from 2^(PROFILE_BUCKETS+1) us (2 s) up
+#define PROFILE_BUCKETS 20
+
+// Begin Phases
+#define PROFILE_PHASES(X) \
+  X(PHASE_MODEM_POLL,    "ModemPoll") \
+  X(PHASE_INCOMING_SMS,  "IncomingSMS") \
+  X(PHASE_GSM_PROBLEMS,  "GSMProblems") \
+  X(PHASE_I2C_PROBLEMS,  "I2CProblems") \
+  X(PHASE_SLAVE_SYNC,    "SlaveSync") \
+  X(PHASE_INPUTS,        "Inputs") \
+  X(PHASE_NOTIFICATIONS, "Notifications") \
+  X(PHASE_OUTBOX,        "Outbox") \
+  X(PHASE_INBOX,         "Inbox")
+
+#define PROFILE_PHASE_ID(id, name) id,
+enum ProfilePhase { PROFILE_PHASES(PROFILE_PHASE_ID) PROFILE_PHASE_COUNT };
+// End Phases
+
+struct PhaseProfile
+{
+  uint32_t runs;
+  uint32_t minMicros;
+  uint32_t maxMicros;
+  uint32_t sumMicros;   // Halved with sumRuns when it would overflow, so
+  uint32_t sumRuns;     // sumMicros / sumRuns stays the average
+  uint16_t histogram[PROFILE_BUCKETS];   // Saturating counts
+};
+
+extern void profileRecord(byte, uint32_t);
+extern const PhaseProfile *profileGetPhase(byte);
+extern const __FlashStringHelper *profilePhaseName(byte);
+extern uint32_t profileBucketStart(byte);
+extern void profileDumpBegin(void);
+extern void profileDumpContinue(void);
+
+class ProfileScope
+{
+public:
+  ProfileScope(byte phase) : phase(phase), start(micros()) {}
+  ~ProfileScope() { profileRecord(phase, micros() - start); }
+
+private:
+  byte phase;
+  unsigned long start;
+};
+
+#if PROFILING
+#define PROFILE_SCOPE_NAME(line) profileScope##line
+#define PROFILE_SCOPE(phase, line) ProfileScope PROFILE_SCOPE_NAME(line)(phase)
+#define PROFILE(phase) PROFILE_SCOPE(phase, __LINE__)
+#else
+#define PROFILE(phase)
+#endif
+#endif
@@ -0,0 +1,152 @@
+/*
+  Scheduler
+
+  A small cooperative scheduler driven by millis(). Each task runs at a
+  fixed interval; loop() only has to call schedulerRun().
+
+  Long operations (modem transactions, I2C transfers) wait with
+  schedulerDelay() instead of delay(). While waiting, tasks flagged
+  TASK_BACKGROUND (input polling, sounds) keep running, so their sampling
+  latency stays bounded no matter what the foreground task is doing.
+*/
+#include <Arduino.h>
+#include "Scheduler.h"
+
+static Task tasks[SCHEDULER_MAX_TASKS];
+static byte numTasks = 0;
+
+/**
+* Register a task. The first run happens on the next schedulerRun().
+* function: The task body
+* name: Name used in the statistics report
+* interval: Time between runs in milliseconds
+* flags: TASK_BACKGROUND or 0
+*
+* Returns:
+*   -The task id, or 255 if the task table is full
+*/
+byte schedulerAddTask(TaskFunction function, const __FlashStringHelper *name, unsigned long interval, byte flags){
+  if(numTasks >= SCHEDULER_MAX_TASKS) return 255;
+
+  Task *task = &tasks[numTasks];
+  task->function = function;
+  task->name = name;
+  task->interval = interval;
+  task->nextRun = millis();
+  task->flags = flags;
+  task->runs = 0;
+  task->lastRun = millis();
+  task->maxGap = 0;
+  task->maxDuration = 0;
+
+  return numTasks++;
+}
+
+static void runTask(Task *task){
+  unsigned long start = millis();
+
+  if(task->runs > 0 && (unsigned long)(start - task->lastRun) > task->maxGap){
+    task->maxGap = start - task->lastRun;
+  }
+  task->lastRun = start;
+  task->runs++;
+
+  task->flags |= TASK_RUNNING;
+  task->function();
+  task->flags &= ~TASK_RUNNING;
+
+  unsigned long duration = millis() - start;
+  if(duration > task->maxDuration) task->maxDuration = duration;
+
+  // Keep the cadence, but don't try to catch up on runs missed while blocked
+  task->nextRun += task->interval;
+  if((long)(millis() - task->nextRun) >= 0){
+    task->nextRun = millis() + task->interval;
+  }
+}
+
+/**
+* Run every task that is due and matches the required flags
+*/
+static void runDueTasks(byte requiredFlags){
+  for(byte i = 0; i < numTasks; i++){
+    Task *task = &tasks[i];
+    if((task->flags & requiredFlags) != requiredFlags) continue;
+    if(task->flags & TASK_RUNNING) continue;
+
+    if((long)(millis() - task->nextRun) >= 0){
+      runTask(task);
+
+      // Let background tasks in between two foreground tasks
+      if(!(task->flags & TASK_BACKGROUND)) schedulerYield();
+    }
+  }
+}
+
+/**
+* Time until the next runnable task is due
+*/
+static unsigned long millisUntilNextTask(byte requiredFlags){
+  unsigned long wait = 0xFFFFFFFF;
+
+  for(byte i = 0; i < numTasks; i++){
+    const Task *task = &tasks[i];
+    if((task->flags & requiredFlags) != requiredFlags) continue;
+    if(task->flags & TASK_RUNNING) continue;
+
+    long remaining = (long)(task->nextRun - millis());
+    if(remaining <= 0) return 0;
+    if((unsigned long)remaining < wait) wait = remaining;
+  }
+  return wait;
+}
+
+/**
+* Run all due tasks once. Called from loop().
+*/
+void schedulerRun(){
+  runDueTasks(0);
+}
+
+/**
+* Wait for the given time while background tasks keep running.
+* Replaces delay() anywhere a task waits for the modem or the slave.
+*/
+void schedulerDelay(unsigned long milliseconds){
+  unsigned long start = millis();
+
+  while((unsigned long)(millis() - start) < milliseconds){
+    runDueTasks(TASK_BACKGROUND);
+
+    unsigned long elapsed = millis() - start;
+    if(elapsed >= milliseconds) break;
+
+    unsigned long wait = millisUntilNextTask(TASK_BACKGROUND);
+    if(wait > milliseconds - elapsed) wait = milliseconds - elapsed;
+    if(wait == 0) wait = 1;
+    delay(wait);
+  }
+}
+
+/**
+* Give background tasks a chance to run between two blocking operations
+*/
+void schedulerYield(){
+  runDueTasks(TASK_BACKGROUND);
+}
+
+/**
+* Time until any task is due. loop() has nothing to do until then.
+*/
+unsigned long schedulerIdleMillis(){
+  return millisUntilNextTask(0);
+}
+
+byte schedulerTaskCount(){
+  return numTasks;
+}
+
+const Task *schedulerGetTask(byte id){
+  return id < numTasks ? &tasks[id] : NULL;
+}
+
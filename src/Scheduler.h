@@ -0,0 +1,36 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#define SCHEDULER_MAX_TASKS 8
+
+// Task may also run while a foreground task is waiting in schedulerDelay()
+#define TASK_BACKGROUND 0x01
+// Set while the task is executing, so waits inside it cannot re-enter it
+#define TASK_RUNNING    0x80
+
+typedef void (*TaskFunction)(void);
+
+class Task
+{
+public:
+  TaskFunction function;
+  const __FlashStringHelper *name;
+  unsigned long interval;
+  unsigned long nextRun;
+  byte flags;
+
+  // Statistics
+  unsigned long runs;
+  unsigned long lastRun;
+  unsigned long maxGap;      // Longest time between two consecutive runs
+  unsigned long maxDuration; // Longest single execution
+};
+
+extern byte schedulerAddTask(TaskFunction, const __FlashStringHelper *, unsigned long, byte);
+extern void schedulerRun(void);
+extern void schedulerDelay(unsigned long);
+extern void schedulerYield(void);
+extern unsigned long schedulerIdleMillis(void);
+extern byte schedulerTaskCount(void);
+extern const Task *schedulerGetTask(byte);
+#endif
@@ -0,0 +1,638 @@
+/*
+  SerialGSM
+
+  AT command engine for the SIM900 in text mode. See SerialGSM.h.
+*/
+#include <Arduino.h>
+#include "SerialGSM.h"
+#include "Scheduler.h"
+#include "Log.h"
+
+// Begin Timeouts
+#define GSM_COMMAND_TIMEOUT 1000
+#define GSM_BOOT_TIMEOUT 20000     // Power up to the first answer to AT
+#define GSM_PROMPT_TIMEOUT 5000
+#define GSM_SMS_TIMEOUT 60000      // Longest AT+CMGS response in the SIM900 manual
+#define GSM_DELETE_TIMEOUT 25000
+#define GSM_READ_TIMEOUT 5000      // AT+CMGR and AT+CMGD of a single message
+#define GSM_DIAL_TIMEOUT 20000
+// End Timeouts
+
+// Tokenizer states
+#define LINE_START 0               // Nothing of the line received yet
+#define LINE_MATCHING 1            // Narrowing down the tokens that start like the line
+#define LINE_PARAMETERS 2          // Token matched, taking in its parameters
+#define LINE_SKIP 3                // No token matches, ignore the rest of the line
+#define LINE_TEXT 4                // The line after a +CMT or +CMGR header: the message
+
+// Token flags
+#define TOKEN_EXACT 0x01           // Nothing may follow the pattern on the line
+#define TOKEN_STATUS 0x02          // The first quoted string is the SMS status, not kept
+
+#define CTRL_Z 0x1A
+#define ESC 0x1B
+
+// Begin Command Table
+struct GsmCommand
+{
+  const char *text;                // After "AT"
+  const char *close;               // After the argument
+  unsigned long timeout;
+};
+
+static const char CMD_AT[] PROGMEM = "";
+static const char CMD_ECHO_OFF[] PROGMEM = "E0";
+static const char CMD_REGISTRATION_REPORTS[] PROGMEM = "+CREG=1";
+static const char CMD_REGISTRATION[] PROGMEM = "+CREG?";
+static const char CMD_TEXT_MODE[] PROGMEM = "+CMGF=1";
+static const char CMD_FORWARD_SMS[] PROGMEM = "+CNMI=2,1,0,0,0";
+static const char CMD_RESET[] PROGMEM = "+CFUN=1,1";
+static const char CMD_DELETE_READ_SMS[] PROGMEM = "+CMGD=1,3";
+static const char CMD_SEND_SMS[] PROGMEM = "+CMGS=\"";
+static const char CMD_DIAL[] PROGMEM = "D";
+static const char CMD_HANGUP[] PROGMEM = "H";
+static const char CMD_CALL_REPORTS[] PROGMEM = "+CLCC=1";
+static const char CMD_READ_SMS[] PROGMEM = "+CMGR=";
+static const char CMD_DELETE_SMS[] PROGMEM = "+CMGD=";
+static const char CMD_STORAGE[] PROGMEM = "+CPMS?";
+static const char CLOSE_NONE[] PROGMEM = "";
+static const char CLOSE_QUOTE[] PROGMEM = "\"";
+static const char CLOSE_VOICE[] PROGMEM = ";";
+
+// Indexed by GSM_CMD_
+static const GsmCommand commands[] PROGMEM = {
+  { CMD_AT,                   CLOSE_NONE,  GSM_COMMAND_TIMEOUT },
+  { CMD_ECHO_OFF,             CLOSE_NONE,  GSM_COMMAND_TIMEOUT },
+  { CMD_REGISTRATION_REPORTS, CLOSE_NONE,  GSM_COMMAND_TIMEOUT },
+  { CMD_REGISTRATION,         CLOSE_NONE,  GSM_COMMAND_TIMEOUT },
+  { CMD_TEXT_MODE,            CLOSE_NONE,  GSM_COMMAND_TIMEOUT },
+  { CMD_FORWARD_SMS,          CLOSE_NONE,  GSM_COMMAND_TIMEOUT },
+  { CMD_RESET,                CLOSE_NONE,  GSM_COMMAND_TIMEOUT },
+  { CMD_DELETE_READ_SMS,      CLOSE_NONE,  GSM_DELETE_TIMEOUT },
+  { CMD_SEND_SMS,             CLOSE_QUOTE, GSM_PROMPT_TIMEOUT },   // GSM_SMS_TIMEOUT once the text is sent
+  { CMD_DIAL,                 CLOSE_VOICE, GSM_DIAL_TIMEOUT },
+  { CMD_HANGUP,               CLOSE_NONE,  GSM_COMMAND_TIMEOUT },
+  { CMD_CALL_REPORTS,         CLOSE_NONE,  GSM_COMMAND_TIMEOUT },
+  { CMD_READ_SMS,             CLOSE_NONE,  GSM_READ_TIMEOUT },
+  { CMD_DELETE_SMS,           CLOSE_NONE,  GSM_READ_TIMEOUT },
+  { CMD_STORAGE,              CLOSE_NONE,  GSM_COMMAND_TIMEOUT },
+};
+static_assert(sizeof(commands) / sizeof(commands[0]) == GSM_CMD_COUNT, "One command table entry per GSM_CMD_");
+// End Command Table
+
+// Begin Token Table
+static const char TOKEN_OK[] PROGMEM = "OK";
+static const char TOKEN_ERROR[] PROGMEM = "ERROR";
+static const char TOKEN_CMS_ERROR[] PROGMEM = "+CMS ERROR:";
+static const char TOKEN_CME_ERROR[] PROGMEM = "+CME ERROR:";
+static const char TOKEN_CMT[] PROGMEM = "+CMT:";
+static const char TOKEN_CMTI[] PROGMEM = "+CMTI:";
+static const char TOKEN_CMGR[] PROGMEM = "+CMGR:";
+static const char TOKEN_CPMS[] PROGMEM = "+CPMS:";
+static const char TOKEN_RING[] PROGMEM = "RING";
+static const char TOKEN_NO_CARRIER[] PROGMEM = "NO CARRIER";
+static const char TOKEN_BUSY[] PROGMEM = "BUSY";
+static const char TOKEN_NO_ANSWER[] PROGMEM = "NO ANSWER";
+static const char TOKEN_CLCC[] PROGMEM = "+CLCC:";
+static const char TOKEN_CREG[] PROGMEM = "+CREG:";
+static const char TOKEN_RDY[] PROGMEM = "RDY";
+static const char TOKEN_CALL_READY[] PROGMEM = "Call Ready";
+static const char TOKEN_NO_SIM[] PROGMEM = "+CPIN: NOT INSERTED";
+static const char TOKEN_POWER_DOWN[] PROGMEM = "NORMAL POWER DOWN";
+static const char TOKEN_UNDER_VOLTAGE[] PROGMEM = "UNDER-VOLTAGE POWER DOWN";
+static const char TOKEN_OVER_VOLTAGE[] PROGMEM = "OVER-VOLTAGE POWER DOWN";
+
+// No pattern may be the start of another: the first complete match wins.
+// Lines that match nothing (echo, +CMGS: <mr>, +CPIN: READY...) are skipped.
+const SerialGSM::Token SerialGSM::tokens[] PROGMEM = {
+  // Final result codes
+  { TOKEN_OK,            TOKEN_EXACT, &SerialGSM::onOK },
+  { TOKEN_ERROR,         TOKEN_EXACT, &SerialGSM::onError },
+  { TOKEN_CMS_ERROR,     0,           &SerialGSM::onError },
+  { TOKEN_CME_ERROR,     0,           &SerialGSM::onEquipmentError },
+  // Unsolicited result codes
+  { TOKEN_CMT,           0,           &SerialGSM::onSMS },
+  { TOKEN_CMTI,          0,           &SerialGSM::onStoredSMS },
+  { TOKEN_CMGR,          TOKEN_STATUS, &SerialGSM::onReadSMS },
+  { TOKEN_CPMS,          0,           &SerialGSM::onStorage },
+  { TOKEN_RING,          TOKEN_EXACT, &SerialGSM::onRing },
+  { TOKEN_NO_CARRIER,    TOKEN_EXACT, &SerialGSM::onCallEnded },
+  { TOKEN_BUSY,          TOKEN_EXACT, &SerialGSM::onCallEnded },
+  { TOKEN_NO_ANSWER,     TOKEN_EXACT, &SerialGSM::onCallEnded },
+  { TOKEN_CLCC,          0,           &SerialGSM::onCallState },
+  { TOKEN_CREG,          0,           &SerialGSM::onRegistration },
+  { TOKEN_RDY,           TOKEN_EXACT, &SerialGSM::onModemStarted },
+  { TOKEN_CALL_READY,    TOKEN_EXACT, &SerialGSM::onCallReady },
+  { TOKEN_NO_SIM,        TOKEN_EXACT, &SerialGSM::onNoSIM },
+  { TOKEN_POWER_DOWN,    TOKEN_EXACT, &SerialGSM::onPowerDown },
+  { TOKEN_UNDER_VOLTAGE, TOKEN_EXACT, &SerialGSM::onPowerDown },
+  { TOKEN_OVER_VOLTAGE,  TOKEN_EXACT, &SerialGSM::onPowerDown },
+};
+#define TOKEN_COUNT (sizeof(tokens) / sizeof(tokens[0]))
+#define ALL_TOKENS ((uint32_t)((1ULL << TOKEN_COUNT) - 1))
+// End Token Table
+
+SerialGSM::SerialGSM(Stream &port)
+  : port(port), verbose(false), status(GSM_STATUS_BOOTING), callState(GSM_CALL_IDLE), errorCode(0),
+    storedHead(0), storedCount(0), missed(false), storageSize(GSM_STORAGE_SIZE), storageHigh(0),
+    pending(GSM_CMD_NONE), result(GSM_RESULT_OK), prompted(false), started(0), timeout(0),
+    smsText(NULL), callback(NULL), lineState(LINE_START), column(0), candidates(0), token(0),
+    inQuotes(false), quoted(0), unread(false), fieldLength(0), parameter(0), textLength(0), smsCallback(NULL)
+{
+  field[0] = '\0';
+  memset(parameters, 0, sizeof(parameters));
+  text[0] = '\0';
+  sender[0] = '\0';
+}
+
+/**
+* Log every token from the modem (at LOG_LEVEL_DEBUG)
+*/
+void SerialGSM::Verbose(boolean verbose){
+  this->verbose = verbose;
+}
+
+/**
+* Send a command without waiting for its result
+* command: GSM_CMD_ id
+* argument: Number for GSM_CMD_SEND_SMS and GSM_CMD_DIAL, storage index for
+*   GSM_CMD_READ_SMS and GSM_CMD_DELETE_SMS, otherwise NULL
+* text: Message of GSM_CMD_SEND_SMS. Must stay valid until the result.
+* callback: Gets the GSM_RESULT_ from Poll(), or NULL
+*
+* Returns:
+*   -false if another command is still in flight
+*/
+boolean SerialGSM::Start(byte command, const char *argument, const char *text, GsmResultCallback callback){
+  if(pending != GSM_CMD_NONE) return false;
+
+  GsmCommand entry;
+  memcpy_P(&entry, &commands[command], sizeof(entry));
+  port.print(F("AT"));
+  port.print((const __FlashStringHelper *)entry.text);
+  if(argument != NULL){
+    port.print(argument);
+    port.print((const __FlashStringHelper *)entry.close);
+  }
+  port.print('\r');
+
+  if(command == GSM_CMD_DIAL) callState = GSM_CALL_DIALING;
+  pending = command;
+  result = GSM_RESULT_PENDING;
+  prompted = false;
+  started = millis();
+  timeout = entry.timeout;
+  smsText = text;
+  this->callback = callback;
+  return true;
+}
+
+/**
+* Returns:
+*   -true while a command is waiting for its result
+*/
+boolean SerialGSM::Busy(){
+  return pending != GSM_CMD_NONE;
+}
+
+/**
+* Complete the command in flight
+*/
+void SerialGSM::finish(byte result){
+  byte command = pending;
+  pending = GSM_CMD_NONE;
+  this->result = result;
+
+  if(command == GSM_CMD_DIAL){
+    if(result == GSM_RESULT_OK) status = GSM_STATUS_IN_CALL;
+    else callState = GSM_CALL_IDLE;
+  }
+  else if(command == GSM_CMD_HANGUP){
+    if(status == GSM_STATUS_IN_CALL || status == GSM_STATUS_CALL_ENDED) status = GSM_STATUS_READY;
+    callState = GSM_CALL_IDLE;
+  }
+  else if(command == GSM_CMD_RESET){
+    // Boot() waits for the modem to come back
+    status = GSM_STATUS_BOOTING;
+    callState = GSM_CALL_IDLE;
+    errorCode = 0;
+  }
+  else if(command == GSM_CMD_DELETE_READ_SMS && result == GSM_RESULT_OK){
+    // Whatever is left is unread, and reported
+    storageHigh = 0;
+  }
+
+  GsmResultCallback done = callback;
+  callback = NULL;
+  if(done != NULL) done(result);
+}
+
+/**
+* Handle everything the modem has sent, then time out the command in flight
+* if its time is up
+*/
+void SerialGSM::Poll(){
+  int c;
+  while((c = port.read()) >= 0) Feed(c);
+
+  if(pending != GSM_CMD_NONE && (unsigned long)(millis() - started) >= timeout){
+    // Leave text entry if the prompt never came
+    if(pending == GSM_CMD_SEND_SMS && !prompted) port.write(ESC);
+    finish(GSM_RESULT_TIMEOUT);
+  }
+}
+
+/**
+* Handle one byte from the modem
+*/
+void SerialGSM::Feed(byte c){
+  if(lineState == LINE_TEXT){
+    if(c == '\n'){
+      while(textLength > 0 && text[textLength - 1] == '\r') textLength--;
+      text[textLength] = '\0';
+      lineState = LINE_START;
+      if(unread && smsCallback) smsCallback();
+    }
+    // The rest of a text too long for an SMS is dropped. Message() stays
+    // terminated while the line is still arriving.
+    else if(textLength < GSM_SMS_SIZE - 1){
+      text[textLength++] = c;
+      text[textLength] = '\0';
+    }
+    return;
+  }
+
+  if(c == '\n'){
+    endLine();
+    return;
+  }
+  if(c == '\r') return;
+
+  if(lineState == LINE_START){
+    // The AT+CMGS prompt "> " has no line end
+    if(c == '>' && pending == GSM_CMD_SEND_SMS && !prompted){
+      prompted = true;
+      port.print(smsText);
+      port.write(CTRL_Z);
+      started = millis();
+      timeout = GSM_SMS_TIMEOUT;
+      lineState = LINE_SKIP;
+      return;
+    }
+    startLine();
+  }
+
+  if(lineState == LINE_MATCHING) matchToken(c);
+  else if(lineState == LINE_PARAMETERS) parseParameter(c);
+}
+
+void SerialGSM::startLine(){
+  lineState = LINE_MATCHING;
+  column = 0;
+  candidates = ALL_TOKENS;
+  inQuotes = false;
+  quoted = 0;
+  fieldLength = 0;
+  parameter = 0;
+  memset(parameters, 0, sizeof(parameters));
+}
+
+/**
+* Drop the tokens whose pattern differs from the line at this column
+*/
+void SerialGSM::matchToken(byte c){
+  static_assert(TOKEN_COUNT <= 32, "candidates has one bit per token");
+  uint32_t remaining = 0;
+  for(byte i = 0; i < TOKEN_COUNT; i++){
+    uint32_t bit = 1UL << i;
+    if(!(candidates & bit)) continue;
+
+    const char *pattern = (const char *)pgm_read_ptr(&tokens[i].pattern);
+    if(pgm_read_byte(pattern + column) != c) continue;
+    if(pgm_read_byte(pattern + column + 1) == '\0'){
+      token = i;
+      lineState = LINE_PARAMETERS;
+      return;
+    }
+    remaining |= bit;
+  }
+
+  candidates = remaining;
+  column++;
+  if(remaining == 0) lineState = LINE_SKIP;
+}
+
+/**
+* Take in what follows a matched pattern: numbers separated by commas and
+* quoted strings. Only the first three numbers and the first string are kept,
+* or the second one after a status.
+*/
+void SerialGSM::parseParameter(byte c){
+  byte flags = pgm_read_byte(&tokens[token].flags);
+  if(flags & TOKEN_EXACT){
+    lineState = LINE_SKIP;
+    return;
+  }
+
+  if(c == '"'){
+    inQuotes = !inQuotes;
+    if(inQuotes) return;
+
+    if(quoted == 0 && (flags & TOKEN_STATUS)){
+      field[fieldLength] = '\0';
+      unread = strcmp_P(field, PSTR("REC UNREAD")) == 0;
+      fieldLength = 0;
+    }
+    quoted++;
+  }
+  else if(inQuotes){
+    byte kept = flags & TOKEN_STATUS ? 1 : 0;
+    if(quoted <= kept && fieldLength < GSM_PHONE_SIZE - 1) field[fieldLength++] = c;
+  }
+  else if(c == ','){
+    if(parameter < 0xFF) parameter++;
+  }
+  else if(c >= '0' && c <= '9' && parameter < 3){
+    unsigned int *value = &parameters[parameter];
+    *value = *value < 6553 ? *value * 10 + (c - '0') : 0xFFFF;
+  }
+}
+
+/**
+* Pass a matched line to its handler. A handler may set lineState for the
+* next line.
+*/
+void SerialGSM::endLine(){
+  boolean matched = lineState == LINE_PARAMETERS;
+  lineState = LINE_START;
+  if(!matched) return;
+
+  field[fieldLength] = '\0';
+  Token entry;
+  memcpy_P(&entry, &tokens[token], sizeof(entry));
+  if(verbose) LOG(LOG_MODEM_LINE, (const __FlashStringHelper *)entry.pattern);
+  (this->*entry.handler)();
+}
+
+// Begin Token Handlers
+void SerialGSM::onOK(){
+  if(pending != GSM_CMD_NONE) finish(GSM_RESULT_OK);
+}
+
+void SerialGSM::onError(){
+  if(pending != GSM_CMD_NONE) finish(GSM_RESULT_ERROR);
+}
+
+void SerialGSM::onEquipmentError(){
+  // Kept for checkGSMProblems()
+  errorCode = parameters[0];
+  if(pending != GSM_CMD_NONE) finish(GSM_RESULT_ERROR);
+}
+
+/**
+* +CMT: "<sender>","<name>","<time>", with the message on the next line
+*/
+void SerialGSM::onSMS(){
+  memcpy(sender, field, fieldLength + 1);
+  unread = true;
+  textLength = 0;
+  lineState = LINE_TEXT;
+}
+
+/**
+* +CMTI: "<storage>",<index>: a new message waits in storage. Its index is
+* queued for TakeStoredSMS(), or flagged as missed if the queue is full.
+*/
+void SerialGSM::onStoredSMS(){
+  byte index = parameters[1] < 0xFF ? parameters[1] : 0xFF;
+  LOG(LOG_GSM_STORED_SMS, index);
+
+  if(index > storageHigh) storageHigh = index;
+  if(storedCount == GSM_STORED_QUEUE_SIZE){
+    missed = true;
+    return;
+  }
+  stored[(storedHead + storedCount) % GSM_STORED_QUEUE_SIZE] = index;
+  storedCount++;
+}
+
+/**
+* +CMGR: "<status>","<sender>","<name>","<time>", with the message on the
+* next line. The status decides whether it goes to the SMS callback.
+*/
+void SerialGSM::onReadSMS(){
+  memcpy(sender, field, fieldLength + 1);
+  textLength = 0;
+  lineState = LINE_TEXT;
+}
+
+/**
+* +CPMS: "<storage>",<used>,<total>,... in answer to AT+CPMS?
+*/
+void SerialGSM::onStorage(){
+  if(parameters[2] > 0) storageSize = parameters[2] < 0xFF ? parameters[2] : 0xFF;
+  // Stored before this boot: their +CMTI went to nobody
+  if(parameters[1] > 0) missed = true;
+  if(parameters[1] + GSM_STORAGE_MARGIN > storageSize) storageHigh = storageSize;
+}
+
+void SerialGSM::onRing(){
+  // The alarm does not take calls, the caller gets no answer
+  LOG(LOG_GSM_RING);
+}
+
+/**
+* NO CARRIER, BUSY or NO ANSWER: also the result of a dial that failed
+*/
+void SerialGSM::onCallEnded(){
+  if(status == GSM_STATUS_IN_CALL) status = GSM_STATUS_CALL_ENDED;
+  if(callState != GSM_CALL_IDLE) callState = GSM_CALL_ENDED;
+  if(pending == GSM_CMD_DIAL) finish(GSM_RESULT_ERROR);
+}
+
+/**
+* +CLCC: <id>,<dir>,<stat>,<mode>,<mpty>,"<number>",<type>, sent on every
+* change of a call once AT+CLCC=1. Only outgoing calls (dir 0) are followed.
+*/
+void SerialGSM::onCallState(){
+  if(parameters[1] != 0 || callState == GSM_CALL_IDLE || callState == GSM_CALL_ENDED) return;
+
+  switch(parameters[2]){
+    case 0: callState = GSM_CALL_ACTIVE; break;
+    case 2: callState = GSM_CALL_DIALING; break;
+    case 3: callState = GSM_CALL_ALERTING; break;
+    case 6:
+      // Disconnected. NO CARRIER, BUSY or NO ANSWER follows.
+      callState = GSM_CALL_ENDED;
+      if(status == GSM_STATUS_IN_CALL) status = GSM_STATUS_CALL_ENDED;
+      break;
+  }
+}
+
+/**
+* +CREG: <stat> as a report, +CREG: <n>,<stat> in answer to AT+CREG?
+*/
+void SerialGSM::onRegistration(){
+  unsigned int registration = parameters[parameter >= 1 ? 1 : 0];
+  if(status == GSM_STATUS_BOOTING && (registration == 1 || registration == 5)) status = GSM_STATUS_READY;
+}
+
+void SerialGSM::onModemStarted(){
+  if(status != GSM_STATUS_BOOTING) status = GSM_STATUS_RESET;
+  // A call does not survive a restart
+  if(callState != GSM_CALL_IDLE) callState = GSM_CALL_ENDED;
+}
+
+void SerialGSM::onCallReady(){
+  if(status == GSM_STATUS_BOOTING) status = GSM_STATUS_READY;
+}
+
+void SerialGSM::onNoSIM(){
+  status = GSM_STATUS_NO_SIM;
+}
+
+void SerialGSM::onPowerDown(){
+  status = GSM_STATUS_POWER_DOWN;
+}
+// End Token Handlers
+
+/**
+* Send a command once the one in flight is done and wait for its result.
+* Background tasks keep running meanwhile.
+*
+* Returns:
+*   -false on an error or timeout
+*/
+boolean SerialGSM::run(byte command, const char *argument){
+  while(Busy()){
+    schedulerDelay(1);
+    Poll();
+  }
+
+  Start(command, argument, NULL, NULL);
+  while(Busy()){
+    schedulerDelay(1);
+    Poll();
+  }
+  return result == GSM_RESULT_OK;
+}
+
+/**
+* Wait for the modem to answer, then turn echo off, ask for network
+* registration and call state reports, set text mode, have new messages
+* reported and check what the SMS storage already holds. The status turns
+* to ready once it is registered.
+*/
+void SerialGSM::Boot(){
+  status = GSM_STATUS_BOOTING;
+  callState = GSM_CALL_IDLE;
+  errorCode = 0;
+  // AT+CPMS? tells what is in storage now
+  storedCount = 0;
+  storageHigh = 0;
+
+  // The modem also sets its baud rate from the first AT it receives
+  unsigned long start = millis();
+  while(!run(GSM_CMD_AT, NULL)){
+    if((unsigned long)(millis() - start) >= GSM_BOOT_TIMEOUT) return;
+  }
+  run(GSM_CMD_ECHO_OFF, NULL);
+  run(GSM_CMD_REGISTRATION_REPORTS, NULL);
+  run(GSM_CMD_CALL_REPORTS, NULL);
+  run(GSM_CMD_TEXT_MODE, NULL);
+  run(GSM_CMD_FORWARD_SMS, NULL);
+  run(GSM_CMD_STORAGE, NULL);
+  run(GSM_CMD_REGISTRATION, NULL);
+}
+
+/**
+* Restart the modem. Boot() waits for it to come back.
+*/
+void SerialGSM::Reset(){
+  run(GSM_CMD_RESET, NULL);
+}
+
+/**
+* Have new messages stored and reported with +CMTI, as Boot() does. Also
+* shows the modem still answers.
+*/
+void SerialGSM::FwdSMS2Serial(){
+  run(GSM_CMD_FORWARD_SMS, NULL);
+}
+
+/**
+* Returns:
+*   -The storage index of the oldest reported message not taken yet, or -1
+*/
+int SerialGSM::TakeStoredSMS(){
+  if(storedCount == 0) return -1;
+
+  byte index = stored[storedHead];
+  storedHead = (storedHead + 1) % GSM_STORED_QUEUE_SIZE;
+  storedCount--;
+  return index;
+}
+
+/**
+* Returns:
+*   -true, once, if messages may be in storage without their index in the
+*    queue: the queue was full, or messages were stored before the boot
+*/
+boolean SerialGSM::TakeMissedSMS(){
+  boolean wasMissed = missed;
+  missed = false;
+  return wasMissed;
+}
+
+/**
+* Returns:
+*   -true once a message was stored within GSM_STORAGE_MARGIN of the end.
+*    The modem stores at the lowest free index, so the rest is taken.
+*/
+boolean SerialGSM::StorageNearlyFull(){
+  return storageHigh + GSM_STORAGE_MARGIN > storageSize;
+}
+
+/**
+* Returns:
+*   -The number of messages the storage holds, from AT+CPMS?
+*/
+byte SerialGSM::StorageSize(){
+  return storageSize;
+}
+
+int SerialGSM::GetGSMStatus(){
+  return status;
+}
+
+/**
+* Returns:
+*   -The GSM_CALL_ state of the outgoing call
+*/
+byte SerialGSM::GetCallState(){
+  return callState;
+}
+
+/**
+* Returns:
+*   -The last +CME ERROR code since the modem was booted, 0 if none
+*/
+int SerialGSM::GetErrorCode(){
+  return errorCode;
+}
+
+char *SerialGSM::Sender(){
+  return sender;
+}
+
+/**
+* Returns:
+*   -The text of the SMS, valid in the callback only
+*/
+char *SerialGSM::Message(){
+  return text;
+}
+
+void SerialGSM::registerSMSCallback(int (*callback)(void)){
+  smsCallback = callback;
+}
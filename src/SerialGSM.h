@@ -0,0 +1,191 @@
+/*
+  SerialGSM
+
+  Event-driven AT command engine for the SIM900 GSM shield in text mode.
+
+  Poll() feeds whatever the modem has sent, byte by byte, through a
+  tokenizer that matches each line against a table of result codes as it
+  arrives. Nothing is buffered per line: a matched token keeps only its
+  numeric parameters and first quoted string, and only the text of an
+  incoming SMS is stored. Final result codes (OK, ERROR, +CMS ERROR,
+  +CME ERROR) complete the command in flight; unsolicited result codes
+  (+CMT, +CMTI, RING, NO CARRIER, BUSY, +CREG, +CLCC...) go to their
+  handler in the same table whether or not a command is pending.
+
+  Boot() turns on call state reports (AT+CLCC=1), so the progress of an
+  outgoing call (GetCallState()) follows the network: ringing at the far
+  end, answered, or ended by a reject, a busy line or no answer.
+
+  New SMS messages are kept in the SIM storage and reported by index with
+  +CMTI. The indices wait in a small queue (TakeStoredSMS()) until they
+  are read with AT+CMGR, whose text goes to the SMS callback like a +CMT.
+  Only unread messages reach the callback.
+
+  One command is in flight at a time, each with its own timeout from the
+  command table. Start() sends a command and returns; its result reaches
+  the callback given to Start() from within Poll(). Boot(), Reset() and
+  FwdSMS2Serial() wait for their result instead.
+*/
+#ifndef SerialGSM_h
+#define SerialGSM_h
+
+#include <Arduino.h>
+
+#define GSM_SMS_SIZE 161         // Text of an SMS: 160 characters
+#define GSM_PHONE_SIZE 16
+#define GSM_STORED_QUEUE_SIZE 8  // +CMTI indices waiting to be read
+#define GSM_STORAGE_SIZE 20      // SIM storage, until AT+CPMS? says otherwise
+#define GSM_STORAGE_MARGIN 3     // Nearly full once a message is stored this close to the end
+
+// Begin Status
+// Returned by GetGSMStatus(). The values are those of the original library.
+#define GSM_STATUS_RESET 1          // Modem restarted by itself (RDY outside a boot)
+#define GSM_STATUS_BOOTING 2
+#define GSM_STATUS_IN_CALL 3
+#define GSM_STATUS_READY 4          // Call Ready, or registered on the network
+#define GSM_STATUS_NO_SIM 7
+#define GSM_STATUS_CALL_ENDED 9     // NO CARRIER, BUSY or NO ANSWER during a call
+#define GSM_STATUS_POWER_DOWN 10
+// End Status
+
+// Begin Commands
+// Ids for Start(). Text and timeout of each are in the table in SerialGSM.cpp.
+#define GSM_CMD_AT 0
+#define GSM_CMD_ECHO_OFF 1
+#define GSM_CMD_REGISTRATION_REPORTS 2
+#define GSM_CMD_REGISTRATION 3
+#define GSM_CMD_TEXT_MODE 4
+#define GSM_CMD_FORWARD_SMS 5       // Store new messages and report them with +CMTI
+#define GSM_CMD_RESET 6
+#define GSM_CMD_DELETE_READ_SMS 7   // All but the unread messages
+#define GSM_CMD_SEND_SMS 8          // argument: number, text: the message
+#define GSM_CMD_DIAL 9              // argument: number
+#define GSM_CMD_HANGUP 10
+#define GSM_CMD_CALL_REPORTS 11
+#define GSM_CMD_READ_SMS 12         // argument: storage index
+#define GSM_CMD_DELETE_SMS 13       // argument: storage index
+#define GSM_CMD_STORAGE 14
+#define GSM_CMD_COUNT 15
+#define GSM_CMD_NONE 0xFF
+// End Commands
+
+// Begin Call States
+// Progress of the outgoing call, from GetCallState()
+#define GSM_CALL_IDLE 0
+#define GSM_CALL_DIALING 1          // Dialed, the far end is not ringing yet
+#define GSM_CALL_ALERTING 2         // Ringing at the far end
+#define GSM_CALL_ACTIVE 3           // Answered
+#define GSM_CALL_ENDED 4            // Ended by the far end or the network, not hung up yet
+// End Call States
+
+// Results of a command
+#define GSM_RESULT_PENDING 0
+#define GSM_RESULT_OK 1
+#define GSM_RESULT_ERROR 2
+#define GSM_RESULT_TIMEOUT 3
+
+typedef void (*GsmResultCallback)(byte result);
+
+class SerialGSM
+{
+  public:
+    SerialGSM(Stream &port);
+    void Verbose(boolean verbose);
+    boolean Start(byte command, const char *argument, const char *text, GsmResultCallback callback);
+    boolean Busy();
+    void Poll();
+    void Feed(byte c);
+    void Boot();
+    void Reset();
+    void FwdSMS2Serial();
+    int TakeStoredSMS();
+    boolean TakeMissedSMS();
+    boolean StorageNearlyFull();
+    byte StorageSize();
+    int GetGSMStatus();
+    byte GetCallState();
+    int GetErrorCode();
+    char *Sender();
+    char *Message();
+    void registerSMSCallback(int (*callback)(void));
+
+  private:
+    // Entry of the token table: a line starting with pattern goes to handler
+    struct Token
+    {
+      const char *pattern;
+      byte flags;
+      void (SerialGSM::*handler)(void);
+    };
+    static const Token tokens[];
+
+    boolean run(byte command, const char *argument);
+    void finish(byte result);
+    void startLine(void);
+    void matchToken(byte c);
+    void parseParameter(byte c);
+    void endLine(void);
+
+    // Token handlers
+    void onOK(void);
+    void onError(void);
+    void onEquipmentError(void);
+    void onSMS(void);
+    void onStoredSMS(void);
+    void onReadSMS(void);
+    void onStorage(void);
+    void onRing(void);
+    void onCallEnded(void);
+    void onCallState(void);
+    void onRegistration(void);
+    void onModemStarted(void);
+    void onCallReady(void);
+    void onNoSIM(void);
+    void onPowerDown(void);
+
+    Stream &port;
+    boolean verbose;
+    int status;
+    byte callState;
+    int errorCode;
+
+    // Begin Storage
+    byte stored[GSM_STORED_QUEUE_SIZE];   // +CMTI indices, oldest first
+    byte storedHead;
+    byte storedCount;
+    boolean missed;              // Stored messages were not reported, or their report was dropped
+    byte storageSize;
+    byte storageHigh;            // Highest index reported since the last AT+CMGD=1,3
+    // End Storage
+
+    // Begin Command In Flight
+    byte pending;                // GSM_CMD_ in flight, or GSM_CMD_NONE
+    byte result;                 // GSM_RESULT_ of the last command
+    boolean prompted;            // AT+CMGS has had its "> " and the text is sent
+    unsigned long started;
+    unsigned long timeout;
+    const char *smsText;         // Sent at the AT+CMGS prompt
+    GsmResultCallback callback;
+    // End Command In Flight
+
+    // Begin Tokenizer
+    byte lineState;              // LINE_ state of the line being received
+    byte column;
+    uint32_t candidates;         // Tokens still matching the line, bit n = tokens[n]
+    byte token;                  // Matched entry of tokens
+    boolean inQuotes;
+    byte quoted;                 // Quoted strings seen
+    boolean unread;              // The SMS being received has not been read before
+    byte fieldLength;
+    char field[GSM_PHONE_SIZE];  // First quoted string of the line, or the one after the status
+    byte parameter;              // Parameters seen, counting commas outside quotes
+    unsigned int parameters[3];  // The first three numeric parameters
+    byte textLength;
+    // End Tokenizer
+
+    char text[GSM_SMS_SIZE];     // Text of the incoming SMS, in the callback
+    char sender[GSM_PHONE_SIZE];
+    int (*smsCallback)(void);
+};
+
+#endif
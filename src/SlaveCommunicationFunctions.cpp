@@ -6,13 +6,16 @@
 #include <Arduino.h>
 #include "SlaveCommunicationsFunctions.h"
 #include "GSMFunctions.h"
-#include "GSMSoftwareSerial.h"
 #include "SerialGSM.h"
 #include "DiagnosticFunctions.h"
 #include "MegaMaster.h"
 #include "CRC32.h"
+#include "ContactParser.h"
+#include "ContactRecord.h"
 #include "ContactManagementFunctions.h"
 #include "MonitoringFunctions.h"
+#include "Scheduler.h"
+#include "Log.h"
 #include "Wire.h" //A custom Wire library which has timeouts: https://github.com/steamfire/WSWireLib
 
 /**
@@ -66,7 +69,7 @@ byte slaveGetContactsFileChanged()
   wireResponseCode = Wire.endTransmission();
 
   // Give the slave time to process
-  delay(10);
+  schedulerDelay(10);
 
   if (Wire.requestFrom(2, 1) == 1){
     return Wire.read();
@@ -88,7 +91,7 @@ byte slaveGetAlarmDisabledHours(){
   wireResponseCode = Wire.endTransmission();
 
   // Give the slave time to process
-  delay(10);
+  schedulerDelay(10);
 
   if (Wire.requestFrom(2, 1) == 1){
     return Wire.read();
@@ -109,7 +112,7 @@ byte slaveGetSavedAlarmState(){
   wireResponseCode = Wire.endTransmission();
 
   // Give the slave time to process
-  delay(500);
+  schedulerDelay(500);
 
   byte currentMachine = 0;
 
@@ -117,14 +120,13 @@ byte slaveGetSavedAlarmState(){
     while(Wire.available()){
       byte value = Wire.read();
       
-      Serial.print("Got savestate: ");
-      Serial.println(value); 
+      LOG(LOG_SAVED_STATE, value);
             
       if(currentMachine < NUMINPUTS && value <= 1){
-        pressed[currentMachine] = value;
+        if(value) inputStates.pressed |= INPUT_BIT(currentMachine);
+        else inputStates.pressed &= ~INPUT_BIT(currentMachine);
       }
       
-      lastTime = millis();      
       currentMachine++;
     }
     return 1;
@@ -145,30 +147,98 @@ unsigned long int slaveGetContactsCheckSum(){
   wireResponseCode = Wire.endTransmission();
 
   // Give the slave time to process
-  delay(10);
+  schedulerDelay(10);
 
   if (Wire.requestFrom(2, 4) == 4){
-    //Use a union to assembly the bytes back into an unsigned long
-    union bytes {
-      unsigned char c[4];
-      unsigned long int l;
+    // Assemble the little-endian bytes back into an unsigned long
+    unsigned long int checkSum = 0;
+    for(byte i = 0; i < 4; i++){
+      checkSum |= (unsigned long int)Wire.read() << (8 * i);
     }
-    myb;
 
-    myb.c[0] = Wire.read();
-    myb.c[1] = Wire.read();
-    myb.c[2] = Wire.read();
-    myb.c[3] = Wire.read();
-
-    return myb.l;
+    return checkSum;
   }
   return 0;
 }
 
+// Begin Contact Parser
+static ContactParser parser;
+static ContactText contactText;  // Line being parsed
+static byte contactLines = 0;   // Lines parsed, valid or not
+// End Contact Parser
+
+// Begin File Records
+// The records (lines) of the contacts file as last loaded, in file order:
+// the entry of the contacts array each one is stored in, or CONTACT_NO_ENTRY
+// for a rejected line, and its CRC32. Only the slave hashes a rejected line,
+// so its hash is 0 until a sync has fetched it once.
+#define CONTACT_NO_ENTRY 0xFF
+static byte fileRecords = 0;
+static byte recordEntry[CONTACTS_MAX_NUMBER];
+static uint32_t recordHash[CONTACTS_MAX_NUMBER];
+// End File Records
+
+// Begin Transfer Statistics
+unsigned long contactsTransferTime = 0;
+byte contactsTransferProtocol = 0;
+unsigned int contactsChunkRetries = 0;
+unsigned int contactsTransferBytes = 0;
+byte contactsRecordsFetched = 0;
+// End Transfer Statistics
+
+/**
+* Count a line that the parser has finished, and move on to the next
+* free entry of the contacts array if it was valid
+*/
+static void contactLineDone(byte result){
+  if(result == CONTACT_PARSE_MORE) return;
+  contactLines++;
+
+  if(contactLines <= CONTACTS_MAX_NUMBER){
+    recordEntry[contactLines - 1] = result == CONTACT_PARSE_DONE ? numContacts : CONTACT_NO_ENTRY;
+    recordHash[contactLines - 1] = result == CONTACT_PARSE_DONE ? contactText.hash : 0;
+    fileRecords = contactLines;
+  }
+
+  if(result == CONTACT_PARSE_DONE){
+    contactStore(numContacts, &contactText);
+    numContacts++;
+    if(numContacts < CONTACTS_MAX_NUMBER) parser.begin(&contactText);
+  }
+  else{
+    LOG(LOG_CONTACT_REJECTED, contactLines);
+  }
+}
+
+/**
+* Pass a received byte of the contacts file to the parser
+*/
+static void receiveContactByte(char c){
+  if(numContacts >= CONTACTS_MAX_NUMBER) return;
+  contactLineDone(parser.feed(c));
+}
+
+/**
+* End of the contacts file: parse a last line without a newline
+*/
+static void finishContacts(){
+  if(numContacts >= CONTACTS_MAX_NUMBER) return;
+  contactLineDone(parser.finish());
+}
+
+static void resetContactParser(){
+  contactRecordsBegin();
+  numContacts = 0;
+  contactLines = 0;
+  fileRecords = 0;
+  parser.begin(&contactText);
+}
+
 /**
 * Get the contacts from the slave. All contacts will be stored in the contacts array (contacts).
 * Data is buffered as it comes in over the I2C connection and is reassembled and parsed to extract data.
 * A CRC32 hash of the recieved data is generated.
+* This is the original protocol, used when the slave does not support block transfers.
 * 
 * fileSize: The filesize to request from the slave
 * 
@@ -177,7 +247,7 @@ unsigned long int slaveGetContactsCheckSum(){
 */
 unsigned long int slaveGetContacts(unsigned long fileSize){
   
-  unsigned long crc = ~0L;
+  uint32_t crc = 0xFFFFFFFF;
   
   // Request the contacts from the slave
   Wire.beginTransmission(2);
@@ -186,13 +256,9 @@ unsigned long int slaveGetContacts(unsigned long fileSize){
   wireResponseCode = Wire.endTransmission();
 
   // Let the slave open the SD card and prep the file for reading
-  delay(500);
+  schedulerDelay(500);
 
-  // Each line in the contacts.csv has a max length of 64 bytes.
-  // The max I2C transfer is 32 bytes, so two transmissions are concatenated in the buffer
-  char lineBuffer[64];
-  byte lIndex = 0;
-  numContacts = 0;
+  resetContactParser();
 
   // Counter for the total bytes recieved
   unsigned int totalBytes = 0;
@@ -201,72 +267,314 @@ unsigned long int slaveGetContacts(unsigned long fileSize){
   // after execution, transfer has failed and the loop breaks
   do{
 
-    Serial.print("Transferred: ");
-    Serial.print(totalBytes);
-    Serial.print("/");
-    Serial.println(fileSize);
+    LOG(LOG_CONTACTS_PROGRESS, totalBytes, fileSize);
     
-    Wire.requestFrom(2, 32);
+    contactsTransferBytes += Wire.requestFrom(2, 32);
 
     // Give the slave time to process
-    delay(75);
+    schedulerDelay(75);
 
     while(Wire.available()){
       char c = Wire.read();    // Receive a byte as character
       if(c > 0){
-        lineBuffer[lIndex] = c;
-        lIndex++;
-        Serial.print(c);
-        
         // Update the hash
         crc = crc_update(crc, c);        
+
+        receiveContactByte(c);
       }
       
       totalBytes++;
-      
-      // Check for a full contact (64 bytes)
-      if(c == '\n' || lIndex >= 64){
-        // Parse the contact details and store in the contacts array
-
-        char* temp;
-        byte strSize = 0;
-
-        // Group - Derefrence the pointer and convert char to decimal
-        contacts[numContacts]->group = (*strtok(lineBuffer, ",") - 48);
-
-        // Name
-        strSize = sizeof(contacts[numContacts]->name);
-        temp = strtok(NULL, ",");     
-        strncpy(contacts[numContacts]->name, temp, strSize - 1);
-        contacts[numContacts]->name[strSize - 1] = '\0'; //Null terminate the string
-
-        // Email
-        strSize = sizeof(contacts[numContacts]->email);
-        temp = strtok(NULL, ",");     
-        strncpy(contacts[numContacts]->email, temp, strSize - 1);
-        contacts[numContacts]->email[strSize - 1] = '\0'; //Null terminate the string
-
-        // Phone                
-        strSize = sizeof(contacts[numContacts]->phone);
-        temp = strtok(NULL, "\n");   
-        strncpy(contacts[numContacts]->phone, temp, strSize - 1);
-        contacts[numContacts]->phone[strSize - 1] = '\0'; //Null terminate the string        
-
-        numContacts++;        
-        lIndex = 0;        
-      }
     }
   } 
   
   while (totalBytes > 0 && totalBytes < fileSize);  // Loop as long data is coming in and there's still some remaining to transfer
+  finishContacts();
   
-  Serial.println();
-  Serial.print(F("Total bytes transferred:"));
-  Serial.println(totalBytes);
+  LOG(LOG_CONTACTS_BYTES, totalBytes);
   
   // Finalize the hash
   crc = ~crc;
   return crc;
 }
 
+/**
+* Ask the slave for the size of the contacts file (block transfer protocol)
+* info: Receives the CONTACTS_INFO_SIZE byte reply
+*
+* Returns:
+*   -CONTACTS_TRANSFER_OK, CONTACTS_TRANSFER_FAILED if the slave stays busy,
+*    or CONTACTS_TRANSFER_UNSUPPORTED if it only speaks the original protocol
+*/
+static byte slaveGetContactsInfo(byte *info){
+  Wire.beginTransmission(2);
+  Wire.write(COMM_TYPE_REQUEST);
+  Wire.write(REQUEST_ID_CONTACTS_INFO);
+  wireResponseCode = Wire.endTransmission();
+  if(wireResponseCode != 0) return CONTACTS_TRANSFER_FAILED;
+
+  // Poll until the slave has opened the file, rather than waiting a fixed time
+  for(byte attempt = 0; attempt < 100; attempt++){
+    byte length = Wire.requestFrom(2, CONTACTS_INFO_SIZE);
+    contactsTransferBytes += length;
+    for(byte i = 0; i < CONTACTS_INFO_SIZE; i++){
+      info[i] = Wire.available() ? Wire.read() : 0;
+    }
+
+    if(length == CONTACTS_INFO_SIZE && info[0] == CONTACTS_PROTOCOL_VERSION){
+      return CONTACTS_TRANSFER_OK;
+    }
+    if(length == 0 || info[0] != CONTACTS_STATUS_BUSY){
+      return CONTACTS_TRANSFER_UNSUPPORTED;
+    }
+    schedulerDelay(10);
+  }
+  return CONTACTS_TRANSFER_FAILED;
+}
+
+/**
+* Fetch and verify one chunk of the contacts file, or one part of a record,
+* asking again if it is missing or corrupted
+* requestId: REQUEST_ID_CONTACTS_CHUNK or REQUEST_ID_CONTACTS_RECORD
+* record: The record, for REQUEST_ID_CONTACTS_RECORD
+* seq: The chunk or part number
+* payload: Receives the CONTACTS_CHUNK_PAYLOAD file bytes
+*
+* Returns:
+*   -true if a valid chunk was received
+*/
+static boolean slaveGetContactsChunk(byte requestId, byte record, byte seq, byte *payload){
+  for(byte attempt = 0; attempt < CONTACTS_CHUNK_RETRIES; attempt++){
+    if(attempt > 0){
+      contactsChunkRetries++;
+      // Back off a little in case the slave is still reading the SD card
+      schedulerDelay(2 << attempt);
+    }
+
+    Wire.beginTransmission(2);
+    Wire.write(COMM_TYPE_REQUEST);
+    Wire.write(requestId);
+    if(requestId == REQUEST_ID_CONTACTS_RECORD) Wire.write(record);
+    Wire.write(seq);
+    wireResponseCode = Wire.endTransmission();
+    if(wireResponseCode != 0) continue;
+
+    byte length = Wire.requestFrom(2, CONTACTS_CHUNK_SIZE);
+    contactsTransferBytes += length;
+    if(length != CONTACTS_CHUNK_SIZE) continue;
+
+    byte crc = 0;
+    byte received = Wire.read();
+    crc = crc8_update(crc, received);
+    for(byte i = 0; i < CONTACTS_CHUNK_PAYLOAD; i++){
+      payload[i] = Wire.read();
+      crc = crc8_update(crc, payload[i]);
+    }
+
+    if(received == seq && crc == Wire.read()) return true;
+  }
+  return false;
+}
+
+/**
+* Get the contacts from the slave with the block transfer protocol. The
+* slave reports the exact file length first, then the file is fetched in
+* numbered chunks protected by a CRC-8. The whole file is checked against
+* the CRC32 and record count from the header.
+*
+* Returns:
+*   -CONTACTS_TRANSFER_OK if the contacts array holds the verified file
+*   -CONTACTS_TRANSFER_FAILED if the transfer could not be completed
+*   -CONTACTS_TRANSFER_UNSUPPORTED if the slave only speaks the original protocol
+*/
+byte slaveGetContactsBlocks(){
+  byte info[CONTACTS_INFO_SIZE];
+  byte status = slaveGetContactsInfo(info);
+  if(status != CONTACTS_TRANSFER_OK) return status;
+
+  unsigned int fileLength = info[1] | ((unsigned int)info[2] << 8);
+  byte records = info[3];
+  uint32_t expectedCrc = 0;
+  for(byte i = 0; i < 4; i++){
+    expectedCrc |= (uint32_t)info[4 + i] << (8 * i);
+  }
+
+  if(fileLength > CONTACTS_MAX_NUMBER * 64) return CONTACTS_TRANSFER_FAILED;
+
+  uint32_t crc = 0xFFFFFFFF;
+  byte payload[CONTACTS_CHUNK_PAYLOAD];
+  unsigned int offset = 0;
+  resetContactParser();
+
+  for(byte seq = 0; offset < fileLength; seq++){
+    if(!slaveGetContactsChunk(REQUEST_ID_CONTACTS_CHUNK, 0, seq, payload)){
+      LOG(LOG_CONTACTS_CHUNK_FAILED, seq);
+      numContacts = 0;
+      return CONTACTS_TRANSFER_FAILED;
+    }
+
+    byte length = fileLength - offset < CONTACTS_CHUNK_PAYLOAD ? fileLength - offset : CONTACTS_CHUNK_PAYLOAD;
+    crc = crc_update_block(crc, payload, length);
+    for(byte i = 0; i < length; i++){
+      receiveContactByte(payload[i]);
+    }
+    offset += length;
+  }
+
+  finishContacts();
+
+  LOG(LOG_CONTACTS_BYTES, offset);
+
+  if(~crc != expectedCrc || contactLines != records){
+    numContacts = 0;
+    return CONTACTS_TRANSFER_FAILED;
+  }
+  return CONTACTS_TRANSFER_OK;
+}
+
+/**
+* Get the CRC32 of every record of the contacts file from the slave
+* hashes: Receives CONTACTS_MAX_NUMBER hashes
+* count: Receives the number of records
+*
+* Returns:
+*   -CONTACTS_TRANSFER_OK, CONTACTS_TRANSFER_FAILED, or CONTACTS_TRANSFER_UNSUPPORTED
+*    if the slave does not provide record hashes
+*/
+static byte slaveGetContactHashes(uint32_t *hashes, byte *count){
+  byte first = 0;
+  byte attempt = 0;
+  *count = 0;
+
+  do{
+    Wire.beginTransmission(2);
+    Wire.write(COMM_TYPE_REQUEST);
+    Wire.write(REQUEST_ID_CONTACTS_HASHES);
+    Wire.write(first);
+    wireResponseCode = Wire.endTransmission();
+    if(wireResponseCode != 0) return CONTACTS_TRANSFER_FAILED;
+
+    byte reply[CONTACTS_HASHES_SIZE];
+    byte length = Wire.requestFrom(2, CONTACTS_HASHES_SIZE);
+    contactsTransferBytes += length;
+    for(byte i = 0; i < CONTACTS_HASHES_SIZE; i++){
+      reply[i] = Wire.available() ? Wire.read() : 0;
+    }
+    if(length == 1 && reply[0] == I2C_STATUS_IDLE) return CONTACTS_TRANSFER_UNSUPPORTED;
 
+    byte crc = 0;
+    for(byte i = 0; i < CONTACTS_HASHES_SIZE - 1; i++){
+      crc = crc8_update(crc, reply[i]);
+    }
+    if(length != CONTACTS_HASHES_SIZE || reply[0] != first || crc != reply[CONTACTS_HASHES_SIZE - 1]){
+      // Ask again for the same records
+      contactsChunkRetries++;
+      if(++attempt >= CONTACTS_CHUNK_RETRIES) return CONTACTS_TRANSFER_FAILED;
+      continue;
+    }
+    attempt = 0;
+
+    *count = reply[1];
+    if(*count > CONTACTS_MAX_NUMBER) return CONTACTS_TRANSFER_FAILED;
+
+    for(byte i = 0; i < CONTACTS_HASHES_PER_REPLY && first < *count; i++, first++){
+      hashes[first] = 0;
+      for(byte j = 0; j < 4; j++){
+        hashes[first] |= (uint32_t)reply[2 + 4 * i + j] << (8 * j);
+      }
+    }
+  } while(first < *count);
+
+  return CONTACTS_TRANSFER_OK;
+}
+
+/**
+* Fetch one record of the contacts file and store it in the contacts array
+* record: The record number
+* entry: The entry that receives it. It is left unchanged unless the record
+*        is a valid contact.
+* hash: The CRC32 the record must match
+*
+* Returns:
+*   -CONTACT_PARSE_DONE if the record was received intact and stored
+*   -CONTACT_PARSE_ERROR if the whole line was received but is malformed
+*   -CONTACT_PARSE_MORE if the record could not be received intact
+*/
+static byte slaveGetContactRecord(byte record, byte entry, uint32_t hash){
+  byte payload[CONTACTS_CHUNK_PAYLOAD];
+  byte result = CONTACT_PARSE_MORE;
+  ContactText parsed;
+  ContactParser recordParser;
+
+  recordParser.begin(&parsed);
+
+  // A line of up to 64 bytes and its newline span at most three parts
+  for(byte part = 0; result == CONTACT_PARSE_MORE && part < 3; part++){
+    if(!slaveGetContactsChunk(REQUEST_ID_CONTACTS_RECORD, record, part, payload)) return CONTACT_PARSE_MORE;
+
+    // The line ends with a newline, or with the zero padding after the last record
+    for(byte i = 0; i < CONTACTS_CHUNK_PAYLOAD && result == CONTACT_PARSE_MORE; i++){
+      result = payload[i] == 0 ? recordParser.finish() : recordParser.feed(payload[i]);
+      if(payload[i] == 0 && result == CONTACT_PARSE_MORE) return CONTACT_PARSE_MORE;
+    }
+  }
+
+  // Each part is CRC checked, but only a valid line has a hash of its own
+  if(result == CONTACT_PARSE_DONE && recordParser.hash != hash) return CONTACT_PARSE_MORE;
+  if(result == CONTACT_PARSE_DONE) contactStore(entry, &parsed);
+  return result;
+}
+
+/**
+* Bring the contacts array up to date by fetching only the records whose
+* CRC32 differs from the one loaded. Rejected lines take no entry, so a
+* record is also fetched again when a change before it moves its entry.
+*
+* Returns:
+*   -CONTACTS_TRANSFER_OK if the contacts array matches the slave's file
+*   -CONTACTS_TRANSFER_FAILED if a record could not be fetched
+*   -CONTACTS_TRANSFER_UNSUPPORTED if the slave does not provide record hashes
+*/
+byte slaveSyncContacts(){
+  uint32_t hashes[CONTACTS_MAX_NUMBER];
+  byte count;
+
+  byte status = slaveGetContactHashes(hashes, &count);
+  if(status != CONTACTS_TRANSFER_OK) return status;
+
+  byte entry = 0;
+  for(byte i = 0; i < count; i++){
+    boolean same = i < fileRecords && recordHash[i] == hashes[i];
+    if(same && recordEntry[i] == CONTACT_NO_ENTRY) continue;
+    if(same && recordEntry[i] == entry){
+      entry++;
+      continue;
+    }
+
+    byte result = slaveGetContactRecord(i, entry, hashes[i]);
+    if(result == CONTACT_PARSE_MORE){
+      LOG(LOG_CONTACT_RECORD_FAILED, i);
+      return CONTACTS_TRANSFER_FAILED;
+    }
+    contactsRecordsFetched++;
+    recordHash[i] = hashes[i];
+
+    if(result == CONTACT_PARSE_DONE){
+      recordEntry[i] = entry++;
+      // Records are fetched in order, so the entries before are all valid
+      if(entry > numContacts) numContacts = entry;
+    }
+    else{
+      recordEntry[i] = CONTACT_NO_ENTRY;
+      LOG(LOG_CONTACT_REJECTED, i + 1);
+    }
+  }
+
+  // Entries left over from records removed or rejected
+  for(byte i = entry; i < numContacts; i++){
+    contactClear(i);
+  }
+  numContacts = entry;
+  fileRecords = count;
+
+  return CONTACTS_TRANSFER_OK;
+}
@@ -1,6 +1,11 @@
 #ifndef SCF_H
 #define SCF_H
 
+// Results of slaveGetContactsBlocks()
+#define CONTACTS_TRANSFER_OK 0
+#define CONTACTS_TRANSFER_FAILED 1
+#define CONTACTS_TRANSFER_UNSUPPORTED 2
+
 extern void slaveSetAlarm(byte);
 extern void slaveClearAlarm(byte);
 extern void slaveSetAlarmResponse(byte, char);
@@ -9,4 +14,13 @@ extern byte slaveGetAlarmDisabledHours(void);
 extern byte slaveGetSavedAlarmState(void);
 extern unsigned long int slaveGetContactsCheckSum(void);
 extern unsigned long int slaveGetContacts(unsigned long);
+extern byte slaveGetContactsBlocks(void);
+extern byte slaveSyncContacts(void);
+
+// Statistics of the last contacts load
+extern unsigned long contactsTransferTime;
+extern byte contactsTransferProtocol;
+extern unsigned int contactsChunkRetries;
+extern unsigned int contactsTransferBytes;
+extern byte contactsRecordsFetched;
 #endif
\ No newline at end of file
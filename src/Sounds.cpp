@@ -1,47 +1,159 @@
 /*
   Sounds
   
-  Provides functions for tone playback
+  Timer2 melody sequencer and the alarm's melodies. The timer runs in CTC
+  mode at twice the note frequency, with the prescaler picked per note as in
+  libold/Tone, and the interrupt toggles PIN_SPEAKER (which is not an OC2
+  pin) through its port register.
 */
 #include <Arduino.h>
 #include "MegaMaster.h"
 #include "Pitches.h"
 #include "Sounds.h"
+
+// Begin Melodies
+static const MelodyNote melodySuccess[] PROGMEM = { {NOTE_A5, 200}, {NOTE_D5, 350}, {0, 0} };
+static const MelodyNote melodyFail[] PROGMEM = { {NOTE_F5, 200}, {NOTE_E5, 300}, {NOTE_B5, 250}, {0, 0} };
+static const MelodyNote melodyAlarm[] PROGMEM = { {NOTE_B5, 150}, {NOTE_F5, 150}, {0, 0} };
+static const MelodyNote melodyShortBeep[] PROGMEM = { {NOTE_A5, 200}, {0, 0} };
+static const MelodyNote melodyLongBeep[] PROGMEM = { {NOTE_C6, 1000}, {0, 0} };
+// End Melodies
+
+// Rests are timed by the same interrupt, at this rate
+#define REST_FREQUENCY 1000
+
+// Shift of each Timer2 clock select (CS22:0 = 1 to 7): ck/1, 8, 32, 64, 128, 256, 1024
+static const byte prescalerShift[] = { 0, 3, 5, 6, 7, 8, 10 };
+
+// Begin Sequencer State
+// Shared with the interrupt: only changed from outside it with interrupts off
+static volatile uint8_t *speakerPort;
+static uint8_t speakerMask;
+static const MelodyNote *volatile nextNote = NULL;   // NULL when idle
+static volatile byte playingPriority = 0;
+static const MelodyNote *volatile queued = NULL;
+static volatile uint16_t toggles = 0;              // Left in the current note
+static volatile boolean resting = false;
+// End Sequencer State
+
+/**
+* Set up the speaker pin. Call before playing anything.
+*/
+void soundBegin(){
+  pinMode(PIN_SPEAKER, OUTPUT);
+  speakerPort = portOutputRegister(digitalPinToPort(PIN_SPEAKER));
+  speakerMask = digitalPinToBitMask(PIN_SPEAKER);
+}
+
 /**
-* Plays the note for the duration specified.
-* This will block program execution until the note has finished playing
-* note: Note to play (See Pitches.h)
-* duration: Duration of the note in milliseconds
+* Program Timer2 for the next note. Called from the interrupt, or with
+* interrupts off.
+*
+* Returns:
+*   -false at the end of the melody
 */
-void playTone(int note, int duration) {
-  for (long i = 0; i < duration * 1000L; i += note * 2) {
-    digitalWrite(PIN_SPEAKER, HIGH);
-    delayMicroseconds(note);
-    digitalWrite(PIN_SPEAKER, LOW);
-    delayMicroseconds(note);
+static boolean loadNote(){
+  uint16_t frequency = pgm_read_word(&nextNote->frequency);
+  uint16_t duration = pgm_read_word(&nextNote->duration);
+  if(duration == 0) return false;
+  nextNote++;
+
+  resting = frequency == 0;
+  if(resting) frequency = REST_FREQUENCY;
+
+  // Timer counts per half period, with the smallest prescaler that fits 8 bits
+  uint32_t counts = F_CPU / 2 / frequency;
+  byte select = 0;
+  while((counts >> prescalerShift[select]) > 256 && select < sizeof(prescalerShift) - 1) select++;
+  counts >>= prescalerShift[select];
+  if(counts > 256) counts = 256;
+
+  OCR2A = counts - 1;
+  TCNT2 = 0;
+  TCCR2B = select + 1;
+  toggles = (uint32_t)2 * frequency * duration / 1000;
+  return true;
+}
+
+static void stopTimer(){
+  TIMSK2 &= ~_BV(OCIE2A);
+  TCCR2B = 0;
+  nextNote = NULL;
+  playingPriority = 0;
+}
+
+ISR(TIMER2_COMPA_vect){
+  if(toggles > 0){
+    if(!resting) *speakerPort ^= speakerMask;
+    toggles--;
+    return;
   }
+
+  // Note done: keep the speaker off between notes
+  *speakerPort &= ~speakerMask;
+  if(loadNote()) return;
+
+  if(queued != NULL){
+    nextNote = queued;
+    queued = NULL;
+    if(loadNote()) return;
+  }
+  stopTimer();
+}
+
+/**
+* Start a melody in the background
+* melody: PROGMEM notes
+* priority: SOUND_PRIORITY_
+*/
+void soundPlay(const MelodyNote *melody, byte priority){
+  cli();
+  if(nextNote == NULL || priority > playingPriority){
+    *speakerPort &= ~speakerMask;
+    queued = NULL;
+    nextNote = melody;
+    playingPriority = priority;
+    if(loadNote()){
+      TCCR2A = _BV(WGM21);   // CTC: count up to OCR2A
+      TIMSK2 |= _BV(OCIE2A);
+    }
+    else{
+      stopTimer();
+    }
+  }
+  else if(priority == playingPriority){
+    queued = melody;
+  }
+  sei();
+}
+
+boolean soundBusy(){
+  return nextNote != NULL;
+}
+
+/**
+* Block until the sounds have played, before a reset
+*/
+void soundWait(){
+  while(soundBusy()) delay(1);
 }
 
 void playSuccessSound(){
-  playTone(NOTE_A5, 200);
-  playTone(NOTE_D5, 350);
+  soundPlay(melodySuccess, SOUND_PRIORITY_STATUS);
 }
 
 void playFailSound(){
-  playTone(NOTE_F5, 200);
-  playTone(NOTE_E5, 300);
-  playTone(NOTE_B5, 250);
+  soundPlay(melodyFail, SOUND_PRIORITY_ALARM);
 }
 
 void playAlarmSound(){
-  playTone(NOTE_B5, 150);
-  playTone(NOTE_F5, 150);
+  soundPlay(melodyAlarm, SOUND_PRIORITY_ALARM);
 }
 
 void playShortBeepSound(){
-  playTone(NOTE_A5, 200);
+  soundPlay(melodyShortBeep, SOUND_PRIORITY_STATUS);
 }
 
 void playLongBeepSound(){
-  playTone(NOTE_C6, 1000);
+  soundPlay(melodyLongBeep, SOUND_PRIORITY_STATUS);
 }
@@ -1,10 +1,33 @@
 #ifndef Sounds_H
 #define Sounds_H
+/*
+  Sounds
+
+  Melodies are played in the background by Timer2: its compare interrupt
+  toggles the speaker and moves on to the next note by itself, so starting
+  a sound returns at once. A melody of higher priority preempts the one
+  playing. One of the same priority is queued to follow it, and one of
+  lower priority is dropped.
+*/
+
+// A note of a PROGMEM melody. frequency 0 is a rest, duration 0 ends the melody.
+struct MelodyNote
+{
+  uint16_t frequency;   // Hz, see Pitches.h
+  uint16_t duration;    // ms
+};
+
+#define SOUND_PRIORITY_STATUS 1
+#define SOUND_PRIORITY_ALARM 2
+
+extern void soundBegin(void);
+extern void soundPlay(const MelodyNote *, byte);
+extern boolean soundBusy(void);
+extern void soundWait(void);
+
 extern void playLongBeepSound(void);
 extern void playSuccessSound(void);
 extern void playAlarmSound(void);
-extern void playLongBeepSound(void);
 extern void playShortBeepSound(void);
 extern void playFailSound(void);
-extern void playSuccessSound(void);
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,40 @@
+#ifndef POOL_H
+#define POOL_H
+/*
+  Static Pool
+
+  Fixed-capacity storage for N objects of type T, sized at compile time and
+  placed in .bss with the other globals. It replaces individual `new`
+  allocations: there are no malloc headers, no fragmentation, and the RAM
+  cost (StaticPool<T, N>::BYTES) is known when the firmware is linked.
+  Objects are handed out in order and never returned.
+*/
+
+template <typename T, byte N>
+class StaticPool
+{
+public:
+  static const unsigned int BYTES = sizeof(T) * N;
+
+  StaticPool() : used(0) {}
+
+  /**
+  * Take the next free object. It is zero-initialized, as the pool is static.
+  *
+  * Returns:
+  *   -The object, or NULL once all N have been handed out
+  */
+  T *allocate(){
+    if(used >= N) return NULL;
+    return &items[used++];
+  }
+
+  byte size() const { return used; }
+  byte capacity() const { return N; }
+
+private:
+  T items[N];
+  byte used;
+};
+
+#endif
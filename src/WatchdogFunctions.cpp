@@ -34,6 +34,7 @@
 // avr-libc library includes
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include "Log.h"
 
 
 #define PIN_RESET_ARDUINO 4
@@ -64,7 +65,7 @@ void SetupWatchdog(){
 }
 
 void HardwareReset(){
-  Serial.println("Reset");
+  LOG(LOG_HARDWARE_RESET);
   digitalWrite(PIN_RESET_ARDUINO, LOW);
 }
 